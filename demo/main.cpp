@@ -155,6 +155,9 @@ void showObjectGUI(const ofbx::Object& object)
 		case ofbx::Object::Type::ANIMATION_LAYER: label = "animation layer"; break;
 		case ofbx::Object::Type::ANIMATION_CURVE: label = "animation curve"; break;
 		case ofbx::Object::Type::ANIMATION_CURVE_NODE: label = "animation curve node"; break;
+		case ofbx::Object::Type::BLEND_SHAPE: label = "blend shape"; break;
+		case ofbx::Object::Type::BLEND_SHAPE_CHANNEL: label = "blend shape channel"; break;
+		case ofbx::Object::Type::SHAPE: label = "shape"; break;
 		default: assert(false); break;
 	}
 
@@ -200,96 +203,6 @@ void showObjectsGUI(const ofbx::IScene& scene)
 }
 
 
-bool saveAsOBJ(ofbx::IScene& scene, const char* path)
-{
-	FILE* fp = fopen(path, "wb");
-	if (!fp) return false;
-	int obj_idx = 0;
-	int indices_offset = 0;
-	int normals_offset = 0;
-	int mesh_count = scene.getMeshCount();
-	for (int i = 0; i < mesh_count; ++i)
-	{
-		fprintf(fp, "o obj%d\ng grp%d\n", i, obj_idx);
-
-		const ofbx::Mesh& mesh = *scene.getMesh(i);
-		const ofbx::Geometry& geom = *mesh.getGeometry();
-		auto vertices = geom.getVertices();
-		fprintf(fp, "# %d vertices\n", vertices.size());
-		for (int i = 0; i < vertices.size(); ++i)
-		{
-			const ofbx::Vec3& v = vertices[i];
-			fprintf(fp, "v %f %f %f\n", v.x, v.y, v.z);
-		}
-
-		auto normals = geom.getNormals();
-		fprintf(fp, "# %d normals\n", normals.size());
-		for (int i = 0; i < normals.size(); ++i)
-		{
-			const ofbx::Vec3& n = normals[i];
-			fprintf(fp, "vn %f %f %f\n", n.x, n.y, n.z);
-		}
-
-		auto uvs = geom.getUVs();
-		fprintf(fp, "# %d UV\n", uvs.size());
-		for (int i = 0; i < uvs.size(); ++i)
-		{
-			ofbx::Vec2 uv = uvs[i];
-			fprintf(fp, "vt %f %f\n", uv.x, uv.y);
-		}
-
-		size_t count = geom.getTriangleCount();
-		auto indices = geom.getTriangles();
-		fprintf(fp, "# %d triangles\n", count);
-		for (size_t i = 0; i < count; ++i) {
-			int v0 = indices[i * 3]+1;
-			int v1 = indices[i * 3+1]+1;
-			int v2 = indices[i * 3+2]+1;
-			fprintf(fp, "f %i %i %i\n", v0,v1,v2);
-		}
-#if 0
-		bool new_face = true;
-		int count = geom.getVertexCount();
-		for (int i = 0; i < count; ++i)
-		{
-			if (new_face)
-			{
-				fputs("f ", fp);
-				new_face = false;
-			}
-			int idx = i + 1;
-			int vertex_idx = indices_offset + idx;
-			fprintf(fp, "%d", vertex_idx);
-			if (has_normals)
-			{
-				fprintf(fp, "/%d", idx);
-			}
-			else
-			{
-				fprintf(fp, "/");
-			}
-
-			if (has_uvs)
-			{
-				fprintf(fp, "/%d", idx);
-			}
-			else
-			{
-				fprintf(fp, "/");
-			}
-			new_face = idx < 0;
-			fputc(new_face ? '\n' : ' ', fp);
-		}
-
-		indices_offset += vertex_count;
-#endif
-		++obj_idx;
-	}
-	fclose(fp);
-	return true;
-}
-
-
 void onGUI()
 {
 
@@ -580,7 +493,7 @@ bool init()
 	auto* content = new ofbx::u8[file_size];
 	fread(content, 1, file_size, fp);
 	g_scene = ofbx::load((ofbx::u8*)content, file_size);
-	saveAsOBJ(*g_scene, "out.obj");
+	ofbx::exportScene(*g_scene, "out.obj", ofbx::ExportSettings());
 	delete[] content;
 	fclose(fp);
 
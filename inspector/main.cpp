@@ -0,0 +1,674 @@
+// Headless inspector: loads FBX files, or every .fbx in directories (in parallel), and prints scene statistics,
+// load stage timings and memory usage as text or JSON; optionally dumps the element tree or exports geometry
+#include "ofbx.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+
+// live and peak bytes of one load, never freed because blocks counted for it can outlive the report
+struct MemoryCounter
+{
+	std::atomic<long long> memory{0};
+	std::atomic<long long> peak{0};
+};
+
+
+// every allocation is prefixed with its size and the counter it was counted for, so it can be freed on any thread;
+// a thread counts for the load it runs, the library's worker threads inherit the counter through ThreadHooks
+static thread_local MemoryCounter* g_thread_counter = nullptr;
+static const size_t ALLOC_HEADER = 16;
+
+
+static void* captureCounter()
+{
+	return g_thread_counter;
+}
+
+
+static void enterCounter(void* counter)
+{
+	g_thread_counter = (MemoryCounter*)counter;
+}
+
+
+static void leaveCounter(void*)
+{
+	g_thread_counter = nullptr;
+}
+
+
+// not inlined into the replaced operators, GCC would otherwise warn about the header access
+__attribute__((noinline)) static void* trackedAlloc(size_t size)
+{
+	unsigned char* ptr = (unsigned char*)malloc(size + ALLOC_HEADER);
+	if (!ptr) return nullptr;
+	MemoryCounter* counter = g_thread_counter;
+	memcpy(ptr, &size, sizeof(size));
+	memcpy(ptr + sizeof(size), &counter, sizeof(counter));
+	if (counter)
+	{
+		const long long memory = counter->memory += size;
+		long long peak = counter->peak.load(std::memory_order_relaxed);
+		while (memory > peak && !counter->peak.compare_exchange_weak(peak, memory)) {}
+	}
+	return ptr + ALLOC_HEADER;
+}
+
+
+__attribute__((noinline)) static void trackedFree(void* ptr)
+{
+	if (!ptr) return;
+	unsigned char* block = (unsigned char*)ptr - ALLOC_HEADER;
+	size_t size;
+	MemoryCounter* counter;
+	memcpy(&size, block, sizeof(size));
+	memcpy(&counter, block + sizeof(size), sizeof(counter));
+	if (counter) counter->memory -= size;
+	free(block);
+}
+
+
+void* operator new(size_t size)
+{
+	void* ptr = trackedAlloc(size);
+	// the library is built without exceptions
+	if (!ptr) abort();
+	return ptr;
+}
+
+
+void* operator new[](size_t size)
+{
+	void* ptr = trackedAlloc(size);
+	if (!ptr) abort();
+	return ptr;
+}
+
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return trackedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return trackedAlloc(size); }
+void operator delete(void* ptr) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+
+
+struct Options
+{
+	bool json = false;
+	bool tree = false;
+	int tree_depth = 1 << 30;
+	const char* export_dir = nullptr;
+	ofbx::ExportSettings::Format export_format = ofbx::ExportSettings::OBJ;
+	int thread_count = 0;
+	double max_ms = 0;
+	double max_memory_mb = 0;
+	ofbx::LoadSettings load_settings;
+};
+
+
+static const int OBJECT_TYPE_COUNT = (int)ofbx::Object::Type::SHAPE + 1;
+static const char* OBJECT_TYPE_NAMES[OBJECT_TYPE_COUNT] = {
+	"root",
+	"geometry",
+	"material",
+	"mesh",
+	"texture",
+	"limb_node",
+	"null_node",
+	"node_attribute",
+	"cluster",
+	"skin",
+	"animation_stack",
+	"animation_layer",
+	"animation_curve",
+	"animation_curve_node",
+	"blend_shape",
+	"blend_shape_channel",
+	"shape"};
+
+
+struct FileReport
+{
+	std::string path;
+	bool ok = false;
+	std::string error;
+	long long file_size = 0;
+	double read_ms = 0;
+	double load_ms = 0;
+	ofbx::LoadStats stages;
+	long long peak_memory = 0;
+	long long retained_memory = 0;
+
+	int object_counts[OBJECT_TYPE_COUNT] = {};
+	int meshes = 0;
+	long long triangles = 0;
+	long long vertices = 0;
+	int bones = 0;
+	long long keys = 0;
+	int takes = 0;
+
+	bool slow = false;
+	bool heavy = false;
+	bool exported = false;
+	std::string tree;
+};
+
+
+static double toMs(std::chrono::steady_clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+
+static void appendf(std::string* out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+static void appendf(std::string* out, const char* format, ...)
+{
+	char tmp[1024];
+	va_list args;
+	va_start(args, format);
+	const int size = vsnprintf(tmp, sizeof(tmp), format, args);
+	va_end(args);
+	if (size > 0) out->append(tmp, std::min(size, (int)sizeof(tmp) - 1));
+}
+
+
+static void appendJSONString(std::string* out, const ofbx::u8* begin, const ofbx::u8* end)
+{
+	out->push_back('"');
+	for (const ofbx::u8* c = begin; c != end; ++c)
+	{
+		switch (*c)
+		{
+			case '"': out->append("\\\""); break;
+			case '\\': out->append("\\\\"); break;
+			case '\n': out->append("\\n"); break;
+			case '\t': out->append("\\t"); break;
+			default:
+				if (*c < 0x20)
+					appendf(out, "\\u%04x", *c);
+				else
+					out->push_back((char)*c);
+				break;
+		}
+	}
+	out->push_back('"');
+}
+
+
+static void appendJSONString(std::string* out, const char* str)
+{
+	appendJSONString(out, (const ofbx::u8*)str, (const ofbx::u8*)str + strlen(str));
+}
+
+
+static void appendProperty(std::string* out, const ofbx::IElementProperty& prop, bool json)
+{
+	const ofbx::DataView value = prop.getValue();
+	switch (prop.getType())
+	{
+		case ofbx::IElementProperty::STRING:
+			if (json)
+			{
+				appendJSONString(out, value.begin, value.end);
+			}
+			else
+			{
+				// object names are "name\0\1class", show only the readable part
+				const ofbx::u8* end = value.begin;
+				while (end != value.end && end - value.begin < 64 && *end >= 0x20) ++end;
+				out->push_back('"');
+				out->append((const char*)value.begin, end - value.begin);
+				out->append(end != value.end ? "...\"" : "\"");
+			}
+			break;
+		case ofbx::IElementProperty::LONG:
+		{
+			long long v;
+			memcpy(&v, value.begin, sizeof(v));
+			appendf(out, "%lld", v);
+			break;
+		}
+		case ofbx::IElementProperty::INTEGER:
+		{
+			int v;
+			memcpy(&v, value.begin, sizeof(v));
+			appendf(out, "%d", v);
+			break;
+		}
+		case ofbx::IElementProperty::FLOAT:
+		{
+			float v;
+			memcpy(&v, value.begin, sizeof(v));
+			appendf(out, "%.9g", v);
+			break;
+		}
+		case ofbx::IElementProperty::DOUBLE:
+		{
+			double v;
+			memcpy(&v, value.begin, sizeof(v));
+			appendf(out, "%.17g", v);
+			break;
+		}
+		case ofbx::IElementProperty::ARRAY_DOUBLE:
+		case ofbx::IElementProperty::ARRAY_INT:
+		case ofbx::IElementProperty::ARRAY_LONG:
+		case ofbx::IElementProperty::ARRAY_FLOAT:
+			appendf(out, json ? "\"%c[%d]\"" : "%c[%d]", (char)prop.getType(), prop.getCount());
+			break;
+		default: appendf(out, json ? "\"%c\"" : "%c", (char)prop.getType()); break;
+	}
+}
+
+
+static void dumpElement(std::string* out, const ofbx::IElement& element, int depth, int max_depth, bool json)
+{
+	const ofbx::DataView id = element.getID();
+	if (json)
+	{
+		out->append("{\"id\":");
+		appendJSONString(out, id.begin, id.end);
+		out->append(",\"properties\":[");
+		for (const ofbx::IElementProperty* prop = element.getFirstProperty(); prop; prop = prop->getNext())
+		{
+			appendProperty(out, *prop, true);
+			if (prop->getNext()) out->push_back(',');
+		}
+		out->append("],\"children\":[");
+		if (depth < max_depth)
+		{
+			for (const ofbx::IElement* child = element.getFirstChild(); child; child = child->getSibling())
+			{
+				dumpElement(out, *child, depth + 1, max_depth, true);
+				if (child->getSibling()) out->push_back(',');
+			}
+		}
+		out->append("]}");
+		return;
+	}
+
+	if (depth > 0)
+	{
+		out->append(depth * 2, ' ');
+		out->append((const char*)id.begin, id.end - id.begin);
+		for (const ofbx::IElementProperty* prop = element.getFirstProperty(); prop; prop = prop->getNext())
+		{
+			out->push_back(' ');
+			appendProperty(out, *prop, false);
+		}
+		out->push_back('\n');
+	}
+	if (depth >= max_depth) return;
+	for (const ofbx::IElement* child = element.getFirstChild(); child; child = child->getSibling())
+	{
+		dumpElement(out, *child, depth + 1, max_depth, false);
+	}
+}
+
+
+static void gatherStats(const ofbx::IScene& scene, FileReport* report)
+{
+	const ofbx::Object* const* objects = scene.getAllObjects();
+	std::vector<const ofbx::Object*> bones;
+	for (int i = 0, c = scene.getAllObjectCount(); i < c; ++i)
+	{
+		const ofbx::Object& obj = *objects[i];
+		const int type = (int)obj.getType();
+		if (type >= 0 && type < OBJECT_TYPE_COUNT) ++report->object_counts[type];
+
+		if (obj.getType() == ofbx::Object::Type::ANIMATION_CURVE)
+		{
+			report->keys += ((const ofbx::AnimationCurve&)obj).getKeyCount();
+		}
+		else if (obj.getType() == ofbx::Object::Type::CLUSTER)
+		{
+			const ofbx::Object* link = ((const ofbx::Cluster&)obj).getLink();
+			if (link) bones.push_back(link);
+		}
+	}
+	std::sort(bones.begin(), bones.end());
+	report->bones = int(std::unique(bones.begin(), bones.end()) - bones.begin());
+
+	report->meshes = scene.getMeshCount();
+	for (int i = 0; i < report->meshes; ++i)
+	{
+		const ofbx::Geometry* geom = scene.getMesh(i)->getGeometry();
+		if (!geom) continue;
+		report->triangles += geom->getTriangleCount();
+		report->vertices += geom->getVertices().size();
+	}
+	report->takes = scene.getAnimationStackCount();
+}
+
+
+static std::string getExportPath(const Options& options, const std::string& path)
+{
+	const size_t slash = path.find_last_of('/');
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	const size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos) name.resize(dot);
+	return std::string(options.export_dir) + "/" + name + (options.export_format == ofbx::ExportSettings::OBJ ? ".obj" : ".ply");
+}
+
+
+static void inspectFile(const Options& options, FileReport* report)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	FILE* fp = fopen(report->path.c_str(), "rb");
+	if (!fp)
+	{
+		report->error = "Failed to open file";
+		return;
+	}
+	fseek(fp, 0, SEEK_END);
+	report->file_size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	std::vector<ofbx::u8> content((size_t)report->file_size);
+	const bool read = content.empty() || fread(&content[0], 1, content.size(), fp) == content.size();
+	fclose(fp);
+	if (!read)
+	{
+		report->error = "Failed to read file";
+		return;
+	}
+	report->read_ms = toMs(std::chrono::steady_clock::now() - start);
+
+	// the file content is not part of the scene's memory; parsing temporaries kept by the thread are released
+	// so the next load starts from nothing too
+	MemoryCounter* counter = new MemoryCounter;
+	g_thread_counter = counter;
+	start = std::chrono::steady_clock::now();
+	ofbx::IScene* scene = ofbx::load(content.empty() ? nullptr : &content[0], (int)content.size(), options.load_settings);
+	report->load_ms = toMs(std::chrono::steady_clock::now() - start);
+	ofbx::releaseScratchMemory();
+	g_thread_counter = nullptr;
+	report->peak_memory = counter->peak;
+	report->retained_memory = counter->memory;
+	if (!scene)
+	{
+		report->error = ofbx::getError();
+		return;
+	}
+
+	report->ok = true;
+	report->stages = scene->getLoadStats();
+	gatherStats(*scene, report);
+	report->slow = options.max_ms > 0 && report->load_ms > options.max_ms;
+	report->heavy = options.max_memory_mb > 0 && report->peak_memory > options.max_memory_mb * 1024 * 1024;
+
+	if (options.tree) dumpElement(&report->tree, *scene->getRootElement(), 0, options.tree_depth, options.json);
+	if (options.export_dir)
+	{
+		ofbx::ExportSettings settings;
+		settings.format = options.export_format;
+		// files are already processed in parallel
+		settings.thread_count = 1;
+		report->exported = ofbx::exportScene(*scene, getExportPath(options, report->path).c_str(), settings);
+	}
+	scene->destroy();
+}
+
+
+static bool hasFBXExtension(const char* name)
+{
+	const size_t len = strlen(name);
+	return len > 4 && strcasecmp(name + len - 4, ".fbx") == 0;
+}
+
+
+static void gatherFiles(const std::string& path, std::vector<std::string>* files)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+	{
+		files->push_back(path);
+		return;
+	}
+
+	DIR* dir = opendir(path.c_str());
+	if (!dir) return;
+	std::vector<std::string> entries;
+	while (dirent* entry = readdir(dir))
+	{
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+		entries.push_back(entry->d_name);
+	}
+	closedir(dir);
+	std::sort(entries.begin(), entries.end());
+
+	for (const std::string& name : entries)
+	{
+		const std::string child = path + "/" + name;
+		if (stat(child.c_str(), &st) != 0) continue;
+		if (S_ISDIR(st.st_mode))
+			gatherFiles(child, files);
+		else if (hasFBXExtension(name.c_str()))
+			files->push_back(child);
+	}
+}
+
+
+static void printText(const FileReport& report)
+{
+	if (!report.ok)
+	{
+		printf("%s: FAILED (%s)\n", report.path.c_str(), report.error.c_str());
+		return;
+	}
+
+	const ofbx::LoadStats& s = report.stages;
+	printf("%s:%s%s\n", report.path.c_str(), report.slow ? " SLOW" : "", report.heavy ? " MEMORY" : "");
+	printf("  %.2f MB, read %.2f ms, load %.2f ms (tokenize %.2f, connections %.2f, takes %.2f, objects %.2f, skin partitions %.2f, bone bounds %.2f, textures %.2f)\n",
+		report.file_size / (1024.0 * 1024.0),
+		report.read_ms,
+		report.load_ms,
+		s.tokenize * 1000,
+		s.connections * 1000,
+		s.takes * 1000,
+		s.objects * 1000,
+		s.skin_partitions * 1000,
+		s.bone_bounds * 1000,
+		s.textures * 1000);
+	printf("  memory peak %.2f MB, retained %.2f MB\n", report.peak_memory / (1024.0 * 1024.0), report.retained_memory / (1024.0 * 1024.0));
+	printf("  meshes %d, triangles %lld, vertices %lld, bones %d, takes %d, keys %lld\n",
+		report.meshes,
+		report.triangles,
+		report.vertices,
+		report.bones,
+		report.takes,
+		report.keys);
+	printf("  objects:");
+	for (int i = 1; i < OBJECT_TYPE_COUNT; ++i)
+	{
+		if (report.object_counts[i]) printf(" %s %d", OBJECT_TYPE_NAMES[i], report.object_counts[i]);
+	}
+	printf("\n");
+	if (!report.tree.empty()) fputs(report.tree.c_str(), stdout);
+}
+
+
+static void appendJSON(std::string* out, const FileReport& report)
+{
+	out->append("{\"path\":");
+	appendJSONString(out, report.path.c_str());
+	appendf(out, ",\"ok\":%s", report.ok ? "true" : "false");
+	if (!report.ok)
+	{
+		out->append(",\"error\":");
+		appendJSONString(out, report.error.c_str());
+		out->push_back('}');
+		return;
+	}
+
+	const ofbx::LoadStats& s = report.stages;
+	appendf(out, ",\"file_size\":%lld,\"read_ms\":%.3f,\"load_ms\":%.3f", report.file_size, report.read_ms, report.load_ms);
+	appendf(out,
+		",\"stages_ms\":{\"tokenize\":%.3f,\"connections\":%.3f,\"takes\":%.3f,\"objects\":%.3f,\"skin_partitions\":%.3f,\"bone_bounds\":%.3f,\"textures\":%.3f}",
+		s.tokenize * 1000,
+		s.connections * 1000,
+		s.takes * 1000,
+		s.objects * 1000,
+		s.skin_partitions * 1000,
+		s.bone_bounds * 1000,
+		s.textures * 1000);
+	appendf(out, ",\"peak_memory\":%lld,\"retained_memory\":%lld", report.peak_memory, report.retained_memory);
+	appendf(out,
+		",\"meshes\":%d,\"triangles\":%lld,\"vertices\":%lld,\"bones\":%d,\"takes\":%d,\"keys\":%lld",
+		report.meshes,
+		report.triangles,
+		report.vertices,
+		report.bones,
+		report.takes,
+		report.keys);
+	out->append(",\"objects\":{");
+	bool first = true;
+	for (int i = 1; i < OBJECT_TYPE_COUNT; ++i)
+	{
+		if (!report.object_counts[i]) continue;
+		appendf(out, "%s\"%s\":%d", first ? "" : ",", OBJECT_TYPE_NAMES[i], report.object_counts[i]);
+		first = false;
+	}
+	appendf(out, "},\"slow\":%s,\"memory\":%s", report.slow ? "true" : "false", report.heavy ? "true" : "false");
+	if (!report.tree.empty())
+	{
+		out->append(",\"tree\":");
+		out->append(report.tree);
+	}
+	out->push_back('}');
+}
+
+
+static void printUsage()
+{
+	printf(
+		"usage: ofbx_inspect [options] <file or directory>...\n"
+		"  directories are searched recursively for .fbx files, which are processed in parallel\n"
+		"  --json              print a JSON array, one object per file\n"
+		"  --threads <n>       files processed at once, default is the number of cores\n"
+		"  --tree              dump the element tree\n"
+		"  --depth <n>         limit the dumped tree depth\n"
+		"  --export <dir>      export geometry of each file to <dir>/<name>.obj\n"
+		"  --ply               export binary PLY instead of OBJ\n"
+		"  --palette <n>       build skin partitions with n bones, to time them\n"
+		"  --clean             load with mesh cleanup\n"
+		"  --bone-bounds       compute per-bone skinned bounds, to time them\n"
+		"  --adjacency         build polygon adjacency, to time it\n"
+		"  --max-ms <ms>       flag files loading slower than this\n"
+		"  --max-memory <MB>   flag files peaking above this\n"
+		"exit code is 1 if any file failed to load, 2 if any was flagged\n");
+}
+
+
+int main(int argc, char** argv)
+{
+	Options options;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (strcmp(arg, "--json") == 0) options.json = true;
+		else if (strcmp(arg, "--tree") == 0) options.tree = true;
+		else if (strcmp(arg, "--ply") == 0) options.export_format = ofbx::ExportSettings::PLY;
+		else if (strcmp(arg, "--clean") == 0) options.load_settings.clean_meshes = true;
+		else if (strcmp(arg, "--bone-bounds") == 0) options.load_settings.bone_bounds = true;
+		else if (strcmp(arg, "--adjacency") == 0) options.load_settings.adjacency = true;
+		else if (strcmp(arg, "--threads") == 0 && has_value) options.thread_count = atoi(argv[++i]);
+		else if (strcmp(arg, "--depth") == 0 && has_value) options.tree_depth = atoi(argv[++i]);
+		else if (strcmp(arg, "--export") == 0 && has_value) options.export_dir = argv[++i];
+		else if (strcmp(arg, "--palette") == 0 && has_value) options.load_settings.bone_palette_size = atoi(argv[++i]);
+		else if (strcmp(arg, "--max-ms") == 0 && has_value) options.max_ms = atof(argv[++i]);
+		else if (strcmp(arg, "--max-memory") == 0 && has_value) options.max_memory_mb = atof(argv[++i]);
+		else if (arg[0] == '-')
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			gatherFiles(arg, &files);
+		}
+	}
+	if (files.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	std::vector<FileReport> reports(files.size());
+	for (size_t i = 0; i < files.size(); ++i) reports[i].path = files[i];
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int thread_count = options.thread_count > 0 ? options.thread_count : (int)std::thread::hardware_concurrency();
+	thread_count = std::max(1, std::min(thread_count, (int)reports.size()));
+	std::atomic<int> next(0);
+	ofbx::ThreadHooks hooks;
+	hooks.capture = captureCounter;
+	hooks.enter = enterCounter;
+	hooks.leave = leaveCounter;
+	ofbx::setThreadHooks(hooks);
+	auto worker = [&]() {
+		for (int i = next++; i < (int)reports.size(); i = next++) inspectFile(options, &reports[i]);
+	};
+	std::vector<std::thread> threads;
+	for (int i = 1; i < thread_count; ++i) threads.emplace_back(worker);
+	worker();
+	for (std::thread& t : threads) t.join();
+	const double total_ms = toMs(std::chrono::steady_clock::now() - start);
+
+	int failed = 0;
+	int flagged = 0;
+	for (const FileReport& report : reports)
+	{
+		if (!report.ok) ++failed;
+		if (report.slow || report.heavy) ++flagged;
+	}
+
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	if (options.json)
+	{
+		std::string out = "{\"files\":[";
+		for (size_t i = 0; i < reports.size(); ++i)
+		{
+			if (i > 0) out.push_back(',');
+			appendJSON(&out, reports[i]);
+		}
+		appendf(&out,
+			"],\"total_ms\":%.3f,\"threads\":%d,\"failed\":%d,\"flagged\":%d,\"max_rss\":%lld}\n",
+			total_ms,
+			thread_count,
+			failed,
+			flagged,
+			(long long)usage.ru_maxrss * 1024);
+		fputs(out.c_str(), stdout);
+	}
+	else
+	{
+		for (const FileReport& report : reports) printText(report);
+		printf("%d files in %.2f ms on %d threads, %d failed, %d flagged, max RSS %.2f MB\n",
+			(int)reports.size(),
+			total_ms,
+			thread_count,
+			failed,
+			flagged,
+			usage.ru_maxrss / 1024.0);
+	}
+
+	if (failed) return 1;
+	return flagged ? 2 : 0;
+}
@@ -301,3 +301,32 @@ project "openfbx"
 		flags { "NoExceptions", "NoFramePointer", "NoIncrementalLink", "NoRTTI", "OptimizeSize", "No64BitChecks" }
 		linkoptions { "/NODEFAULTLIB"}
 		linkoptions { "/MANIFEST:NO"}
+
+project "inspector"
+	kind "ConsoleApp"
+	targetname "ofbx_inspect"
+
+	debugdir ("../runtime")
+
+	files { "../src/**.c", "../src/**.cpp", "../src/**.h", "../inspector/**.cpp", "genie.lua" }
+
+	defines {"_CRT_SECURE_NO_WARNINGS", "_HAS_ITERATOR_DEBUGGING=0" }
+
+	configuration "Debug"
+		targetdir(BINARY_DIR .. "Debug")
+		defines { "DEBUG", "_DEBUG" }
+		flags { "Symbols" }
+
+	configuration "Release"
+		targetdir(BINARY_DIR .. "Release")
+		defines { "NDEBUG" }
+		flags { "Optimize" }
+
+	configuration "RelWithDebInfo"
+		targetdir(BINARY_DIR .. "RelWithDebInfo")
+		defines { "NDEBUG" }
+		flags { "Symbols", "Optimize" }
+
+	configuration "linux"
+		buildoptions { "-std=c++14" }
+		links { "pthread" }
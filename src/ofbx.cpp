@@ -1,12 +1,17 @@
 #include "ofbx.h"
 #include "ofbxImp.h"
 #include "miniz.h"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
 namespace ofbx
 {
 
-const char* Error::s_message = "";
+thread_local const char* Error::s_message = "";
 
 #pragma pack(1)
 struct Header
@@ -40,7 +45,7 @@ static Vec3 operator-(const Vec3& v)
 }
 
 
-static Matrix operator*(const Matrix& lhs, const Matrix& rhs)
+Matrix operator*(const Matrix& lhs, const Matrix& rhs)
 {
 	Matrix res;
 	for (int j = 0; j < 4; ++j)
@@ -59,12 +64,120 @@ static Matrix operator*(const Matrix& lhs, const Matrix& rhs)
 }
 
 
-static Matrix makeIdentity()
+Matrix makeIdentity()
 {
 	return {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
 }
 
 
+double getDeterminant3x3(const Matrix& mtx)
+{
+	const double* m = mtx.m;
+	return m[0] * (m[5] * m[10] - m[6] * m[9]) - m[4] * (m[1] * m[10] - m[2] * m[9]) + m[8] * (m[1] * m[6] - m[2] * m[5]);
+}
+
+
+Matrix getNormalMatrix(const Matrix& mtx)
+{
+	// inverse transpose of the upper 3x3, i.e. cofactors / determinant
+	const double* m = mtx.m;
+	double det = getDeterminant3x3(mtx);
+	double inv_det = det == 0 ? 0 : 1 / det;
+
+	Matrix res = makeIdentity();
+	res.m[0] = (m[5] * m[10] - m[6] * m[9]) * inv_det;
+	res.m[1] = (m[6] * m[8] - m[4] * m[10]) * inv_det;
+	res.m[2] = (m[4] * m[9] - m[5] * m[8]) * inv_det;
+	res.m[4] = (m[2] * m[9] - m[1] * m[10]) * inv_det;
+	res.m[5] = (m[0] * m[10] - m[2] * m[8]) * inv_det;
+	res.m[6] = (m[1] * m[8] - m[0] * m[9]) * inv_det;
+	res.m[8] = (m[1] * m[6] - m[2] * m[5]) * inv_det;
+	res.m[9] = (m[2] * m[4] - m[0] * m[6]) * inv_det;
+	res.m[10] = (m[0] * m[5] - m[1] * m[4]) * inv_det;
+	return res;
+}
+
+
+Matrix getInverseAffine(const Matrix& mtx)
+{
+	// the transposed normal matrix is the inverse of the upper 3x3
+	Matrix normal = getNormalMatrix(mtx);
+	Matrix res = makeIdentity();
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = 0; j < 3; ++j) res.m[i * 4 + j] = normal.m[j * 4 + i];
+	}
+	const double* t = mtx.m + 12;
+	for (int j = 0; j < 3; ++j) res.m[12 + j] = -(res.m[j] * t[0] + res.m[4 + j] * t[1] + res.m[8 + j] * t[2]);
+	return res;
+}
+
+
+template <bool POINTS>
+static void transform(const Matrix& mtx, Vec3* values, int count)
+{
+	const double* m = mtx.m;
+#ifdef OFBX_SSE2
+	const __m128d c0 = _mm_loadu_pd(m + 0);
+	const __m128d c1 = _mm_loadu_pd(m + 4);
+	const __m128d c2 = _mm_loadu_pd(m + 8);
+	const __m128d c3 = _mm_loadu_pd(m + 12);
+	const __m128d z0 = _mm_load_sd(m + 2);
+	const __m128d z1 = _mm_load_sd(m + 6);
+	const __m128d z2 = _mm_load_sd(m + 10);
+	const __m128d z3 = _mm_load_sd(m + 14);
+	for (int i = 0; i < count; ++i)
+	{
+		double* v = &values[i].x;
+		const __m128d x = _mm_load1_pd(v + 0);
+		const __m128d y = _mm_load1_pd(v + 1);
+		const __m128d z = _mm_load1_pd(v + 2);
+		__m128d xy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(c0, x), _mm_mul_pd(c1, y)), _mm_mul_pd(c2, z));
+		__m128d zz = _mm_add_sd(_mm_add_sd(_mm_mul_sd(z0, x), _mm_mul_sd(z1, y)), _mm_mul_sd(z2, z));
+		if (POINTS)
+		{
+			xy = _mm_add_pd(xy, c3);
+			zz = _mm_add_sd(zz, z3);
+		}
+		_mm_storeu_pd(v, xy);
+		_mm_store_sd(v + 2, zz);
+	}
+#else
+	for (int i = 0; i < count; ++i)
+	{
+		Vec3 v = values[i];
+		values[i].x = m[0] * v.x + m[4] * v.y + m[8] * v.z + (POINTS ? m[12] : 0);
+		values[i].y = m[1] * v.x + m[5] * v.y + m[9] * v.z + (POINTS ? m[13] : 0);
+		values[i].z = m[2] * v.x + m[6] * v.y + m[10] * v.z + (POINTS ? m[14] : 0);
+	}
+#endif
+}
+
+
+void transformPoints(const Matrix& mtx, Vec3* points, int count)
+{
+	transform<true>(mtx, points, count);
+}
+
+
+void transformVectors(const Matrix& mtx, Vec3* vectors, int count, bool normalize)
+{
+	transform<false>(mtx, vectors, count);
+	if (!normalize) return;
+
+	for (int i = 0; i < count; ++i)
+	{
+		Vec3& v = vectors[i];
+		double len_sq = v.x * v.x + v.y * v.y + v.z * v.z;
+		if (len_sq == 0) continue;
+		double inv_len = 1 / sqrt(len_sq);
+		v.x *= inv_len;
+		v.y *= inv_len;
+		v.z *= inv_len;
+	}
+}
+
+
 static Matrix rotationX(double angle)
 {
 	Matrix m = makeIdentity();
@@ -199,6 +312,32 @@ static IElement* resolveProperty(const Object& obj, const char* name)
 }
 
 
+// numeric property value, bools are stored as 'C' or 'I'
+static bool toNumber(const Property& prop, double* value)
+{
+	switch (prop.type)
+	{
+		case 'C': *value = *prop.value.begin != 0 ? 1 : 0; return true;
+		case 'I':
+		{
+			int i;
+			memcpy(&i, prop.value.begin, sizeof(i));
+			*value = i;
+			return true;
+		}
+		case 'F':
+		{
+			float f;
+			memcpy(&f, prop.value.begin, sizeof(f));
+			*value = f;
+			return true;
+		}
+		case 'D': *value = prop.value.toDouble(); return true;
+		default: return false;
+	}
+}
+
+
 static Vec3 resolveVec3Property(const Object& object, const char* name, const Vec3& default_value)
 {
 	Element* element = (Element*)resolveProperty(object, name);
@@ -342,20 +481,17 @@ static OptionalError<Property*> readProperty(Cursor* cursor)
 }
 
 
-static void deleteElement(Element* el)
+void deleteElement(Element* el)
 {
-	if (!el) return;
-
-	delete el->first_property;
-	deleteElement(el->child);
-	Element* iter = el;
-	// do not use recursion to avoid stack overflow
-	do
+	// do not use recursion for siblings to avoid stack overflow
+	while (el)
 	{
-		Element* next = iter->sibling;
-		delete iter;
-		iter = next;
-	} while (iter);
+		Element* next = el->sibling;
+		delete el->first_property;
+		deleteElement(el->child);
+		delete el;
+		el = next;
+	}
 }
 
 
@@ -374,8 +510,10 @@ static OptionalError<u64> readElementOffset(Cursor* cursor, u16 version)
 }
 
 
-static OptionalError<Element*> readElement(Cursor* cursor, u32 version)
+// *skipped is set if the filter rejected the element, it is then stepped over as a whole and nullptr is returned
+static OptionalError<Element*> readElement(Cursor* cursor, u32 version, const Element& parent, ElementFilter filter, bool* skipped)
 {
+	*skipped = false;
 	OptionalError<u64> end_offset = readElementOffset(cursor, version);
 	if (end_offset.isError()) return Error();
 	if (end_offset.getValue() == 0) return nullptr;
@@ -389,6 +527,14 @@ static OptionalError<Element*> readElement(Cursor* cursor, u32 version)
 	OptionalError<DataView> id = readShortString(cursor);
 	if (id.isError()) return Error();
 
+	if (filter && !filter(parent, id.getValue()))
+	{
+		if (end_offset.getValue() > (u64)(cursor->end - cursor->begin)) return Error("Reading past the end");
+		cursor->current = cursor->begin + end_offset.getValue();
+		*skipped = true;
+		return nullptr;
+	}
+
 	Element* element = new Element();
 	element->first_property = nullptr;
 	element->id = id.getValue();
@@ -417,12 +563,14 @@ static OptionalError<Element*> readElement(Cursor* cursor, u32 version)
 	Element** link = &element->child;
 	while (cursor->current - cursor->begin < ((ptrdiff_t)end_offset.getValue() - BLOCK_SENTINEL_LENGTH))
 	{
-		OptionalError<Element*> child = readElement(cursor, version);
+		bool skipped_child;
+		OptionalError<Element*> child = readElement(cursor, version, *element, filter, &skipped_child);
 		if (child.isError())
 		{
 			deleteElement(element);
 			return Error();
 		}
+		if (skipped_child) continue;
 
 		*link = child.getValue();
 		link = &(*link)->sibling;
@@ -439,12 +587,13 @@ static OptionalError<Element*> readElement(Cursor* cursor, u32 version)
 }
 
 
-static OptionalError<Element*> tokenize(const u8* data, size_t size)
+OptionalError<Element*> tokenize(const u8* data, size_t size, ElementFilter filter)
 {
 	Cursor cursor;
 	cursor.begin = data;
 	cursor.current = data;
 	cursor.end = data + size;
+	if (size < sizeof(Header)) return Error("Invalid header");
 
 	const Header* header = (const Header*)cursor.current;
 	cursor.current += sizeof(*header);
@@ -459,12 +608,14 @@ static OptionalError<Element*> tokenize(const u8* data, size_t size)
 	Element** element = &root->child;
 	for (;;)
 	{
-		OptionalError<Element*> child = readElement(&cursor, header->version);
+		bool skipped;
+		OptionalError<Element*> child = readElement(&cursor, header->version, *root, filter, &skipped);
 		if (child.isError())
 		{
 			deleteElement(root);
 			return Error();
 		}
+		if (skipped) continue;
 		*element = child.getValue();
 		if (!*element) return root;
 		element = &(*element)->sibling;
@@ -504,14 +655,18 @@ static void parseTemplates(const Element& root)
 }
 
 
+Scene::Document::~Document()
+{
+	deleteElement(root);
+}
+
+
 Scene::~Scene()
 {
 	for (auto iter : m_object_map)
 	{
 		delete iter.second.object;
 	}
-
-	deleteElement(m_root_element);
 }
 
 
@@ -544,7 +699,7 @@ struct MeshImpl : Mesh
 		Matrix mtx = getRotationMatrix(rotation);
 		setTranslation(translation, &mtx);
 
-		return scale_mtx * mtx;
+		return scene.m_conversion.convert(scale_mtx * mtx);
 	}
 
 
@@ -568,6 +723,12 @@ Material::Material(const Scene& _scene, const IElement& _element)
 }
 
 
+Vec3 Material::getDiffuseColor() const
+{
+	return resolveVec3Property(*this, "DiffuseColor", {0.8, 0.8, 0.8});
+}
+
+
 struct MaterialImpl : Material
 {
 	MaterialImpl(const Scene& _scene, const IElement& _element)
@@ -647,12 +808,12 @@ struct ClusterImpl : Cluster
 	{
 	}
 
-	const int* getIndices() const override { return &indices[0]; }
-	virtual int getIndicesCount() const override { return (int)indices.size(); }
-	const double* getWeights() const override { return &weights[0]; }
-	int getWeightsCount() const override { return (int)weights.size(); }
-	Matrix getTransformMatrix() const { return transform_matrix; }
-	Matrix getTransformLinkMatrix() const { return transform_link_matrix; }
+	const int* getIndices() const override { return &data->indices[0]; }
+	virtual int getIndicesCount() const override { return (int)data->indices.size(); }
+	const double* getWeights() const override { return &data->weights[0]; }
+	int getWeightsCount() const override { return (int)data->weights.size(); }
+	Matrix getTransformMatrix() const { return data->transform_matrix; }
+	Matrix getTransformLinkMatrix() const { return data->transform_link_matrix; }
 	Object* getLink() const override { return link; }
 
 
@@ -679,6 +840,8 @@ struct ClusterImpl : Cluster
 
 		if (old_indices.size() != old_weights.size()) return false;
 
+		std::vector<int>& indices = data->indices;
+		std::vector<double>& weights = data->weights;
 		indices.reserve(old_indices.size());
 		weights.reserve(old_indices.size());
 		int* ir = old_indices.empty() ? nullptr : &old_indices[0];
@@ -687,8 +850,10 @@ struct ClusterImpl : Cluster
 		{
 			int old_idx = ir[i];
 			double w = wr[i];
-			GeometryImpl::NewVertex* n = &geom->to_new_vertices[old_idx];
-			while (n)
+			if (old_idx < 0 || old_idx >= (int)geom->data->to_new_vertices.size()) return false;
+			GeometryImpl::NewVertex* n = &geom->data->to_new_vertices[old_idx];
+			// -1 if the control point lost all its vertices in cleanup
+			while (n && n->index != -1)
 			{
 				indices.push_back(n->index);
 				weights.push_back(w);
@@ -700,12 +865,17 @@ struct ClusterImpl : Cluster
 	}
 
 
+	struct Data
+	{
+		std::vector<int> indices;
+		std::vector<double> weights;
+		Matrix transform_matrix;
+		Matrix transform_link_matrix;
+	};
+
 	Object* link = nullptr;
 	Skin* skin = nullptr;
-	std::vector<int> indices;
-	std::vector<double> weights;
-	Matrix transform_matrix;
-	Matrix transform_link_matrix;
+	std::shared_ptr<Data> data = std::make_shared<Data>();
 	Type getType() const override { return Type::CLUSTER; }
 };
 
@@ -760,12 +930,18 @@ struct AnimationCurveImpl : AnimationCurve
 	{
 	}
 
-	int getKeyCount() const override { return (int)times.size(); }
-	const u64* getKeyTime() const override { return &times[0]; }
-	const float* getKeyValue() const override { return &values[0]; }
+	int getKeyCount() const override { return (int)data->values.size(); }
+	const u64* getKeyTime() const override { return data->times->data(); }
+	const float* getKeyValue() const override { return &data->values[0]; }
 
-	std::vector<u64> times;
-	std::vector<float> values;
+	struct Data
+	{
+		// identical key times of different curves are stored once
+		std::shared_ptr<const std::vector<u64>> times;
+		std::vector<float> values;
+	};
+
+	std::shared_ptr<Data> data = std::make_shared<Data>();
 	Type getType() const override { return Type::ANIMATION_CURVE; }
 };
 
@@ -792,6 +968,199 @@ struct SkinImpl : Skin
 };
 
 
+Shape::Shape(const Scene& _scene, const IElement& _element)
+	: Object(_scene, _element)
+{
+}
+
+
+struct BlendShapeChannelImpl;
+struct BlendShapeImpl;
+
+
+struct ShapeImpl : Shape
+{
+	ShapeImpl(const Scene& _scene, const IElement& _element)
+		: Shape(_scene, _element)
+	{
+	}
+
+	int getDeltaCount() const override { return (int)data->indices.size(); }
+	const int* getIndices() const override { return data->indices.empty() ? nullptr : &data->indices[0]; }
+	const Vec3* getDeltaPositions() const override { return data->vertices.empty() ? nullptr : &data->vertices[0]; }
+	const Vec3* getDeltaNormals() const override { return data->normals.empty() ? nullptr : &data->normals[0]; }
+
+
+	bool postprocess(GeometryImpl* geom)
+	{
+		assert(geom);
+
+		std::vector<int>& indices = data->indices;
+		std::vector<Vec3>& vertices = data->vertices;
+		std::vector<Vec3>& normals = data->normals;
+		std::vector<int> old_indices;
+		std::vector<Vec3> old_vertices;
+		std::vector<Vec3> old_normals;
+		old_indices.swap(indices);
+		old_vertices.swap(vertices);
+		old_normals.swap(normals);
+
+		if (old_indices.size() != old_vertices.size()) return false;
+		if (!old_normals.empty() && old_normals.size() != old_indices.size()) return false;
+
+		const Scene::Conversion& conversion = scene.m_conversion;
+		if (conversion.enabled && !old_vertices.empty())
+		{
+			transformVectors(conversion.matrix, &old_vertices[0], (int)old_vertices.size(), false);
+			if (!old_normals.empty()) transformVectors(conversion.axes, &old_normals[0], (int)old_normals.size(), false);
+		}
+
+		indices.reserve(old_indices.size());
+		vertices.reserve(old_indices.size());
+		if (!old_normals.empty()) normals.reserve(old_indices.size());
+		for (int i = 0, c = (int)old_indices.size(); i < c; ++i)
+		{
+			int old_idx = old_indices[i];
+			if (old_idx < 0 || old_idx >= (int)geom->data->to_new_vertices.size()) return false;
+			const GeometryImpl::NewVertex* n = &geom->data->to_new_vertices[old_idx];
+			while (n && n->index != -1)
+			{
+				indices.push_back(n->index);
+				vertices.push_back(old_vertices[i]);
+				if (!old_normals.empty()) normals.push_back(old_normals[i]);
+				n = n->next;
+			}
+		}
+#ifdef OFBX_SSE2
+		pack();
+#endif
+		return true;
+	}
+
+
+	// converted once, so applyShapes() reads half the memory and scales 4 deltas per instruction
+	void pack()
+	{
+		const int count = (int)data->indices.size();
+		const bool has_normals = !data->normals.empty();
+		const int block_size = has_normals ? 24 : 12;
+		std::vector<float>& packed = data->packed;
+		packed.assign((count + 3) / 4 * block_size, 0.f);
+		for (int i = 0; i < count; ++i)
+		{
+			float* block = &packed[i / 4 * block_size + i % 4];
+			const Vec3& v = data->vertices[i];
+			block[0] = (float)v.x;
+			block[4] = (float)v.y;
+			block[8] = (float)v.z;
+			if (!has_normals) continue;
+			const Vec3& n = data->normals[i];
+			block[12] = (float)n.x;
+			block[16] = (float)n.y;
+			block[20] = (float)n.z;
+		}
+	}
+
+
+	Type getType() const override { return Type::SHAPE; }
+
+	struct Data
+	{
+		std::vector<int> indices;
+		std::vector<Vec3> vertices;
+		std::vector<Vec3> normals;
+		// SoA blocks of 4 deltas: x0..x3, y0..y3, z0..z3, then the same for normals if there are any;
+		// the last block is padded with zeros
+		std::vector<float> packed;
+	};
+
+	BlendShapeChannelImpl* channel = nullptr;
+	std::shared_ptr<Data> data = std::make_shared<Data>();
+};
+
+
+BlendShapeChannel::BlendShapeChannel(const Scene& _scene, const IElement& _element)
+	: Object(_scene, _element)
+{
+}
+
+
+struct BlendShapeChannelImpl : BlendShapeChannel
+{
+	BlendShapeChannelImpl(const Scene& _scene, const IElement& _element)
+		: BlendShapeChannel(_scene, _element)
+	{
+	}
+
+	double getDeformPercent() const override { return deform_percent; }
+	int getShapeCount() const override { return (int)shapes.size(); }
+	const Shape* getShape(int idx) const override { return shapes[idx]; }
+
+
+	double getFullWeight(int idx) const override
+	{
+		// FullWeights may be missing, single target is fully applied at 100%
+		if (idx < (int)full_weights.size()) return full_weights[idx];
+		return 100.0 * (idx + 1) / shapes.size();
+	}
+
+
+	void getShapeWeights(double percent, double* weights) const override
+	{
+		int count = (int)shapes.size();
+		for (int i = 0; i < count; ++i) weights[i] = 0;
+		if (count == 0) return;
+
+		double prev_weight = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			double full_weight = getFullWeight(i);
+			if (percent <= full_weight || i == count - 1)
+			{
+				// clamped, past the last full weight the last shape stays fully applied
+				double t = full_weight > prev_weight ? (percent - prev_weight) / (full_weight - prev_weight) : 1;
+				t = t < 0 ? 0 : (t > 1 ? 1 : t);
+				weights[i] = t;
+				if (i > 0) weights[i - 1] = 1 - t;
+				return;
+			}
+			prev_weight = full_weight;
+		}
+	}
+
+
+	Type getType() const override { return Type::BLEND_SHAPE_CHANNEL; }
+
+	BlendShapeImpl* blend_shape = nullptr;
+	double deform_percent = 0;
+	std::vector<double> full_weights;
+	std::vector<ShapeImpl*> shapes;
+};
+
+
+BlendShape::BlendShape(const Scene& _scene, const IElement& _element)
+	: Object(_scene, _element)
+{
+}
+
+
+struct BlendShapeImpl : BlendShape
+{
+	BlendShapeImpl(const Scene& _scene, const IElement& _element)
+		: BlendShape(_scene, _element)
+	{
+	}
+
+	int getBlendShapeChannelCount() const override { return (int)channels.size(); }
+	const BlendShapeChannel* getBlendShapeChannel(int idx) const override { return channels[idx]; }
+
+	Type getType() const override { return Type::BLEND_SHAPE; }
+
+	GeometryImpl* geometry = nullptr;
+	std::vector<BlendShapeChannelImpl*> channels;
+};
+
+
 Texture::Texture(const Scene& _scene, const IElement& _element)
 	: Object(_scene, _element)
 {
@@ -823,31 +1192,210 @@ struct AnimationCurveNodeImpl : AnimationCurveNode
 	}
 
 
+	// index of the key ending the segment containing fbx_time and the interpolation factor in it,
+	// key 0 with factor 0 if there is only one key
+	static int findKey(const u64* times, int count, u64 fbx_time, float* t)
+	{
+		if (fbx_time < times[0]) fbx_time = times[0];
+		if (fbx_time > times[count - 1]) fbx_time = times[count - 1];
+		if (count < 2)
+		{
+			*t = 0;
+			return 0;
+		}
+
+		const int i = int(std::lower_bound(times + 1, times + count - 1, fbx_time) - times);
+		*t = float(double(fbx_time - times[i - 1]) / double(times[i] - times[i - 1]));
+		return i;
+	}
+
+
 	Vec3 getNodeLocalTransform(double time) const override
 	{
-		u64 fbx_time = secondsToFbxTime(time);
+		const u64 fbx_time = secondsToFbxTime(time);
+
+		if (track)
+		{
+			// one search for all three components, whose values are next to each other
+			float t;
+			const int i = findKey(track->times->data(), (int)track->times->size(), fbx_time, &t);
+			const float* v = &track->values[i * 3];
+			if (i == 0) return {v[0], v[1], v[2]};
+			return {v[-3] * (1 - t) + v[0] * t, v[-2] * (1 - t) + v[1] * t, v[-1] * (1 - t) + v[2] * t};
+		}
 
 		auto getCoord = [](const Curve& curve, u64 fbx_time) {
-			if (!curve.curve) return 0.0f;
+			if (!curve.curve || curve.curve->getKeyCount() == 0) return 0.0f;
 
-			const u64* times = curve.curve->getKeyTime();
 			const float* values = curve.curve->getKeyValue();
-			int count = curve.curve->getKeyCount();
+			float t;
+			const int i = findKey(curve.curve->getKeyTime(), curve.curve->getKeyCount(), fbx_time, &t);
+			if (i == 0) return values[0];
+			return values[i - 1] * (1 - t) + values[i] * t;
+		};
+
+		return {getCoord(curves[0], fbx_time), getCoord(curves[1], fbx_time), getCoord(curves[2], fbx_time)};
+	}
+
+
+	// findKey for a time not before the previous one, walks forward from the key returned for that one
+	static int nextKey(const u64* times, int count, u64 fbx_time, int key, float* t)
+	{
+		if (fbx_time < times[0]) fbx_time = times[0];
+		if (fbx_time > times[count - 1]) fbx_time = times[count - 1];
+		if (count < 2)
+		{
+			*t = 0;
+			return 0;
+		}
 
-			if (fbx_time < times[0]) fbx_time = times[0];
-			if (fbx_time > times[count - 1]) fbx_time = times[count - 1];
-			for (int i = 1; i < count; ++i)
+		if (key < 1) key = 1;
+		while (key < count - 1 && times[key] < fbx_time) ++key;
+		*t = float(double(fbx_time - times[key - 1]) / double(times[key] - times[key - 1]));
+		return key;
+	}
+
+
+	// "d|X", "d|Y", "d|Z" or "d|<property>" values in the node's properties, returns their count
+	int getDefaults(float* values) const
+	{
+		values[0] = values[1] = values[2] = 0;
+		const Element* props = findChild((const Element&)element, "Properties70");
+		if (!props) return 0;
+
+		int count = 0;
+		for (const Element* prop = props->child; prop && count < 3; prop = prop->sibling)
+		{
+			const Property* name = prop->first_property;
+			if (!name || name->value.end - name->value.begin < 2 || memcmp(name->value.begin, "d|", 2) != 0) continue;
+
+			const Property* value = (const Property*)prop->getProperty(4);
+			double v = 0;
+			if (value) toNumber(*value, &v);
+			values[count++] = (float)v;
+		}
+		return count;
+	}
+
+
+	AnimationChannel getChannel() const override
+	{
+		AnimationChannel channel;
+		channel.node = this;
+		channel.target = bone;
+		channel.property = bone_link_property;
+
+		float defaults[3];
+		int component_count = getDefaults(defaults);
+		for (const Curve& curve : curves)
+		{
+			if (curve.curve) component_count = std::max(component_count, int(&curve - curves) + 1);
+		}
+		channel.type = component_count >= 3 ? AnimationChannel::VEC3 : AnimationChannel::SCALAR;
+		if (!bone) return channel;
+
+		// the declared type, properties with default values are usually not written
+		char name[128];
+		bone_link_property.toString(name);
+		const Element* prop = (const Element*)resolveProperty(*bone, name);
+		const Property* type = prop && prop->first_property ? prop->first_property->next : nullptr;
+		if (type)
+		{
+			const DataView& t = type->value;
+			if (t == "Color" || t == "ColorRGB" || t == "ColorAndAlpha") channel.type = AnimationChannel::COLOR;
+			else if (t == "Vector" || t == "Vector3D" || t == "Lcl Translation" || t == "Lcl Rotation" || t == "Lcl Scaling")
+				channel.type = AnimationChannel::VEC3;
+			else if (t == "bool" || t == "Bool" || t == "Visibility" || t == "Visibility Inheritance")
+				channel.type = AnimationChannel::BOOL;
+			else if (t != "Compound" && t != "object") channel.type = AnimationChannel::SCALAR;
+			return channel;
+		}
+
+		const int len = int(bone_link_property.end - bone_link_property.begin);
+		if (strncmp(name, "Lcl ", 4) == 0) channel.type = AnimationChannel::VEC3;
+		else if (strcmp(name, "Visibility") == 0) channel.type = AnimationChannel::BOOL;
+		else if (component_count >= 3 && len >= 5 && strcmp(name + len - 5, "Color") == 0) channel.type = AnimationChannel::COLOR;
+		return channel;
+	}
+
+
+	void sample(double start_time, double frame_time, int frame_count, int stride, float* out) const override
+	{
+		const AnimationChannel channel = getChannel();
+		const int component_count = channel.getComponentCount();
+		const bool forward = frame_time >= 0;
+		float defaults[3];
+		getDefaults(defaults);
+
+		if (track && component_count == 3)
+		{
+			// one walk over the keys for all three components
+			const u64* times = track->times->data();
+			const int count = (int)track->times->size();
+			int key = 0;
+			for (int frame = 0; frame < frame_count; ++frame)
 			{
-				if (times[i] >= fbx_time)
-				{
-					float t = float(double(fbx_time - times[i - 1]) / double(times[i] - times[i - 1]));
-					return values[i - 1] * (1 - t) + values[i] * t;
-				}
+				const u64 fbx_time = secondsToFbxTime(std::max(start_time + frame * frame_time, 0.0));
+				float t;
+				key = forward && frame > 0 ? nextKey(times, count, fbx_time, key, &t) : findKey(times, count, fbx_time, &t);
+				const float* v = &track->values[key * 3];
+				float* o = out + frame * stride;
+				for (int c = 0; c < 3; ++c) o[c] = key == 0 ? v[c] : v[c - 3] * (1 - t) + v[c] * t;
 			}
-			return values[0];
-		};
+			return;
+		}
 
-		return {getCoord(curves[0], fbx_time), getCoord(curves[1], fbx_time), getCoord(curves[2], fbx_time)};
+		for (int c = 0; c < component_count; ++c)
+		{
+			const AnimationCurve* curve = curves[c].curve;
+			if (!curve || curve->getKeyCount() == 0)
+			{
+				for (int frame = 0; frame < frame_count; ++frame) out[frame * stride + c] = defaults[c];
+				continue;
+			}
+
+			const u64* times = curve->getKeyTime();
+			const float* values = curve->getKeyValue();
+			const int count = curve->getKeyCount();
+			int key = 0;
+			for (int frame = 0; frame < frame_count; ++frame)
+			{
+				const u64 fbx_time = secondsToFbxTime(std::max(start_time + frame * frame_time, 0.0));
+				float t;
+				key = forward && frame > 0 ? nextKey(times, count, fbx_time, key, &t) : findKey(times, count, fbx_time, &t);
+				out[frame * stride + c] = key == 0 ? values[0] : values[key - 1] * (1 - t) + values[key] * t;
+			}
+		}
+		if (channel.type == AnimationChannel::BOOL)
+		{
+			for (int frame = 0; frame < frame_count; ++frame) out[frame * stride] = out[frame * stride] >= 0.5f ? 1.0f : 0.0f;
+		}
+	}
+
+
+	// fuses the curves into one track if all three share their key times
+	void postprocess()
+	{
+		track.reset();
+		for (const Curve& curve : curves)
+		{
+			if (!curve.curve) return;
+		}
+		const AnimationCurveImpl::Data* x = ((const AnimationCurveImpl*)curves[0].curve)->data.get();
+		const AnimationCurveImpl::Data* y = ((const AnimationCurveImpl*)curves[1].curve)->data.get();
+		const AnimationCurveImpl::Data* z = ((const AnimationCurveImpl*)curves[2].curve)->data.get();
+		if (x->times != y->times || x->times != z->times || x->values.empty()) return;
+
+		auto fused = std::make_shared<Vec3Track>();
+		fused->times = x->times;
+		fused->values.resize(x->values.size() * 3);
+		for (int i = 0, c = (int)x->values.size(); i < c; ++i)
+		{
+			fused->values[i * 3 + 0] = x->values[i];
+			fused->values[i * 3 + 1] = y->values[i];
+			fused->values[i * 3 + 2] = z->values[i];
+		}
+		track = fused;
 	}
 
 
@@ -858,7 +1406,16 @@ struct AnimationCurveNodeImpl : AnimationCurveNode
 	};
 
 
+	struct Vec3Track
+	{
+		std::shared_ptr<const std::vector<u64>> times;
+		std::vector<float> values; // x, y, z per key
+	};
+
+
 	Curve curves[3];
+	// shared with clones like the curves themselves
+	std::shared_ptr<const Vec3Track> track;
 	Object* bone = nullptr;
 	DataView bone_link_property;
 	Type getType() const override { return Type::ANIMATION_CURVE_NODE; }
@@ -893,6 +1450,10 @@ struct AnimationLayerImpl : AnimationLayer
 	}
 
 
+	int getCurveNodeCount() const override { return (int)curve_nodes.size(); }
+	const AnimationCurveNode* getCurveNode(int index) const override { return curve_nodes[index]; }
+
+
 	std::vector<AnimationCurveNodeImpl*> curve_nodes;
 };
 
@@ -921,6 +1482,15 @@ template <typename T> static OptionalError<Object*> parse(const Scene& scene, co
 }
 
 
+// object of a cloned scene referencing the already parsed data of the source object
+template <typename T> static OptionalError<Object*> share(const Scene& scene, const Element& element, const Object& source)
+{
+	T* obj = new T(scene, element);
+	obj->data = ((const T&)source).data;
+	return obj;
+}
+
+
 static OptionalError<Object*> parseCluster(const Scene& scene, const Element& element)
 {
 	std::unique_ptr<ClusterImpl> obj = std::make_unique<ClusterImpl>(scene, element);
@@ -929,7 +1499,7 @@ static OptionalError<Object*> parseCluster(const Scene& scene, const Element& el
 	if (transform_link && transform_link->first_property)
 	{
 		if (!parseBinaryArrayRaw(
-				*transform_link->first_property, &obj->transform_link_matrix, sizeof(obj->transform_link_matrix)))
+				*transform_link->first_property, &obj->data->transform_link_matrix, sizeof(obj->data->transform_link_matrix)))
 		{
 			return Error("Failed to parse TransformLink");
 		}
@@ -937,17 +1507,69 @@ static OptionalError<Object*> parseCluster(const Scene& scene, const Element& el
 	const Element* transform = findChild(element, "Transform");
 	if (transform && transform->first_property)
 	{
-		if (!parseBinaryArrayRaw(*transform->first_property, &obj->transform_matrix, sizeof(obj->transform_matrix)))
+		if (!parseBinaryArrayRaw(*transform->first_property, &obj->data->transform_matrix, sizeof(obj->data->transform_matrix)))
 		{
 			return Error("Failed to parse Transform");
 
 		}
 	}
+	obj->data->transform_link_matrix = scene.m_conversion.convert(obj->data->transform_link_matrix);
+	obj->data->transform_matrix = scene.m_conversion.convert(obj->data->transform_matrix);
 
 	return obj.release();
 }
 
 
+static OptionalError<Object*> parseShape(const Scene& scene, const Element& element)
+{
+	std::unique_ptr<ShapeImpl> shape = std::make_unique<ShapeImpl>(scene, element);
+
+	const Element* indexes = findChild(element, "Indexes");
+	if (indexes && indexes->first_property)
+	{
+		if (!parseBinaryArray(*indexes->first_property, &shape->data->indices)) return Error("Failed to parse shape indices");
+	}
+
+	const Element* vertices = findChild(element, "Vertices");
+	if (vertices && vertices->first_property)
+	{
+		if (!parseDoubleVecData(*vertices->first_property, &shape->data->vertices)) return Error("Failed to parse shape vertices");
+	}
+
+	const Element* normals = findChild(element, "Normals");
+	if (normals && normals->first_property)
+	{
+		if (!parseDoubleVecData(*normals->first_property, &shape->data->normals)) return Error("Failed to parse shape normals");
+	}
+
+	return shape.release();
+}
+
+
+static OptionalError<Object*> parseBlendShapeChannel(const Scene& scene, const Element& element)
+{
+	std::unique_ptr<BlendShapeChannelImpl> channel = std::make_unique<BlendShapeChannelImpl>(scene, element);
+
+	const Element* deform_percent = findChild(element, "DeformPercent");
+	if (deform_percent && deform_percent->first_property)
+	{
+		if (deform_percent->first_property->getType() != IElementProperty::DOUBLE) return Error("Invalid DeformPercent");
+		channel->deform_percent = deform_percent->first_property->value.toDouble();
+	}
+
+	const Element* full_weights = findChild(element, "FullWeights");
+	if (full_weights && full_weights->first_property)
+	{
+		if (!parseBinaryArray(*full_weights->first_property, &channel->full_weights))
+		{
+			return Error("Failed to parse FullWeights");
+		}
+	}
+
+	return channel.release();
+}
+
+
 static OptionalError<Object*> parseNodeAttribute(const Scene& scene, const Element& element)
 {
 	NodeAttributeImpl* obj = new NodeAttributeImpl(scene, element);
@@ -1077,25 +1699,27 @@ static OptionalError<Object*> parseAnimationCurve(const Scene& scene, const Elem
 	const Element* times = findChild(element, "KeyTime");
 	const Element* values = findChild(element, "KeyValueFloat");
 
+	auto key_times = std::make_shared<std::vector<u64>>();
 	if (times && times->first_property)
 	{
-		curve->times.resize(times->first_property->getCount());
-		if (!times->first_property->getValues(&curve->times[0], (int)curve->times.size() * sizeof(curve->times[0])))
+		key_times->resize(times->first_property->getCount());
+		if (!times->first_property->getValues(&(*key_times)[0], (int)key_times->size() * sizeof((*key_times)[0])))
 		{
 			return Error("Invalid animation curve");
 		}
 	}
+	curve->data->times = key_times;
 
 	if (values && values->first_property)
 	{
-		curve->values.resize(values->first_property->getCount());
-		if (!values->first_property->getValues(&curve->values[0], (int)curve->values.size() * sizeof(curve->values[0])))
+		curve->data->values.resize(values->first_property->getCount());
+		if (!values->first_property->getValues(&curve->data->values[0], (int)curve->data->values.size() * sizeof(curve->data->values[0])))
 		{
 			return Error("Invalid animation curve");
 		}
 	}
 
-	if (curve->times.size() != curve->values.size()) return Error("Invalid animation curve");
+	if (key_times->size() != curve->data->values.size()) return Error("Invalid animation curve");
 
 	return curve.release();
 }
@@ -1142,6 +1766,7 @@ static OptionalError<Object*> parseGeometry(const Scene& scene, const Element& e
 	if (!polys_element || !polys_element->first_property) return Error("Indices missing");
 
 	std::unique_ptr<GeometryImpl> geom = std::make_unique<GeometryImpl>(scene, element);
+	GeometryImpl::Data& data = *geom->data;
 
 	std::vector<Vec3> vertices;
 	if (!parseDoubleVecData(*vertices_element->first_property, &vertices)) return Error("Failed to parse vertices");
@@ -1150,21 +1775,21 @@ static OptionalError<Object*> parseGeometry(const Scene& scene, const Element& e
 	if (!parseBinaryArray(*polys_element->first_property, &original_indices)) return Error("Failed to parse indices");
 
 	std::vector<int> to_old_indices;
-	geom->triangulate(original_indices, &geom->to_old_vertices, &to_old_indices);
+	geom->triangulate(original_indices, &data.to_old_vertices, &to_old_indices);
 
 #if 1
-	geom->vertices.resize(geom->to_old_vertices.size());
-	for (int i = 0, c = (int)geom->to_old_vertices.size(); i < c; ++i)
+	data.vertices.resize(data.to_old_vertices.size());
+	for (int i = 0, c = (int)data.to_old_vertices.size(); i < c; ++i)
 	{
-		geom->vertices[i] = vertices[geom->to_old_vertices[i]];
+		data.vertices[i] = vertices[data.to_old_vertices[i]];
 	}
 
-	geom->to_new_vertices.resize(geom->to_old_vertices.size());
-	const int* to_old_vertices = geom->to_old_vertices.empty() ? nullptr : &geom->to_old_vertices[0];
-	for (int i = 0, c = (int)geom->to_old_vertices.size(); i < c; ++i)
+	data.to_new_vertices.resize(data.to_old_vertices.size());
+	const int* to_old_vertices = data.to_old_vertices.empty() ? nullptr : &data.to_old_vertices[0];
+	for (int i = 0, c = (int)data.to_old_vertices.size(); i < c; ++i)
 	{
 		int old = to_old_vertices[i];
-		add(geom->to_new_vertices[old], i);
+		add(data.to_new_vertices[old], i);
 	}
 #endif
 
@@ -1181,8 +1806,8 @@ static OptionalError<Object*> parseGeometry(const Scene& scene, const Element& e
 		if (mapping_element->first_property->value == "ByPolygon" &&
 			reference_element->first_property->value == "IndexToDirect")
 		{
-			geom->materials.reserve(geom->vertices.size() / 3);
-			for (int& i : geom->materials) i = -1;
+			data.materials.reserve(data.vertices.size() / 3);
+			for (int& i : data.materials) i = -1;
 
 			const Element* indices_element = findChild(*layer_material_element, "Materials");
 			if (!indices_element || !indices_element->first_property) return Error("Invalid LayerElementMaterial");
@@ -1195,7 +1820,7 @@ static OptionalError<Object*> parseGeometry(const Scene& scene, const Element& e
 				int tri_count = getTriCountFromPoly(original_indices, &tmp_i);
 				for (int i = 0; i < tri_count; ++i)
 				{
-					geom->materials.push_back(tmp[poly]);
+					data.materials.push_back(tmp[poly]);
 				}
 			}
 		}
@@ -1212,9 +1837,9 @@ static OptionalError<Object*> parseGeometry(const Scene& scene, const Element& e
 		std::vector<int> tmp_indices;
 		GeometryImpl::VertexDataMapping mapping;
 		if (!parseVertexData(*layer_uv_element, "UV", "UVIndex", &tmp, &tmp_indices, &mapping)) return Error("Invalid UVs");
-		geom->uvs.resize(tmp_indices.empty() ? tmp.size() : tmp_indices.size());
-		splat(&geom->uvs, mapping, tmp, tmp_indices, geom->to_old_vertices);
-		remap(&geom->uvs, to_old_indices);
+		data.uvs.emplace_back();
+		splat(&data.uvs[0].data, mapping, tmp, tmp_indices, data.to_old_vertices);
+		remap(&data.uvs[0].data, to_old_indices);
 	}
 
 	const Element* layer_tangent_element = findChild(element, "LayerElementTangents");
@@ -1231,8 +1856,8 @@ static OptionalError<Object*> parseGeometry(const Scene& scene, const Element& e
 		{
 			if (!parseVertexData(*layer_tangent_element, "Tangent", "TangentIndex", &tmp, &tmp_indices, &mapping))  return Error("Invalid tangets");
 		}
-		splat(&geom->tangents, mapping, tmp, tmp_indices, geom->to_old_vertices);
-		remap(&geom->tangents, to_old_indices);
+		splat(&data.tangents, mapping, tmp, tmp_indices, data.to_old_vertices);
+		remap(&data.tangents, to_old_indices);
 	}
 
 	const Element* layer_color_element = findChild(element, "LayerElementColor");
@@ -1242,8 +1867,9 @@ static OptionalError<Object*> parseGeometry(const Scene& scene, const Element& e
 		std::vector<int> tmp_indices;
 		GeometryImpl::VertexDataMapping mapping;
 		if (!parseVertexData(*layer_color_element, "Colors", "ColorIndex", &tmp, &tmp_indices, &mapping)) return Error("Invalid colors");
-		splat(&geom->colors, mapping, tmp, tmp_indices, geom->to_old_vertices);
-		remap(&geom->colors, to_old_indices);
+		data.colors.emplace_back();
+		splat(&data.colors[0].data, mapping, tmp, tmp_indices, data.to_old_vertices);
+		remap(&data.colors[0].data, to_old_indices);
 	}
 
 	const Element* layer_normal_element = findChild(element, "LayerElementNormal");
@@ -1253,8 +1879,8 @@ static OptionalError<Object*> parseGeometry(const Scene& scene, const Element& e
 		std::vector<int> tmp_indices;
 		GeometryImpl::VertexDataMapping mapping;
 		if (!parseVertexData(*layer_normal_element, "Normals", "NormalsIndex", &tmp, &tmp_indices, &mapping)) return Error("Invalid normals");
-		splat(&geom->normals, mapping, tmp, tmp_indices, geom->to_old_vertices);
-		remap(&geom->normals, to_old_indices);
+		splat(&data.normals, mapping, tmp, tmp_indices, data.to_old_vertices);
+		remap(&data.normals, to_old_indices);
 	}
 
 	return geom.release();
@@ -1387,7 +2013,184 @@ static bool parseTakes(Scene* scene)
 }
 
 
-static bool parseObjects(const Element& root, Scene* scene)
+static bool isValid(const GlobalSettings& settings)
+{
+	if (settings.up_axis == settings.front_axis || settings.up_axis == settings.coord_axis) return false;
+	if (settings.front_axis == settings.coord_axis) return false;
+	if (abs(settings.up_axis_sign) != 1 || abs(settings.front_axis_sign) != 1 || abs(settings.coord_axis_sign) != 1) return false;
+	return settings.unit_scale_factor > 0;
+}
+
+
+GlobalSettings parseGlobalSettings(const Element& root)
+{
+	GlobalSettings settings;
+	const Element* global = findChild(root, "GlobalSettings");
+	const Element* props = global ? findChild(*global, "Properties70") : nullptr;
+	if (!props) return settings;
+
+	for (const Element* prop = props->child; prop; prop = prop->sibling)
+	{
+		const Property* value = (const Property*)prop->getProperty(4);
+		if (!value) continue;
+
+		double v;
+		if (!toNumber(*value, &v)) continue;
+
+		const DataView& name = prop->first_property->value;
+		const GlobalSettings::Axis axis = v == 0 ? GlobalSettings::X : (v == 1 ? GlobalSettings::Y : GlobalSettings::Z);
+		const int sign = v < 0 ? -1 : 1;
+		if (name == "UpAxis") settings.up_axis = axis;
+		else if (name == "UpAxisSign") settings.up_axis_sign = sign;
+		else if (name == "FrontAxis") settings.front_axis = axis;
+		else if (name == "FrontAxisSign") settings.front_axis_sign = sign;
+		else if (name == "CoordAxis") settings.coord_axis = axis;
+		else if (name == "CoordAxisSign") settings.coord_axis_sign = sign;
+		else if (name == "UnitScaleFactor") settings.unit_scale_factor = v;
+	}
+
+	// broken files get the default axes and unit
+	if (!isValid(settings)) settings = GlobalSettings();
+	return settings;
+}
+
+
+// columns are the coord, up and front directions
+static Matrix getBasis(const GlobalSettings& settings)
+{
+	Matrix basis = {};
+	basis.m[settings.coord_axis] = settings.coord_axis_sign;
+	basis.m[4 + settings.up_axis] = settings.up_axis_sign;
+	basis.m[8 + settings.front_axis] = settings.front_axis_sign;
+	basis.m[15] = 1;
+	return basis;
+}
+
+
+Matrix Scene::Conversion::convert(const Matrix& mtx) const
+{
+	return enabled ? matrix * mtx * inverse : mtx;
+}
+
+
+void Scene::Conversion::init(const GlobalSettings& source, const GlobalSettings& target)
+{
+	// bases are orthonormal, so the inverse is the transpose
+	axes = getBasis(target) * getInverseAffine(getBasis(source));
+	const double scale = source.unit_scale_factor / target.unit_scale_factor;
+	matrix = axes;
+	inverse = getInverseAffine(axes);
+	for (int i = 0; i < 12; ++i)
+	{
+		matrix.m[i] *= scale;
+		inverse.m[i] /= scale;
+	}
+	flip_winding = getDeterminant3x3(axes) < 0;
+
+	const Matrix identity = makeIdentity();
+	enabled = scale != 1 || memcmp(&axes, &identity, sizeof(identity)) != 0;
+}
+
+
+static bool initConversion(Scene* scene)
+{
+	scene->m_conversion = Scene::Conversion();
+	if (!scene->m_settings.convert_coordinates) return true;
+
+	const GlobalSettings& target = scene->m_settings.target_space;
+	if (!isValid(target))
+	{
+		Error::s_message = "Invalid target space";
+		return false;
+	}
+
+	scene->m_conversion.init(scene->m_global_settings, target);
+	return true;
+}
+
+
+// curves with identical key times, usually x, y and z of one curve node, end up sharing one array
+static void shareKeyTimes(Scene* scene)
+{
+	std::unordered_map<u64, std::vector<std::shared_ptr<const std::vector<u64>>>> arrays;
+	for (auto iter : scene->m_object_map)
+	{
+		Object* obj = iter.second.object;
+		if (!obj || obj->getType() != Object::Type::ANIMATION_CURVE) continue;
+
+		AnimationCurveImpl::Data& data = *((AnimationCurveImpl*)obj)->data;
+		const std::vector<u64>& times = *data.times;
+		u64 hash = 14695981039346656037ULL;
+		for (u64 time : times) hash = (hash ^ time) * 1099511628211ULL;
+
+		std::vector<std::shared_ptr<const std::vector<u64>>>& candidates = arrays[hash];
+		bool found = false;
+		for (const std::shared_ptr<const std::vector<u64>>& candidate : candidates)
+		{
+			if (candidate->size() != times.size()) continue;
+			if (!times.empty() && memcmp(&(*candidate)[0], &times[0], times.size() * sizeof(times[0])) != 0) continue;
+			data.times = candidate;
+			found = true;
+			break;
+		}
+		if (!found) candidates.push_back(data.times);
+	}
+}
+
+
+// source is the scene being cloned, its parsed data are shared instead of parsing them again
+// generating lightmap UVs dominates parsing, so geometries are parsed up front in parallel,
+// the charts of each geometry get the threads left per geometry
+static bool parseGeometries(Scene* scene, std::unordered_map<u64, std::unique_ptr<Object>>* geometries)
+{
+	std::vector<std::pair<u64, const Element*>> elements;
+	for (auto iter : scene->m_object_map)
+	{
+		const Element* element = iter.second.element;
+		if (iter.second.object == scene->m_root || element->id != "Geometry") continue;
+
+		Property* last_prop = element->first_property;
+		while (last_prop->next) last_prop = last_prop->next;
+		if (last_prop->value == "Mesh") elements.push_back({iter.first, element});
+	}
+
+	const int thread_count = scene->m_settings.lightmap.thread_count > 0 ? scene->m_settings.lightmap.thread_count
+																		 : (int)std::thread::hardware_concurrency();
+	const int geometry_threads = std::max(1, std::min(thread_count, (int)elements.size()));
+	const int chart_threads = std::max(1, thread_count / geometry_threads);
+	std::vector<Object*> objects(elements.size(), nullptr);
+	std::vector<const char*> errors(elements.size(), nullptr);
+	std::atomic<bool> ok(true);
+	parallelFor((int)elements.size(), geometry_threads, [&](int i) {
+		if (!ok) return;
+		OptionalError<Object*> obj = parseGeometryForRendering(*scene, *elements[i].second, chart_threads);
+		if (obj.isError())
+		{
+			// the message is set on the worker thread
+			errors[i] = Error::s_message;
+			ok = false;
+		}
+		else
+		{
+			objects[i] = obj.getValue();
+		}
+	});
+
+	for (size_t i = 0; i < elements.size(); ++i)
+	{
+		if (objects[i]) (*geometries)[elements[i].first].reset(objects[i]);
+	}
+	for (const char* error : errors)
+	{
+		if (!error) continue;
+		Error::s_message = error;
+		break;
+	}
+	return ok;
+}
+
+
+static bool parseObjects(const Element& root, Scene* scene, const Scene* source)
 {
 	const Element* objs = findChild(root, "Objects");
 	if (!objs) return true;
@@ -1410,19 +2213,42 @@ static bool parseObjects(const Element& root, Scene* scene)
 		object = object->sibling;
 	}
 
+	std::unordered_map<u64, std::unique_ptr<Object>> geometries;
+	if (!source && scene->m_settings.lightmap_uvs && !parseGeometries(scene, &geometries)) return false;
+
 	for (auto iter : scene->m_object_map)
 	{
 		OptionalError<Object*> obj = nullptr;
 
 		if (iter.second.object == scene->m_root) continue;
 
+		const Object* shared = nullptr;
+		if (source)
+		{
+			auto source_iter = source->m_object_map.find(iter.first);
+			if (source_iter != source->m_object_map.end()) shared = source_iter->second.object;
+		}
+
 		if (iter.second.element->id == "Geometry")
 		{
 			Property* last_prop = iter.second.element->first_property;
 			while (last_prop->next) last_prop = last_prop->next;
 			if (last_prop && last_prop->value == "Mesh")
 			{
-				obj = parseGeometryForRendering(*scene, *iter.second.element);
+				auto parsed = geometries.find(iter.first);
+				if (shared)
+					obj = share<GeometryImpl>(*scene, *iter.second.element, *shared);
+				else if (parsed != geometries.end())
+					obj = parsed->second.release();
+				else
+					obj = parseGeometryForRendering(*scene, *iter.second.element);
+			}
+			else if (last_prop && last_prop->value == "Shape")
+			{
+				if (shared)
+					obj = share<ShapeImpl>(*scene, *iter.second.element, *shared);
+				else
+					obj = parseShape(*scene, *iter.second.element);
 			}
 		}
 		else if (iter.second.element->id == "Material")
@@ -1444,11 +2270,18 @@ static bool parseObjects(const Element& root, Scene* scene)
 		}
 		else if (iter.second.element->id == "AnimationCurve")
 		{
-			obj = parseAnimationCurve(*scene, *iter.second.element);
+			if (shared)
+				obj = share<AnimationCurveImpl>(*scene, *iter.second.element, *shared);
+			else
+				obj = parseAnimationCurve(*scene, *iter.second.element);
 		}
 		else if (iter.second.element->id == "AnimationCurveNode")
 		{
 			obj = parse<AnimationCurveNodeImpl>(*scene, *iter.second.element);
+			if (shared && !obj.isError())
+			{
+				((AnimationCurveNodeImpl*)obj.getValue())->track = ((const AnimationCurveNodeImpl*)shared)->track;
+			}
 		}
 		else if (iter.second.element->id == "Deformer")
 		{
@@ -1457,9 +2290,14 @@ static bool parseObjects(const Element& root, Scene* scene)
 			if (class_prop)
 			{
 				if (class_prop->getValue() == "Cluster")
-					obj = parseCluster(*scene, *iter.second.element);
+					obj = shared ? share<ClusterImpl>(*scene, *iter.second.element, *shared)
+								 : parseCluster(*scene, *iter.second.element);
 				else if (class_prop->getValue() == "Skin")
 					obj = parse<SkinImpl>(*scene, *iter.second.element);
+				else if (class_prop->getValue() == "BlendShape")
+					obj = parse<BlendShapeImpl>(*scene, *iter.second.element);
+				else if (class_prop->getValue() == "BlendShapeChannel")
+					obj = parseBlendShapeChannel(*scene, *iter.second.element);
 			}
 		}
 		else if (iter.second.element->id == "NodeAttribute")
@@ -1521,7 +2359,8 @@ static bool parseObjects(const Element& root, Scene* scene)
 				parent->node_attribute = (NodeAttribute*)child;
 				break;
 			case Object::Type::ANIMATION_CURVE_NODE:
-				if (parent->isNode())
+				// any animated property, layers link their curve nodes object to object
+				if (con.type == Scene::Connection::OBJECT_PROPERTY)
 				{
 					AnimationCurveNodeImpl* node = (AnimationCurveNodeImpl*)child;
 					node->bone = parent;
@@ -1591,6 +2430,49 @@ static bool parseObjects(const Element& root, Scene* scene)
 			{
 				GeometryImpl* geom = (GeometryImpl*)parent;
 				if (child->getType() == Object::Type::SKIN) geom->skin = (Skin*)child;
+				else if (child->getType() == Object::Type::BLEND_SHAPE)
+				{
+					BlendShapeImpl* blend_shape = (BlendShapeImpl*)child;
+					if (blend_shape->geometry)
+					{
+						Error::s_message = "Invalid blend shape";
+						return false;
+					}
+					if (!geom->blend_shape) geom->blend_shape = blend_shape;
+					blend_shape->geometry = geom;
+				}
+				break;
+			}
+			case Object::Type::BLEND_SHAPE:
+			{
+				BlendShapeImpl* blend_shape = (BlendShapeImpl*)parent;
+				if (child->getType() == Object::Type::BLEND_SHAPE_CHANNEL)
+				{
+					BlendShapeChannelImpl* channel = (BlendShapeChannelImpl*)child;
+					if (channel->blend_shape)
+					{
+						Error::s_message = "Invalid blend shape channel";
+						return false;
+					}
+					blend_shape->channels.push_back(channel);
+					channel->blend_shape = blend_shape;
+				}
+				break;
+			}
+			case Object::Type::BLEND_SHAPE_CHANNEL:
+			{
+				BlendShapeChannelImpl* channel = (BlendShapeChannelImpl*)parent;
+				if (child->getType() == Object::Type::SHAPE)
+				{
+					ShapeImpl* shape = (ShapeImpl*)child;
+					if (shape->channel)
+					{
+						Error::s_message = "Invalid shape";
+						return false;
+					}
+					channel->shapes.push_back(shape);
+					shape->channel = channel;
+				}
 				break;
 			}
 			case Object::Type::CLUSTER:
@@ -1647,6 +2529,11 @@ static bool parseObjects(const Element& root, Scene* scene)
 		}
 	}
 
+	// shared data were already postprocessed by the source scene
+	if (source) return true;
+
+	shareKeyTimes(scene);
+
 	for (auto iter : scene->m_object_map)
 	{
 		Object* obj = iter.second.object;
@@ -1659,6 +2546,20 @@ static bool parseObjects(const Element& root, Scene* scene)
 				return false;
 			};
 		}
+		else if (obj->getType() == Object::Type::SHAPE)
+		{
+			ShapeImpl* shape = (ShapeImpl*)obj;
+			if (!shape->channel || !shape->channel->blend_shape || !shape->channel->blend_shape->geometry) continue;
+			if (!shape->postprocess(shape->channel->blend_shape->geometry))
+			{
+				Error::s_message = "Failed to postprocess shape";
+				return false;
+			}
+		}
+		else if (obj->getType() == Object::Type::ANIMATION_CURVE_NODE)
+		{
+			((AnimationCurveNodeImpl*)obj)->postprocess();
+		}
 	}
 
 	return true;
@@ -1732,7 +2633,7 @@ Matrix Object::evalLocal(const Vec3& translation, const Vec3& rotation) const
 	setTranslation(-scaling_pivot, &s_p_inv);
 
 	// http://help.autodesk.com/view/FBX/2017/ENU/?guid=__files_GUID_10CDD63C_79C1_4F2D_BB28_AD2BE65A02ED_htm
-	return t * r_off * r_p * r_pre * r * r_post_inv * r_p_inv * s_off * s_p * s * s_p_inv;
+	return scene.m_conversion.convert(t * r_off * r_p * r_pre * r * r_post_inv * r_p_inv * s_off * s_p * s * s_p_inv);
 }
 
 
@@ -1850,26 +2751,311 @@ Object* Object::getParent() const
 }
 
 
+#ifdef OFBX_SSE2
+// adds the 4 scaled deltas of one SoA block (x0..x3, y0..y3, z0..z3) to up to 4 scattered vertices
+static void addDeltaBlock(const float* block, __m128 w, const int* indices, int count, Vec3* out)
+{
+	__m128 d[4] = {_mm_mul_ps(_mm_loadu_ps(block), w),
+		_mm_mul_ps(_mm_loadu_ps(block + 4), w),
+		_mm_mul_ps(_mm_loadu_ps(block + 8), w),
+		_mm_setzero_ps()};
+	_MM_TRANSPOSE4_PS(d[0], d[1], d[2], d[3]); // d[j] = (xj, yj, zj, 0)
+	for (int j = 0; j < count; ++j)
+	{
+		Vec3& v = out[indices[j]];
+		_mm_storeu_pd(&v.x, _mm_add_pd(_mm_loadu_pd(&v.x), _mm_cvtps_pd(d[j])));
+		_mm_store_sd(&v.z, _mm_add_sd(_mm_load_sd(&v.z), _mm_cvtps_pd(_mm_movehl_ps(d[j], d[j]))));
+	}
+}
+#endif
+
+
+template <bool NORMALS>
+static void applyShapeDeltas(const ShapeImpl& shape, double weight, Vec3* out_positions, Vec3* out_normals)
+{
+	const int* indices = &shape.data->indices[0];
+	const int count = (int)shape.data->indices.size();
+#ifdef OFBX_SSE2
+	// shapes without a blend shape geometry are not postprocessed, so they are not packed either
+	if (!shape.data->packed.empty())
+	{
+		const __m128 w = _mm_set1_ps((float)weight);
+		const float* block = &shape.data->packed[0];
+		const int block_size = shape.data->normals.empty() ? 12 : 24;
+		for (int i = 0; i < count; i += 4, block += block_size)
+		{
+			const int block_count = std::min(4, count - i);
+			addDeltaBlock(block, w, indices + i, block_count, out_positions);
+			if (NORMALS) addDeltaBlock(block + 12, w, indices + i, block_count, out_normals);
+		}
+		return;
+	}
+#endif
+	const Vec3* deltas = &shape.data->vertices[0];
+	const Vec3* normals = NORMALS ? &shape.data->normals[0] : nullptr;
+	for (int i = 0; i < count; ++i)
+	{
+		Vec3& p = out_positions[indices[i]];
+		p.x += deltas[i].x * weight;
+		p.y += deltas[i].y * weight;
+		p.z += deltas[i].z * weight;
+		if (NORMALS)
+		{
+			Vec3& n = out_normals[indices[i]];
+			n.x += normals[i].x * weight;
+			n.y += normals[i].y * weight;
+			n.z += normals[i].z * weight;
+		}
+	}
+}
+
+
+void applyShapes(const Vec3* base_positions,
+	const Vec3* base_normals,
+	int vertex_count,
+	const Shape* const* shapes,
+	const double* weights,
+	int shape_count,
+	Vec3* out_positions,
+	Vec3* out_normals)
+{
+	assert(base_positions && out_positions);
+	const bool has_normals = base_normals && out_normals;
+	if (out_positions != base_positions) memcpy(out_positions, base_positions, sizeof(Vec3) * vertex_count);
+	if (has_normals && out_normals != base_normals) memcpy(out_normals, base_normals, sizeof(Vec3) * vertex_count);
+
+	for (int i = 0; i < shape_count; ++i)
+	{
+		if (weights[i] == 0) continue;
+		const ShapeImpl& shape = *(const ShapeImpl*)shapes[i];
+		if (shape.data->indices.empty()) continue;
+
+		if (has_normals && !shape.data->normals.empty())
+			applyShapeDeltas<true>(shape, weights[i], out_positions, out_normals);
+		else
+			applyShapeDeltas<false>(shape, weights[i], out_positions, nullptr);
+	}
+}
+
+
 IScene* load(const u8* data, int size)
 {
+	return load(data, size, LoadSettings());
+}
+
+
+// seconds since the previous lap
+struct StageTimer
+{
+	double lap()
+	{
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration<double>(now - last).count();
+		last = now;
+		return seconds;
+	}
+
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+};
+
+
+static void partitionSkins(Scene* scene)
+{
+	for (Object* obj : scene->m_all_objects)
+	{
+		if (obj->getType() != Object::Type::GEOMETRY) continue;
+		GeometryImpl* geom = (GeometryImpl*)obj;
+		if (!geom->skin) continue;
+
+		if (scene->m_settings.bone_palette_size > 0)
+			partitionSkin(geom, scene->m_settings.bone_palette_size);
+		else
+			geom->skin_partitions.reset();
+	}
+}
+
+
+static void computeBoneBounds(Scene* scene)
+{
+	for (Object* obj : scene->m_all_objects)
+	{
+		if (obj->getType() != Object::Type::GEOMETRY) continue;
+		GeometryImpl* geom = (GeometryImpl*)obj;
+		if (!geom->skin) continue;
+
+		if (scene->m_settings.bone_bounds)
+			computeBoneBounds(geom, scene->m_settings.bone_bounds_min_weight);
+		else
+			geom->bone_bounds.reset();
+	}
+}
+
+
+static bool operator==(const GlobalSettings& a, const GlobalSettings& b)
+{
+	return a.up_axis == b.up_axis && a.up_axis_sign == b.up_axis_sign && a.front_axis == b.front_axis &&
+		a.front_axis_sign == b.front_axis_sign && a.coord_axis == b.coord_axis && a.coord_axis_sign == b.coord_axis_sign &&
+		a.unit_scale_factor == b.unit_scale_factor;
+}
+
+
+// settings the parsed geometries, shapes and clusters depend on, the thread count does not change the result
+static bool sameGeometrySettings(const LoadSettings& a, const LoadSettings& b)
+{
+	if (a.clean_meshes != b.clean_meshes || a.adjacency != b.adjacency) return false;
+	if (a.convert_coordinates != b.convert_coordinates) return false;
+	if (a.convert_coordinates && !(a.target_space == b.target_space)) return false;
+	if (a.lightmap_uvs != b.lightmap_uvs) return false;
+	return !a.lightmap_uvs ||
+		(a.lightmap.resolution == b.lightmap.resolution && a.lightmap.padding == b.lightmap.padding &&
+			a.lightmap.max_chart_angle == b.lightmap.max_chart_angle);
+}
+
+
+static bool sameTextureSettings(const LoadSettings& a, const LoadSettings& b)
+{
+	if (a.resolve_textures != b.resolve_textures) return false;
+	if (!a.resolve_textures) return true;
+	if (a.prefetch_textures != b.prefetch_textures || a.texture_io_threads != b.texture_io_threads) return false;
+	if (a.texture_search_paths.size() != b.texture_search_paths.size()) return false;
+	for (size_t i = 0; i < a.texture_search_paths.size(); ++i)
+	{
+		if (strcmp(a.texture_search_paths[i], b.texture_search_paths[i]) != 0) return false;
+	}
+	return true;
+}
+
+
+IScene* Scene::clone(const LoadSettings& settings) const
+{
+	std::unique_ptr<Scene> scene = std::make_unique<Scene>();
+	scene->m_settings = settings;
+	scene->m_global_settings = m_global_settings;
+	scene->m_document = m_document;
+	scene->m_root_element = m_root_element;
+	scene->m_connections = m_connections;
+	scene->m_take_infos = m_take_infos;
+
+	StageTimer timer;
+	if (sameTextureSettings(settings, m_settings))
+		scene->m_texture_files = m_texture_files;
+	else
+		resolveTextures(scene.get());
+	scene->m_load_stats.textures = timer.lap();
+
+	// geometry stages run while parsing and rendering vertices, shape deltas and cluster weights depend on them,
+	// so with different settings the clone parses all objects again from the shared document
+	const bool share_objects = sameGeometrySettings(settings, m_settings);
+	if (share_objects)
+		scene->m_conversion = m_conversion;
+	else if (!initConversion(scene.get()))
+		return nullptr;
+	if (!parseObjects(*m_root_element, scene.get(), share_objects ? this : nullptr)) return nullptr;
+	scene->m_load_stats.objects = timer.lap();
+
+	if (!share_objects)
+	{
+		if (settings.bone_palette_size > 0) partitionSkins(scene.get());
+		scene->m_load_stats.skin_partitions = timer.lap();
+		if (settings.bone_bounds) computeBoneBounds(scene.get());
+		scene->m_load_stats.bone_bounds = timer.lap();
+		return scene.release();
+	}
+
+	// skin partitions and bone bounds are shared too unless their settings change
+	for (auto iter : scene->m_object_map)
+	{
+		Object* obj = iter.second.object;
+		if (!obj || obj->getType() != Object::Type::GEOMETRY) continue;
+		const GeometryImpl* source = (const GeometryImpl*)m_object_map.find(iter.first)->second.object;
+		if (!source) continue;
+		((GeometryImpl*)obj)->skin_partitions = source->skin_partitions;
+		((GeometryImpl*)obj)->bone_bounds = source->bone_bounds;
+	}
+	if (settings.bone_palette_size != m_settings.bone_palette_size) partitionSkins(scene.get());
+	scene->m_load_stats.skin_partitions = timer.lap();
+	if (settings.bone_bounds != m_settings.bone_bounds
+		|| (settings.bone_bounds && settings.bone_bounds_min_weight != m_settings.bone_bounds_min_weight))
+	{
+		computeBoneBounds(scene.get());
+	}
+	scene->m_load_stats.bone_bounds = timer.lap();
+
+	return scene.release();
+}
+
+
+// takes the content of data, so files read by loadFiles() are not copied
+static IScene* loadDocument(std::vector<u8>* data, const LoadSettings& settings)
+{
+	StageTimer timer;
 	std::unique_ptr<Scene> scene = std::make_unique<Scene>();
-	scene->m_data.resize(size);
-	memcpy(&scene->m_data[0], data, size);
-	OptionalError<Element*> root = tokenize(&scene->m_data[0], size);
+	scene->m_settings = settings;
+	LoadStats& stats = scene->m_load_stats;
+	std::shared_ptr<Scene::Document> document = std::make_shared<Scene::Document>();
+	scene->m_document = document;
+	document->data.swap(*data);
+	OptionalError<Element*> root = tokenize(document->data.data(), document->data.size());
 	if (root.isError()) return nullptr;
 
+	document->root = root.getValue();
 	scene->m_root_element = root.getValue();
 	assert(scene->m_root_element);
+	stats.tokenize = timer.lap();
 
 	//if (parseTemplates(*root.getValue()).isError()) return nullptr;
 	if(!parseConnections(*root.getValue(), scene.get())) return nullptr;
+	stats.connections = timer.lap();
 	if(!parseTakes(scene.get())) return nullptr;
-	if(!parseObjects(*root.getValue(), scene.get())) return nullptr;
+	stats.takes = timer.lap();
+	resolveTextures(scene.get());
+	stats.textures = timer.lap();
+	scene->m_global_settings = parseGlobalSettings(*root.getValue());
+	if (!initConversion(scene.get())) return nullptr;
+	if(!parseObjects(*root.getValue(), scene.get(), nullptr)) return nullptr;
+	stats.objects = timer.lap();
+
+	if (settings.bone_palette_size > 0) partitionSkins(scene.get());
+	stats.skin_partitions = timer.lap();
+	if (settings.bone_bounds) computeBoneBounds(scene.get());
+	stats.bone_bounds = timer.lap();
 	
 	return scene.release();
 }
 
 
+IScene* load(const u8* data, int size, const LoadSettings& settings)
+{
+	std::vector<u8> copy(data, data + size);
+	return loadDocument(&copy, settings);
+}
+
+
+bool loadFiles(const char* const* paths,
+	int file_count,
+	const LoadSettings& settings,
+	const FileReadSettings& read_settings,
+	int thread_count,
+	IScene** scenes)
+{
+	assert(scenes);
+	std::vector<const char*> errors(file_count, nullptr);
+	forEachFile(paths, file_count, read_settings, thread_count, [&](int index, std::vector<u8>& data, bool ok) {
+		scenes[index] = ok ? loadDocument(&data, settings) : nullptr;
+		if (!scenes[index]) errors[index] = ok ? Error::s_message : "Failed to read file";
+	});
+
+	// errors are set on the loading threads, report the first one on the calling thread
+	for (const char* error : errors)
+	{
+		if (!error) continue;
+		Error::s_message = error;
+		return false;
+	}
+	return true;
+}
+
+
 const char* getError()
 {
 	return Error::s_message;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <vector>
 
 namespace ofbx
@@ -112,6 +113,7 @@ struct AnimationCurveNode;
 struct AnimationLayer;
 struct Scene;
 struct IScene;
+struct LoadSettings;
 
 
 struct Object
@@ -131,7 +133,10 @@ struct Object
 		ANIMATION_STACK,
 		ANIMATION_LAYER,
 		ANIMATION_CURVE,
-		ANIMATION_CURVE_NODE
+		ANIMATION_CURVE_NODE,
+		BLEND_SHAPE,
+		BLEND_SHAPE_CHANNEL,
+		SHAPE
 	};
 
 	Object(const Scene& _scene, const IElement& _element);
@@ -200,6 +205,8 @@ struct Material : Object
 	Material(const Scene& _scene, const IElement& _element);
 
 	virtual const Texture* getTexture(Texture::TextureType type) const = 0;
+	// DiffuseColor property, {0.8, 0.8, 0.8} if it's missing
+	Vec3 getDiffuseColor() const;
 };
 
 
@@ -240,6 +247,105 @@ struct NodeAttribute : Object
 };
 
 
+struct Shape : Object
+{
+	static const Type s_type = Type::SHAPE;
+
+	Shape(const Scene& _scene, const IElement& _element);
+
+	// sparse deltas, indices are rendering vertices (same space as Geometry::getVertices)
+	virtual int getDeltaCount() const = 0;
+	virtual const int* getIndices() const = 0;
+	virtual const Vec3* getDeltaPositions() const = 0;
+	virtual const Vec3* getDeltaNormals() const = 0; // nullptr if the shape has no normals
+};
+
+
+struct BlendShapeChannel : Object
+{
+	static const Type s_type = Type::BLEND_SHAPE_CHANNEL;
+
+	BlendShapeChannel(const Scene& _scene, const IElement& _element);
+
+	virtual double getDeformPercent() const = 0;
+	virtual int getShapeCount() const = 0;
+	virtual const Shape* getShape(int idx) const = 0;
+	virtual double getFullWeight(int idx) const = 0;
+	// converts channel's percent (0-100, e.g. sampled from "DeformPercent" curve) to per-shape weights,
+	// in-between shapes are blended linearly, percents past the last full weight are clamped to it;
+	// weights must have getShapeCount() elements
+	virtual void getShapeWeights(double deform_percent, double* weights) const = 0;
+};
+
+
+struct BlendShape : Object
+{
+	static const Type s_type = Type::BLEND_SHAPE;
+
+	BlendShape(const Scene& _scene, const IElement& _element);
+
+	virtual int getBlendShapeChannelCount() const = 0;
+	virtual const BlendShapeChannel* getBlendShapeChannel(int idx) const = 0;
+};
+
+
+// part of a skinned geometry which uses at most LoadSettings::bone_palette_size bones
+struct SkinPartition
+{
+	enum { MAX_INFLUENCES = 4 };
+
+	std::vector<int> bones; // local bone index -> cluster index in Skin
+	std::vector<int> vertices; // local vertex -> rendering vertex, vertices on partition boundaries are duplicated
+	std::vector<int> indices; // triangles, local vertices
+	std::vector<int> triangles; // local triangle -> triangle in Geometry::getTriangles, e.g. to look up material
+	std::vector<u8> bone_indices; // MAX_INFLUENCES local bone indices per local vertex
+	std::vector<float> weights; // MAX_INFLUENCES normalized weights per local vertex
+};
+
+
+// what LoadSettings::clean_meshes removed from a geometry
+struct CleanupReport
+{
+	int degenerate_triangles = 0; // repeated control point or zero area
+	int duplicate_triangles = 0; // same vertices, winding and material as an earlier triangle
+	int unused_vertices = 0;
+};
+
+
+// half-edge topology of the source polygons, built if LoadSettings::adjacency is set;
+// half edges of polygon p are [polygon_starts[p], polygon_starts[p + 1]), in the polygon's winding order
+struct Adjacency
+{
+	std::vector<int> vertices; // rendering vertex each half edge starts at, -1 if LoadSettings::clean_meshes removed it
+	std::vector<int> polygons; // polygon of each half edge
+	// half edge in the opposite direction between the same control points, so twins connect across UV and normal
+	// seams; -1 on boundary and non-manifold edges (more than two half edges or the same direction)
+	std::vector<int> twins;
+	std::vector<int> polygon_starts; // polygon count + 1 elements, polygons with less than 3 vertices are kept
+	std::vector<int> triangle_polygons; // polygon each triangle of Geometry::getTriangles() was cut from
+	int non_manifold_edges = 0;
+
+	int getPolygonCount() const { return (int)polygon_starts.size() - 1; }
+	int next(int half_edge) const
+	{
+		const int n = half_edge + 1;
+		return n == polygon_starts[polygons[half_edge] + 1] ? polygon_starts[polygons[half_edge]] : n;
+	}
+	int prev(int half_edge) const
+	{
+		return half_edge == polygon_starts[polygons[half_edge]] ? polygon_starts[polygons[half_edge] + 1] - 1 : half_edge - 1;
+	}
+};
+
+
+// bind pose bounds of the vertices a cluster influences, in the space of the cluster's link node
+struct BoneBounds
+{
+	Vec3 min;
+	Vec3 max; // min > max if the cluster influences no vertex
+};
+
+
 struct Geometry : Object
 {
 	static const Type s_type = Type::GEOMETRY;
@@ -248,12 +354,28 @@ struct Geometry : Object
 
 	virtual const std::vector<Vec3>& getVertices() const = 0;
 	virtual const std::vector<Vec3>& getNormals() const = 0;
-	virtual const std::vector<Vec2>& getUVs() const = 0;
-	virtual const std::vector<Vec4>& getColors() const = 0;
+	virtual const std::vector<Vec2>& getUVs(int index = 0) const = 0;
+	virtual int getUVSetCount() const = 0;
+	virtual DataView getUVSetName(int index) const = 0;
+	virtual const std::vector<Vec4>& getColors(int index = 0) const = 0;
+	virtual int getColorSetCount() const = 0;
+	virtual DataView getColorSetName(int index) const = 0;
 	virtual const std::vector<Vec3>& getTangents() const = 0;
+	// control point (index in the file's Vertices array) of each rendering vertex of getVertices(),
+	// e.g. to map point caches, see scatterControlPoints()
+	virtual const std::vector<int>& getVertexControlPoints() const = 0;
+	virtual int getControlPointCount() const = 0;
 
 	virtual const Skin* getSkin() const = 0;
+	virtual int getSkinPartitionCount() const = 0;
+	virtual const SkinPartition& getSkinPartition(int idx) const = 0;
+	virtual const BlendShape* getBlendShape() const = 0;
 	virtual const int* getMaterials() const = 0;
+	virtual const CleanupReport& getCleanupReport() const = 0;
+	// one per cluster of getSkin(), nullptr unless LoadSettings::bone_bounds is set
+	virtual const BoneBounds* getBoneBounds() const = 0;
+	// nullptr unless LoadSettings::adjacency is set
+	virtual const Adjacency* getAdjacency() const = 0;
 
 	virtual const std::vector<int>& getTriangles() const = 0;
 	virtual size_t getTriangleCount() const = 0;
@@ -288,7 +410,11 @@ struct AnimationLayer : Object
 
 	AnimationLayer(const Scene& _scene, const IElement& _element);
 
+	// bone can be any object with an animated property, e.g. a node, a BlendShapeChannel ("DeformPercent" property,
+	// value in x), a material ("DiffuseColor") or a camera attribute ("FieldOfView")
 	virtual const AnimationCurveNode* getCurveNode(const Object& bone, const char* property) const = 0;
+	virtual int getCurveNodeCount() const = 0;
+	virtual const AnimationCurveNode* getCurveNode(int index) const = 0;
 };
 
 
@@ -304,6 +430,26 @@ struct AnimationCurve : Object
 };
 
 
+// animated property of any object; vec3 and color components are x, y, z and r, g, b, scalars and bools have one
+struct AnimationChannel
+{
+	enum Type
+	{
+		SCALAR,
+		VEC3,
+		COLOR,
+		BOOL // sampled as 0 or 1
+	};
+
+	const AnimationCurveNode* node = nullptr;
+	const Object* target = nullptr; // null if the curve node is not connected to a property
+	DataView property; // e.g. "Lcl Rotation", "DiffuseColor", "FieldOfView", "Visibility" or a user property
+	Type type = SCALAR;
+
+	int getComponentCount() const { return type == VEC3 || type == COLOR ? 3 : 1; }
+};
+
+
 struct AnimationCurveNode : Object
 {
 	static const Type s_type = Type::ANIMATION_CURVE_NODE;
@@ -311,6 +457,11 @@ struct AnimationCurveNode : Object
 	AnimationCurveNode(const Scene& _scene, const IElement& _element);
 
 	virtual Vec3 getNodeLocalTransform(double time) const = 0;
+	// type comes from the target's property declaration, or from the property name and curve count if it has none
+	virtual AnimationChannel getChannel() const = 0;
+	// frame_count frames frame_time seconds apart, writes the channel's component count floats per frame to out,
+	// stride floats between frames; components without a curve get the curve node's default value
+	virtual void sample(double start_time, double frame_time, int frame_count, int stride, float* out) const = 0;
 };
 
 
@@ -325,26 +476,561 @@ struct TakeInfo
 };
 
 
+// axes and unit of a scene, as stored in the file's GlobalSettings; also the target of LoadSettings::convert_coordinates
+struct GlobalSettings
+{
+	enum Axis
+	{
+		X,
+		Y,
+		Z
+	};
+
+	// signs are 1 or -1; front = coord x up in right-handed systems, e.g. Y-up right-handed is the default below
+	Axis up_axis = Y;
+	int up_axis_sign = 1;
+	Axis front_axis = Z;
+	int front_axis_sign = 1;
+	Axis coord_axis = X;
+	int coord_axis_sign = 1;
+	double unit_scale_factor = 1; // centimeters per unit
+};
+
+
+// wall clock time of the load stages in seconds
+struct LoadStats
+{
+	double tokenize = 0;
+	double connections = 0;
+	double takes = 0;
+	double objects = 0; // parsing objects including geometries, linking and postprocessing
+	double skin_partitions = 0;
+	double bone_bounds = 0;
+	double textures = 0; // resolving paths and starting the prefetch, not the reads
+};
+
+
+// a file referenced by the scene's textures if LoadSettings::resolve_textures is set,
+// textures whose paths resolve to the same file share one
+struct TextureFile
+{
+	enum Status
+	{
+		NOT_FOUND,
+		FOUND, // not read, LoadSettings::prefetch_textures is not set
+		READY,
+		READ_FAILED
+	};
+
+	Status status = NOT_FOUND;
+	const char* path = nullptr; // found path, or the normalized file name if it was not found
+	std::vector<u8> data; // whole file, ready to decode, if status is READY
+};
+
+
 struct IScene
 {
 	virtual void destroy() = 0;
 	virtual const IElement* getRootElement() const = 0;
 	virtual const Object* getRoot() const = 0;
 	virtual const TakeInfo* getTakeInfo(const char* name) const = 0;
+	// as stored in the file, even if the scene was converted
+	virtual const GlobalSettings& getGlobalSettings() const = 0;
 	virtual int getMeshCount() const = 0;
 	virtual const Mesh* getMesh(int index) const = 0;
 	virtual int getAnimationStackCount() const = 0;
 	virtual const AnimationStack* getAnimationStack(int index) const = 0;
 	virtual const Object *const * getAllObjects() const = 0;
 	virtual int getAllObjectCount() const = 0;
+	// clones only have the stages they redo
+	virtual const LoadStats& getLoadStats() const = 0;
+	// 0 unless LoadSettings::resolve_textures is set; with prefetch_textures, getTextureFile() waits until
+	// the file is read, files are read in the order of their first use in the document
+	virtual int getTextureFileCount() const = 0;
+	virtual const TextureFile& getTextureFile(int index) const = 0;
+	// nullptr if textures were not resolved or the texture has no file name
+	virtual const TextureFile* getTextureFile(const Texture& texture) const = 0;
+	// new scene sharing the source data, element tree and parsed geometries, curves and deformers,
+	// only the small per-scene tables are rebuilt; returns nullptr on error
+	virtual IScene* clone() const = 0;
+	// as above, stages depending on settings are redone for the clone only; if clean_meshes, adjacency,
+	// convert_coordinates or lightmap_uvs settings differ from the source's, the clone parses its own objects
+	// from the shared document instead of sharing them
+	virtual IScene* clone(const LoadSettings& settings) const = 0;
 
 protected:
 	virtual ~IScene() {}
 };
 
 
+struct MeshBatch
+{
+	// part of the batch coming from one source mesh
+	struct Range
+	{
+		const Mesh* mesh;
+		int first_vertex;
+		int vertex_count;
+		int first_index;
+		int index_count;
+	};
+
+	const Material* material = nullptr;
+	std::vector<Vec3> vertices;
+	std::vector<Vec3> normals;
+	std::vector<Vec3> tangents;
+	std::vector<std::vector<Vec2>> uvs;
+	std::vector<std::vector<Vec4>> colors;
+	std::vector<int> indices;
+	std::vector<Range> ranges;
+};
+
+
+struct BatchSettings
+{
+	int max_vertices = 65536;
+	int max_indices = 3 * 65536;
+	// bake getGlobalTransform() * getGeometricMatrix() into vertices, normals and tangents
+	bool pre_transform = true;
+};
+
+
+// merges static (not skinned, no blend shapes) meshes sharing a material into batches
+void batchStaticMeshes(const IScene& scene, const BatchSettings& settings, std::vector<MeshBatch>* batches);
+
+
+struct SceneCell
+{
+	// whole mesh, or the triangles of a mesh split between cells
+	struct Part
+	{
+		const Mesh* mesh;
+		std::vector<int> triangles; // indices of triangles in getTriangles(), empty if the whole mesh is in the cell
+	};
+
+	int level; // octree depth, 0 for grid cells
+	int x, y, z; // cell coordinates in the grid or in the octree level
+	Vec3 min; // cell box in world space, content can stick out by up to a triangle
+	Vec3 max;
+	Vec3 bounds_min; // world-space bounds of the cell's meshes and triangles, use these for culling
+	Vec3 bounds_max;
+	std::vector<Part> parts;
+	std::vector<MeshBatch> batches; // static parts merged in world space if TilingSettings::merge is set
+};
+
+
+struct TilingSettings
+{
+	enum Mode
+	{
+		GRID,
+		OCTREE
+	};
+
+	Mode mode = GRID;
+	// GRID: cell size on each axis, 0 leaves the axis undivided, e.g. {500, 0, 500} for ground tiles in a Y-up scene;
+	// OCTREE: nodes are not subdivided below this size
+	Vec3 cell_size = {100, 100, 100};
+	// OCTREE: nodes with more triangles are subdivided
+	int max_cell_triangles = 65536;
+	// meshes bigger than a cell are split, their triangles go to the cell containing their center and are not clipped
+	bool split_meshes = true;
+	bool merge = false;
+	BatchSettings batch_settings;
+	// 0 - std::thread::hardware_concurrency()
+	int thread_count = 0;
+};
+
+
+// bins meshes by world-space bounds (getGlobalTransform() * getGeometricMatrix()) into cells of a grid or an octree,
+// mesh bounds and merged buffers are computed in parallel; empty cells are not emitted
+void tileScene(const IScene& scene, const TilingSettings& settings, std::vector<SceneCell>* cells);
+
+
+struct ConvexHull
+{
+	std::vector<Vec3> vertices;
+	std::vector<Vec4> planes; // outward normal in xyz, w = -dot(normal, point on plane); inside if dot(normal, p) + w <= 0
+};
+
+
+struct CollisionProxy
+{
+	const Mesh* mesh; // render mesh, hull coordinates are in its node space (getGlobalTransform())
+	bool from_hints; // hulls come from UCX_ (UBX_, UCP_, USP_) nodes instead of the render geometry
+	std::vector<ConvexHull> hulls;
+};
+
+
+struct CollisionSettings
+{
+	// hulls are built from at most this many of the most extreme points
+	int max_hull_vertices = 64;
+	// split concave meshes into several hulls, otherwise every mesh gets one hull;
+	// with Geometry::getAdjacency(), disconnected pieces are tried as a split too
+	bool decompose = true;
+	int max_hulls = 16;
+	// a part is split only if it reduces the volume of its hulls at least by this fraction
+	double min_volume_gain = 0.1;
+	// 0 - std::thread::hardware_concurrency()
+	int thread_count = 0;
+};
+
+
+// one proxy per mesh; nodes named UCX_<mesh name> or UCX_<mesh name>_<number> (or with UBX_, UCP_, USP_)
+// are hulls authored for the mesh, they are used instead of the mesh and don't get proxies of their own;
+// flat and degenerate geometries get no hulls; meshes are processed in parallel
+void buildCollisionProxies(const IScene& scene, const CollisionSettings& settings, std::vector<CollisionProxy>* proxies);
+
+
+struct Skeleton
+{
+	struct Bone
+	{
+		const Object* node;
+		int parent; // -1 for roots
+		// local transforms of removed static ancestors between parent and this bone,
+		// global = parent's global * offset * node's local
+		Matrix offset;
+	};
+
+	struct SkinBones
+	{
+		const Skin* skin;
+		std::vector<int> cluster_bones; // cluster index -> bone index, -1 if the cluster is not linked
+	};
+
+	int findBone(const char* name) const;
+
+	std::vector<Bone> bones; // parents are always before their children
+	std::vector<SkinBones> skins;
+};
+
+
+// builds a compact hierarchy of nodes linked by clusters, animated by any stack, holding a non-skinned mesh
+// or named in keep_names; other nodes are removed and their static transforms collapsed into Bone::offset
+void optimizeSkeleton(const IScene& scene, const char* const* keep_names, int keep_count, Skeleton* skeleton);
+
+
+// world transforms of skeleton bones updated incrementally; locals start as the nodes' local transforms,
+// overriding one marks the bone's subtree dirty and update() recomputes only dirty bones, parents first
+struct Pose
+{
+	// the skeleton must outlive the pose
+	void init(const Skeleton& skeleton);
+	void setLocal(int bone, const Matrix& local);
+	// back to the node's transform
+	void resetLocal(int bone);
+	// returns bones whose global transform was recomputed, in ascending order, valid until the next update()
+	const std::vector<int>& update();
+
+	const Matrix& getLocal(int bone) const { return locals[bone]; }
+	const Matrix& getGlobal(int bone) const { return globals[bone]; }
+	bool isDirty() const { return !dirty_bones.empty(); }
+
+	const Skeleton* skeleton = nullptr;
+	std::vector<Matrix> locals;
+	std::vector<Matrix> globals;
+	// children of bone i are children[child_offsets[i]] ... children[child_offsets[i + 1] - 1]
+	std::vector<int> child_offsets;
+	std::vector<int> children;
+	std::vector<int> dirty_bones;
+	std::vector<bool> dirty;
+	std::vector<int> changed;
+};
+
+
+struct AnimationClip
+{
+	struct Curve
+	{
+		std::vector<u64> times;
+		std::vector<float> values;
+	};
+
+	struct Track
+	{
+		enum Channel
+		{
+			TRANSLATION,
+			ROTATION,
+			SCALING
+		};
+
+		int bone; // index in Skeleton::bones
+		Channel channel;
+		Curve curves[3]; // x, y, z, empty if the component is not animated
+	};
+
+	int file; // index of the source file
+	char name[128]; // animation stack name
+	std::vector<Track> tracks;
+};
+
+
+// how loadFiles() and loadAnimationLibrary() read files
+struct FileReadSettings
+{
+	enum Backend
+	{
+		AUTO, // IO_URING if the platform and kernel support it, THREAD_POOL otherwise
+		IO_URING, // Linux only, batched reads from one thread, falls back to THREAD_POOL if unavailable
+		THREAD_POOL // threads reading whole files with pread (fread on Windows)
+	};
+
+	Backend backend = AUTO;
+	// files being read at once, also the most read files waiting to be parsed
+	int queue_depth = 64;
+	// threads of THREAD_POOL, 0 - queue_depth / 8
+	int thread_count = 0;
+};
+
+
+struct AnimationLibrarySettings
+{
+	// match curves by node names joined with '/' from the root instead of node name
+	bool match_by_path = false;
+	// 0 - std::thread::hardware_concurrency()
+	int thread_count = 0;
+};
+
+
+// parses only animation objects, node names and connections of each file and binds the curves to skeleton bones;
+// other objects such as geometries are skipped without being tokenized
+// files are processed in parallel, clips are appended in file order, returns false if any file failed and
+// getError() then describes the first failure in file order
+// if the skeleton's scene was loaded with convert_coordinates, translation curves are converted from each file's
+// GlobalSettings to its target_space; rotation and scaling curves are left as stored
+bool loadAnimationLibrary(const Skeleton& skeleton,
+	const u8* const* files,
+	const int* sizes,
+	int file_count,
+	const AnimationLibrarySettings& settings,
+	std::vector<AnimationClip>* clips);
+// as above, reading the files with read_settings; files are parsed as they arrive while others are being read
+bool loadAnimationLibrary(const Skeleton& skeleton,
+	const char* const* paths,
+	int file_count,
+	const AnimationLibrarySettings& settings,
+	const FileReadSettings& read_settings,
+	std::vector<AnimationClip>* clips);
+
+
+// out_positions = base_positions + sum(weights[i] * shapes[i] deltas), same for normals if both are not null;
+// out buffers have vertex_count elements, shapes with zero weight are skipped; with SSE2 the deltas are scaled
+// in single precision, 4 at a time
+void applyShapes(const Vec3* base_positions,
+	const Vec3* base_normals,
+	int vertex_count,
+	const Shape* const* shapes,
+	const double* weights,
+	int shape_count,
+	Vec3* out_positions,
+	Vec3* out_normals);
+
+
+// rendering vertex positions (like Geometry::getVertices()) from new positions of the geometry's control points,
+// e.g. one frame of a point cache, in one gather pass; control_points has getControlPointCount() elements in file
+// space and is converted like the geometry if LoadSettings::convert_coordinates is set; if out_normals is not null,
+// normals are recomputed from the triangles, smooth across vertices sharing a control point and the same loaded normal
+void scatterControlPoints(const Geometry& geometry, const Vec3* control_points, Vec3* out_positions, Vec3* out_normals);
+// as above with 3 floats per control point
+void scatterControlPoints(const Geometry& geometry, const float* control_points, Vec3* out_positions, Vec3* out_normals);
+
+
+// world AABB of a posed skinned geometry from Geometry::getBoneBounds(); cluster_transforms are the current
+// global transforms of the clusters' link nodes, one per cluster; returns false if the geometry has no bone bounds
+// or no cluster influences any vertex
+bool getSkinnedBounds(const Geometry& geometry, const Matrix* cluster_transforms, Vec3* min, Vec3* max);
+
+
+struct VertexAnimationSettings
+{
+	double frame_rate = 30;
+	// seconds, both frames included; if end_time < start_time the take of the animation stack is used
+	double start_time = 0;
+	double end_time = -1;
+	// 0 - std::thread::hardware_concurrency()
+	int thread_count = 0;
+};
+
+
+// vertex animation texture: one row per frame, one texel per rendering vertex (Geometry::getVertices) of the mesh
+struct VertexAnimation
+{
+	int vertex_count = 0;
+	int frame_count = 0;
+	double frame_rate = 0;
+	double start_time = 0;
+	// world space bounds of all frames, position = min + texel / 65535 * (max - min)
+	Vec3 min;
+	Vec3 max;
+	std::vector<Vec3> frame_min; // per frame bounds, for culling
+	std::vector<Vec3> frame_max;
+	std::vector<u16> positions; // RGBA16 texels, alpha is 65535
+	std::vector<u8> normals; // RGBA8 texels, normal = texel / 127.5 - 1, alpha is 255
+};
+
+
+// evaluates the first layer of the stack at every frame, applies animated blend shapes, skins the mesh
+// (or moves it rigidly if it has no skin) and quantizes world space positions and normals; frames are
+// evaluated in parallel; returns false and sets getError() if the mesh has no geometry or the range is empty
+bool bakeVertexAnimation(const Mesh& mesh,
+	const AnimationStack& stack,
+	const VertexAnimationSettings& settings,
+	VertexAnimation* animation);
+
+
+struct ChannelSampleSettings
+{
+	double start_time = 0;
+	double frame_rate = 30;
+	int frame_count = 0;
+	// 0 - std::thread::hardware_concurrency()
+	int thread_count = 0;
+};
+
+
+// channels of all curve nodes of the layer which are connected to a property, in the layer's order
+void getAnimationChannels(const AnimationLayer& layer, std::vector<AnimationChannel>* channels);
+// samples every frame into out, frame major: each frame holds the components of all channels in order;
+// frames are split into ranges sampled in parallel, times before 0 are clamped to 0;
+// returns the number of floats per frame
+int sampleChannels(const AnimationChannel* channels,
+	int channel_count,
+	const ChannelSampleSettings& settings,
+	std::vector<float>* out);
+
+
+struct ExportSettings
+{
+	enum Format
+	{
+		OBJ,
+		PLY // binary
+	};
+
+	Format format = OBJ;
+	// positions and normals transformed by getGlobalTransform() * getGeometricMatrix(), otherwise in geometry space
+	bool world_space = true;
+	// 0 - std::thread::hardware_concurrency()
+	int thread_count = 0;
+};
+
+
+// writes every mesh with its normals and first UV set into one file, meshes with mirroring transforms get flipped winding;
+// chunks of meshes are formatted in parallel and written in order, returns false and sets getError() on failure
+bool exportScene(const IScene& scene, const char* path, const ExportSettings& settings);
+// shortest text which reads back as the same float, at most 16 chars, returns their count
+int formatFloat(float value, char* out);
+
+
+struct ThumbnailSettings
+{
+	int width = 256;
+	int height = 256;
+	// each pixel averages supersampling x supersampling samples, 1 - 4
+	int supersampling = 2;
+	// meshes are posed with the first layer of the stack at time (seconds), or with the nodes' own transforms
+	const AnimationStack* stack = nullptr;
+	double time = 0;
+	// the camera orbits the center of the posed meshes' bounds, in degrees from the scene's front axis
+	// around its up axis and above the horizon; it's moved back until every vertex is in the view
+	double yaw = 30;
+	double pitch = 20;
+	double fov = 30; // vertical, in degrees
+	double margin = 0.05; // fraction of the width and height left empty on each side
+	Vec4 background = {0, 0, 0, 0}; // RGBA, 0 - 1
+	// 0 - std::thread::hardware_concurrency()
+	int thread_count = 0;
+};
+
+
+// renders all meshes with their materials' diffuse colors, two-sided, lit by a light from the camera's upper left
+// and a sky light along the scene's up axis; meshes are posed and projected in parallel, triangles are binned
+// into tiles which are rasterized in parallel; rgba gets width * height RGBA8 pixels, top row first;
+// returns false and sets getError() if the size is invalid or there is nothing to render
+bool renderThumbnail(const IScene& scene, const ThumbnailSettings& settings, std::vector<u8>* rgba);
+
+
+// second UV set for lightmaps: polygons are grouped into charts over manifold edges by their normals, each chart
+// is flattened with a least squares conformal map and the charts are packed into a square texture
+struct LightmapSettings
+{
+	int resolution = 1024; // texels on each side
+	int padding = 2; // texels between charts and around the border
+	// the most a polygon's normal may differ from its chart's average normal, in degrees
+	double max_chart_angle = 60;
+	// threads parsing geometries, charts of a geometry are parameterized on the threads left per geometry;
+	// 0 - std::thread::hardware_concurrency()
+	int thread_count = 0;
+};
+
+
+struct LoadSettings
+{
+	// skinned geometries are split into SkinPartitions using at most this many bones each (at least 12),
+	// 0 disables splitting
+	int bone_palette_size = 0;
+	// remove degenerate and duplicate triangles and unreferenced vertices while parsing geometries
+	bool clean_meshes = false;
+	// build Geometry::getAdjacency() from the polygons while parsing
+	bool adjacency = false;
+	// compute Geometry::getBoneBounds() for skinned geometries; a vertex counts for a cluster if the cluster has
+	// at least bone_bounds_min_weight of the vertex's total weight, or is its strongest influence
+	bool bone_bounds = false;
+	double bone_bounds_min_weight = 0.1;
+	// convert from the file's GlobalSettings to target_space while parsing: vertices, normals, tangents, shape deltas,
+	// cluster matrices and every matrix returned by evalLocal(), getGlobalTransform() and getGeometricMatrix();
+	// property values and animation curves stay in file space, evalLocal() converts the matrix built from them;
+	// mirroring conversions also flip triangle winding
+	bool convert_coordinates = false;
+	GlobalSettings target_space;
+	// deduplicate texture files by normalized path and find them: RelativeFilename in each of texture_search_paths,
+	// then FileName, then its file name alone in each search path (the current directory if there are none);
+	// file names match case-insensitively;
+	// search paths only need to be valid during load() and clone()
+	bool resolve_textures = false;
+	std::vector<const char*> texture_search_paths;
+	// read the found texture files on background threads, started before objects are parsed
+	bool prefetch_textures = false;
+	int texture_io_threads = 4;
+	// add a UV set named "Lightmap" after the geometries' own ones, its chart seams split rendering vertices
+	// like other UV seams
+	bool lightmap_uvs = false;
+	LightmapSettings lightmap;
+};
+
+
 IScene* load(const u8* data, int size);
+IScene* load(const u8* data, int size, const LoadSettings& settings);
+// loads files with load(), each file is loaded on one of thread_count threads (0 - hardware concurrency) as soon as
+// it's read while other reads are in flight; scenes has file_count elements, nullptr for files which failed to read
+// or load; returns false if any failed, getError() is then the error of the first failed file
+bool loadFiles(const char* const* paths,
+	int file_count,
+	const LoadSettings& settings,
+	const FileReadSettings& read_settings,
+	int thread_count,
+	IScene** scenes);
+// error of the last failed call on this thread
 const char* getError();
+// frees the memory the calling thread keeps for parsing temporaries between loads
+void releaseScratchMemory();
+
+
+// carries per-thread state of the application, e.g. memory accounting, over to the threads the library starts:
+// capture() runs on the thread starting a worker, its result is passed to enter() on the worker before it does
+// anything and to leave() when it's done; any of them may be null
+struct ThreadHooks
+{
+	void* (*capture)() = nullptr;
+	void (*enter)(void* context) = nullptr;
+	void (*leave)(void* context) = nullptr;
+};
+
+// not thread-safe, set the hooks before the library starts any threads
+void setThreadHooks(const ThreadHooks& hooks);
 
 
 } // namespace ofbx
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "ofbxImp.h"
+#include <algorithm>
+
+namespace ofbx
+{
+
+	struct AdjacencyBuilder
+	{
+		AdjacencyBuilder(const int* _control_points, int _control_point_count, Adjacency* _adjacency)
+			: control_points(_control_points)
+			, control_point_count(_control_point_count)
+			, adjacency(*_adjacency)
+		{
+		}
+
+
+		void initPolygons(const int* rendering_vertices, const int* starts, int polygon_count)
+		{
+			const int half_edge_count = starts[polygon_count];
+			adjacency.vertices.assign(rendering_vertices, rendering_vertices + half_edge_count);
+			adjacency.polygon_starts.assign(starts, starts + polygon_count + 1);
+			adjacency.polygons.resize(half_edge_count);
+			adjacency.triangle_polygons.clear();
+			for (int poly = 0; poly < polygon_count; ++poly)
+			{
+				for (int i = starts[poly]; i < starts[poly + 1]; ++i) adjacency.polygons[i] = poly;
+				for (int i = starts[poly] + 2; i < starts[poly + 1]; ++i) adjacency.triangle_polygons.push_back(poly);
+			}
+		}
+
+
+		// counting sort of the half edges by their lower control point, linear in the number of half edges
+		void bucketEdges()
+		{
+			const int half_edge_count = (int)adjacency.vertices.size();
+			bucket_starts.assign(control_point_count + 1, 0);
+			for (int i = 0; i < half_edge_count; ++i) ++bucket_starts[lower(i) + 1];
+			for (int i = 0; i < control_point_count; ++i) bucket_starts[i + 1] += bucket_starts[i];
+
+			std::vector<int> offsets(bucket_starts.begin(), bucket_starts.end() - 1);
+			sorted.resize(half_edge_count);
+			for (int i = 0; i < half_edge_count; ++i) sorted[offsets[lower(i)]++] = i;
+		}
+
+
+		int lower(int half_edge) const
+		{
+			return std::min(control_points[half_edge], control_points[adjacency.next(half_edge)]);
+		}
+
+
+		int upper(int half_edge) const
+		{
+			return std::max(control_points[half_edge], control_points[adjacency.next(half_edge)]);
+		}
+
+
+		// half edges in a bucket share the lower control point, runs with the same upper one are the same edge
+		int matchBuckets(int from, int to)
+		{
+			int non_manifold = 0;
+			for (int bucket = from; bucket < to; ++bucket)
+			{
+				int* begin = sorted.data() + bucket_starts[bucket];
+				int* end = sorted.data() + bucket_starts[bucket + 1];
+				std::sort(begin, end, [&](int a, int b) {
+					const int ua = upper(a);
+					const int ub = upper(b);
+					return ua < ub || (ua == ub && a < b);
+				});
+
+				for (int* run = begin; run != end;)
+				{
+					const int key = upper(*run);
+					int* run_end = run + 1;
+					while (run_end != end && upper(*run_end) == key) ++run_end;
+
+					const int a = run[0];
+					if (key == bucket)
+					{
+						// both ends on the same control point, no edge
+					}
+					else if (run_end - run == 2 && control_points[a] != control_points[run[1]])
+					{
+						adjacency.twins[a] = run[1];
+						adjacency.twins[run[1]] = a;
+					}
+					else if (run_end - run > 1)
+					{
+						++non_manifold;
+					}
+					run = run_end;
+				}
+			}
+			return non_manifold;
+		}
+
+
+		void run()
+		{
+			bucketEdges();
+			const int half_edge_count = (int)sorted.size();
+			adjacency.twins.assign(half_edge_count, -1);
+
+			// buckets are independent, ranges of them are matched in parallel on big meshes
+			const int MIN_JOB_SIZE = 64 * 1024;
+			const int job_count = std::max(1, std::min((int)std::thread::hardware_concurrency(), half_edge_count / MIN_JOB_SIZE));
+			std::vector<int> non_manifold(job_count, 0);
+			parallelFor(job_count, job_count, [&](int job) {
+				const int from = int((long long)control_point_count * job / job_count);
+				const int to = int((long long)control_point_count * (job + 1) / job_count);
+				non_manifold[job] = matchBuckets(from, to);
+			});
+			adjacency.non_manifold_edges = 0;
+			for (int count : non_manifold) adjacency.non_manifold_edges += count;
+		}
+
+
+		const int* control_points;
+		const int control_point_count;
+		Adjacency& adjacency;
+		std::vector<int> bucket_starts;
+		std::vector<int> sorted;
+	};
+
+
+	void buildAdjacency(const int* control_points,
+		const int* rendering_vertices,
+		const int* starts,
+		int polygon_count,
+		int control_point_count,
+		Adjacency* adjacency)
+	{
+		assert(adjacency);
+		AdjacencyBuilder builder(control_points, control_point_count, adjacency);
+		builder.initPolygons(rendering_vertices, starts, polygon_count);
+		builder.run();
+	}
+
+} // namespace ofbx
@@ -0,0 +1,428 @@
+#include "ofbxImp.h"
+#include <string>
+#include <unordered_set>
+
+namespace ofbx
+{
+
+	static bool isLongProperty(const Property* prop)
+	{
+		return prop && prop->getType() == IElementProperty::LONG;
+	}
+
+
+	static std::string getObjectName(const Element& element)
+	{
+		if (!element.first_property || !element.first_property->next) return std::string();
+		DataView name = element.first_property->next->value;
+		const u8* end = name.begin;
+		while (end != name.end && *end) ++end; // "name\0\1class"
+		return std::string((const char*)name.begin, end - name.begin);
+	}
+
+
+	// only what the animation library reads is tokenized: GlobalSettings, Connections and the models and animation
+	// objects in Objects; geometries, materials, embedded videos, definitions and takes are stepped over
+	static bool isAnimationElement(const Element& parent, const DataView& id)
+	{
+		if (!parent.id.begin) return id == "GlobalSettings" || id == "Objects" || id == "Connections";
+		if (parent.id == "Objects")
+		{
+			return id == "Model" || id == "AnimationStack" || id == "AnimationLayer" || id == "AnimationCurveNode" ||
+				   id == "AnimationCurve";
+		}
+		// these are identified by their properties and connections only
+		return !(parent.id == "Model" || parent.id == "AnimationStack" || parent.id == "AnimationLayer" ||
+				 parent.id == "AnimationCurveNode");
+	}
+
+
+	struct AnimationFileParser
+	{
+		struct CurveNode
+		{
+			const Element* element = nullptr;
+			u64 layer = 0;
+			u64 target = 0;
+			DataView property;
+			const Element* curves[3] = {nullptr, nullptr, nullptr};
+		};
+
+		struct LayerConnection
+		{
+			u64 layer;
+			u64 stack;
+		};
+
+		struct Model
+		{
+			std::string name;
+			u64 parent = 0;
+		};
+
+
+		AnimationFileParser(const std::unordered_map<std::string, int>& _bones, bool _match_by_path, const GlobalSettings* _target_space)
+			: bones(_bones)
+			, match_by_path(_match_by_path)
+			, target_space(_target_space)
+		{
+		}
+
+
+		void parseObjects(const Element& objects)
+		{
+			for (const Element* object = objects.child; object; object = object->sibling)
+			{
+				if (!isLongProperty(object->first_property)) continue;
+				const u64 id = object->first_property->value.toLong();
+
+				if (object->id == "Model")
+				{
+					models[id].name = getObjectName(*object);
+				}
+				else if (object->id == "AnimationStack")
+				{
+					stacks.push_back(object);
+				}
+				else if (object->id == "AnimationLayer")
+				{
+					layers.insert(id);
+				}
+				else if (object->id == "AnimationCurveNode")
+				{
+					curve_nodes[id].element = object;
+					curve_node_order.push_back(id);
+				}
+				else if (object->id == "AnimationCurve")
+				{
+					curves[id] = object;
+				}
+			}
+		}
+
+
+		void parseConnections(const Element& connections)
+		{
+			for (const Element* connection = connections.child; connection; connection = connection->sibling)
+			{
+				const Property* type = connection->first_property;
+				if (!type || !isLongProperty(type->next) || !isLongProperty(type->next->next)) continue;
+
+				const u64 from = type->next->value.toLong();
+				const u64 to = type->next->next->value.toLong();
+				const Property* property = type->next->next->next;
+
+				auto curve_node = curve_nodes.find(from);
+				if (curve_node != curve_nodes.end())
+				{
+					if (layers.find(to) != layers.end())
+					{
+						curve_node->second.layer = to;
+					}
+					else if (property && models.find(to) != models.end())
+					{
+						curve_node->second.target = to;
+						curve_node->second.property = property->value;
+					}
+					continue;
+				}
+
+				auto curve = curves.find(from);
+				if (curve != curves.end())
+				{
+					auto target = curve_nodes.find(to);
+					if (target == curve_nodes.end()) continue;
+
+					int component = -1;
+					if (property && property->value == "d|X") component = 0;
+					else if (property && property->value == "d|Y") component = 1;
+					else if (property && property->value == "d|Z") component = 2;
+					else
+					{
+						for (int i = 2; i >= 0; --i)
+						{
+							if (!target->second.curves[i]) component = i;
+						}
+					}
+					if (component >= 0) target->second.curves[component] = curve->second;
+					continue;
+				}
+
+				if (layers.find(from) != layers.end())
+				{
+					layer_connections.push_back({from, to});
+					continue;
+				}
+
+				auto model = models.find(from);
+				if (model != models.end() && to != 0 && models.find(to) != models.end())
+				{
+					model->second.parent = to;
+				}
+			}
+		}
+
+
+		std::string getPath(u64 model_id) const
+		{
+			std::string path;
+			for (auto iter = models.find(model_id); iter != models.end(); iter = models.find(iter->second.parent))
+			{
+				path = path.empty() ? iter->second.name : iter->second.name + "/" + path;
+				if (iter->second.parent == 0) break;
+			}
+			return path;
+		}
+
+
+		int getBone(u64 model_id) const
+		{
+			auto model = models.find(model_id);
+			if (model == models.end()) return -1;
+
+			auto iter = bones.find(match_by_path ? getPath(model_id) : model->second.name);
+			return iter == bones.end() ? -1 : iter->second;
+		}
+
+
+		static bool parseCurve(const Element* element, AnimationClip::Curve* curve)
+		{
+			if (!element) return true;
+
+			const Element* times = findChild(*element, "KeyTime");
+			const Element* values = findChild(*element, "KeyValueFloat");
+			if (!times || !times->first_property || !values || !values->first_property)
+			{
+				Error::s_message = "Animation curve without KeyTime or KeyValueFloat";
+				return false;
+			}
+
+			curve->times.resize(times->first_property->getCount());
+			curve->values.resize(values->first_property->getCount());
+			if (curve->times.size() != curve->values.size())
+			{
+				Error::s_message = "Animation curve key count mismatch";
+				return false;
+			}
+			if (curve->times.empty()) return true;
+
+			if (!times->first_property->getValues(&curve->times[0], int(curve->times.size() * sizeof(curve->times[0]))) ||
+				!values->first_property->getValues(&curve->values[0], int(curve->values.size() * sizeof(curve->values[0]))))
+			{
+				Error::s_message = "Invalid animation curve keys";
+				return false;
+			}
+			return true;
+		}
+
+
+		// the axes part of the conversion is a signed permutation, so each converted component is one scaled source curve
+		void convertTranslation(AnimationClip::Track* track) const
+		{
+			AnimationClip::Curve converted[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				for (int j = 0; j < 3; ++j)
+				{
+					const double factor = conversion.matrix.m[j * 4 + i];
+					if (factor == 0) continue;
+
+					converted[i] = std::move(track->curves[j]);
+					for (float& value : converted[i].values) value = float(value * factor);
+				}
+			}
+			for (int i = 0; i < 3; ++i) track->curves[i] = std::move(converted[i]);
+		}
+
+
+		bool buildClip(const Element& stack, int file, std::vector<AnimationClip>* clips)
+		{
+			const u64 stack_id = stack.first_property->value.toLong();
+
+			// same as AnimationStack::getLayer(0), the first layer connected to the stack
+			u64 layer_id = 0;
+			for (const LayerConnection& connection : layer_connections)
+			{
+				if (connection.stack == stack_id)
+				{
+					layer_id = connection.layer;
+					break;
+				}
+			}
+			if (layer_id == 0) return true;
+
+			clips->emplace_back();
+			AnimationClip& clip = clips->back();
+			clip.file = file;
+			copyString(clip.name, getObjectName(stack).c_str());
+
+			for (u64 curve_node_id : curve_node_order)
+			{
+				const CurveNode& node = curve_nodes[curve_node_id];
+				if (node.layer != layer_id || node.target == 0) continue;
+
+				AnimationClip::Track::Channel channel;
+				if (node.property == "Lcl Translation") channel = AnimationClip::Track::TRANSLATION;
+				else if (node.property == "Lcl Rotation") channel = AnimationClip::Track::ROTATION;
+				else if (node.property == "Lcl Scaling") channel = AnimationClip::Track::SCALING;
+				else continue;
+
+				const int bone = getBone(node.target);
+				if (bone < 0) continue;
+
+				clip.tracks.emplace_back();
+				AnimationClip::Track& track = clip.tracks.back();
+				track.bone = bone;
+				track.channel = channel;
+				for (int i = 0; i < 3; ++i)
+				{
+					if (!parseCurve(node.curves[i], &track.curves[i])) return false;
+				}
+				if (channel == AnimationClip::Track::TRANSLATION && conversion.enabled) convertTranslation(&track);
+			}
+			return true;
+		}
+
+
+		bool parse(const u8* data, int size, int file, std::vector<AnimationClip>* clips)
+		{
+			Error::s_message = "Invalid FBX file"; // the tokenizer does not name every failure
+			OptionalError<Element*> root = tokenize(data, size, &isAnimationElement);
+			if (root.isError()) return false;
+			std::unique_ptr<Element, void (*)(Element*)> root_guard(root.getValue(), &deleteElement);
+
+			const Element* objects = findChild(*root.getValue(), "Objects");
+			const Element* connections = findChild(*root.getValue(), "Connections");
+			if (!objects) return true;
+
+			if (target_space) conversion.init(parseGlobalSettings(*root.getValue()), *target_space);
+			parseObjects(*objects);
+			if (connections) parseConnections(*connections);
+
+			for (const Element* stack : stacks)
+			{
+				if (!buildClip(*stack, file, clips)) return false;
+			}
+			return true;
+		}
+
+
+		const std::unordered_map<std::string, int>& bones;
+		const bool match_by_path;
+		const GlobalSettings* target_space; // null if the skeleton's scene is not converted
+		Scene::Conversion conversion;
+		std::unordered_map<u64, Model> models;
+		std::unordered_map<u64, CurveNode> curve_nodes;
+		std::vector<u64> curve_node_order;
+		std::unordered_map<u64, const Element*> curves;
+		std::unordered_set<u64> layers;
+		std::vector<LayerConnection> layer_connections; // in file order
+		std::vector<const Element*> stacks;
+	};
+
+
+	static std::string getNodePath(const Object& node)
+	{
+		std::string path = node.name;
+		for (const Object* parent = node.getParent(); parent && parent->getType() != Object::Type::ROOT;
+			 parent = parent->getParent())
+		{
+			path = std::string(parent->name) + "/" + path;
+		}
+		return path;
+	}
+
+
+	static std::unordered_map<std::string, int> getBoneMap(const Skeleton& skeleton, bool match_by_path)
+	{
+		std::unordered_map<std::string, int> bones;
+		for (int i = 0, c = (int)skeleton.bones.size(); i < c; ++i)
+		{
+			const Object& node = *skeleton.bones[i].node;
+			bones.insert({match_by_path ? getNodePath(node) : std::string(node.name), i});
+		}
+		return bones;
+	}
+
+
+	static const GlobalSettings* getTargetSpace(const Skeleton& skeleton)
+	{
+		if (skeleton.bones.empty()) return nullptr;
+		const Scene& scene = (const Scene&)skeleton.bones[0].node->getScene();
+		return scene.m_settings.convert_coordinates ? &scene.m_settings.target_space : nullptr;
+	}
+
+
+	// Error::s_message is per thread, so workers record their errors and the first one in file order is published
+	// on the calling thread
+	static bool appendClips(std::vector<std::vector<AnimationClip>>& file_clips,
+		const std::vector<std::string>& errors,
+		std::vector<AnimationClip>* clips)
+	{
+		static thread_local std::string s_error;
+		bool all_loaded = true;
+		for (int i = 0, c = (int)file_clips.size(); i < c; ++i)
+		{
+			if (all_loaded && !errors[i].empty())
+			{
+				all_loaded = false;
+				s_error = errors[i];
+				Error::s_message = s_error.c_str();
+			}
+			for (AnimationClip& clip : file_clips[i]) clips->push_back(std::move(clip));
+		}
+		return all_loaded;
+	}
+
+
+	bool loadAnimationLibrary(const Skeleton& skeleton,
+		const u8* const* files,
+		const int* sizes,
+		int file_count,
+		const AnimationLibrarySettings& settings,
+		std::vector<AnimationClip>* clips)
+	{
+		assert(clips);
+
+		const std::unordered_map<std::string, int> bones = getBoneMap(skeleton, settings.match_by_path);
+		const GlobalSettings* target_space = getTargetSpace(skeleton);
+		std::vector<std::vector<AnimationClip>> file_clips(file_count);
+		std::vector<std::string> errors(file_count);
+		parallelFor(file_count, settings.thread_count, [&](int i) {
+			AnimationFileParser parser(bones, settings.match_by_path, target_space);
+			if (parser.parse(files[i], sizes[i], i, &file_clips[i])) return;
+			errors[i] = Error::s_message;
+			file_clips[i].clear();
+		});
+		return appendClips(file_clips, errors, clips);
+	}
+
+
+	bool loadAnimationLibrary(const Skeleton& skeleton,
+		const char* const* paths,
+		int file_count,
+		const AnimationLibrarySettings& settings,
+		const FileReadSettings& read_settings,
+		std::vector<AnimationClip>* clips)
+	{
+		assert(clips);
+
+		const std::unordered_map<std::string, int> bones = getBoneMap(skeleton, settings.match_by_path);
+		const GlobalSettings* target_space = getTargetSpace(skeleton);
+		std::vector<std::vector<AnimationClip>> file_clips(file_count);
+		std::vector<std::string> errors(file_count);
+		forEachFile(paths, file_count, read_settings, settings.thread_count, [&](int i, std::vector<u8>& data, bool ok) {
+			if (!ok)
+			{
+				errors[i] = std::string("Failed to read ") + paths[i];
+				return;
+			}
+			AnimationFileParser parser(bones, settings.match_by_path, target_space);
+			if (parser.parse(data.data(), (int)data.size(), i, &file_clips[i])) return;
+			errors[i] = std::string(paths[i]) + ": " + Error::s_message;
+			file_clips[i].clear();
+		});
+		return appendClips(file_clips, errors, clips);
+	}
+
+} // namespace ofbx
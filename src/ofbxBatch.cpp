@@ -0,0 +1,208 @@
+#include "ofbxImp.h"
+
+namespace ofbx
+{
+
+	struct BatchBuilder
+	{
+		BatchBuilder(const BatchSettings& _settings, std::vector<MeshBatch>* _batches)
+			: settings(_settings)
+			, batches(_batches)
+		{
+		}
+
+
+		MeshBatch* getBatch(const Material* material)
+		{
+			auto iter = open_batches.find(material);
+			if (iter != open_batches.end()) return &(*batches)[iter->second];
+
+			return newBatch(material);
+		}
+
+
+		MeshBatch* newBatch(const Material* material)
+		{
+			open_batches[material] = (int)batches->size();
+			batches->emplace_back();
+			batches->back().material = material;
+			return &batches->back();
+		}
+
+
+		template <typename T>
+		static void appendStream(std::vector<T>* out, const std::vector<T>& src, const std::vector<int>& vertices, size_t first)
+		{
+			out->resize(first);
+			if (src.empty())
+			{
+				out->resize(first + vertices.size(), T());
+				return;
+			}
+			for (int v : vertices) out->push_back(src[v]);
+		}
+
+
+		template <typename T>
+		static void appendLayers(std::vector<std::vector<T>>* out,
+			int layer_count,
+			const std::vector<T>& (Geometry::*getter)(int) const,
+			const Geometry& geom,
+			const std::vector<int>& vertices,
+			size_t first)
+		{
+			if ((int)out->size() < layer_count) out->resize(layer_count);
+			for (int i = 0; i < (int)out->size(); ++i)
+			{
+				static const std::vector<T> empty;
+				appendStream(&(*out)[i], i < layer_count ? (geom.*getter)(i) : empty, vertices, first);
+			}
+		}
+
+
+		// copies the vertices referenced by the range into the batch and bakes the transform
+		void finishRange(MeshBatch* batch, const Mesh& mesh, const Geometry& geom)
+		{
+			if (range_vertices.empty()) return;
+
+			MeshBatch::Range range;
+			range.mesh = &mesh;
+			range.first_vertex = (int)batch->vertices.size();
+			range.vertex_count = (int)range_vertices.size();
+			range.first_index = first_index;
+			range.index_count = (int)batch->indices.size() - first_index;
+
+			const size_t first = range.first_vertex;
+			appendStream(&batch->vertices, geom.getVertices(), range_vertices, first);
+			if (!geom.getNormals().empty() || !batch->normals.empty())
+				appendStream(&batch->normals, geom.getNormals(), range_vertices, first);
+			if (!geom.getTangents().empty() || !batch->tangents.empty())
+				appendStream(&batch->tangents, geom.getTangents(), range_vertices, first);
+			appendLayers(&batch->uvs, geom.getUVSetCount(), &Geometry::getUVs, geom, range_vertices, first);
+			appendLayers(&batch->colors, geom.getColorSetCount(), &Geometry::getColors, geom, range_vertices, first);
+
+			if (settings.pre_transform)
+			{
+				transformPoints(world, &batch->vertices[first], range.vertex_count);
+				if (!batch->normals.empty())
+					transformVectors(normal_matrix, &batch->normals[first], range.vertex_count, true);
+				if (!batch->tangents.empty())
+					transformVectors(world, &batch->tangents[first], range.vertex_count, true);
+			}
+
+			for (int v : range_vertices) local[v] = -1;
+			range_vertices.clear();
+			batch->ranges.push_back(range);
+		}
+
+
+		// subset lists the triangles to add, all triangles of the mesh are added if it's null
+		void addMesh(const Mesh& mesh, const std::vector<int>* subset)
+		{
+			const Geometry& geom = *mesh.getGeometry();
+			const std::vector<int>& triangles = geom.getTriangles();
+			const int* materials = geom.getMaterials();
+			const int tri_count = subset ? (int)subset->size() : (int)geom.getTriangleCount();
+			if (tri_count == 0) return;
+
+			world = mesh.getGlobalTransform() * mesh.getGeometricMatrix();
+			normal_matrix = getNormalMatrix(world);
+			const bool flip_winding = settings.pre_transform && getDeterminant3x3(world) < 0;
+
+			local.assign(geom.getVertices().size(), -1);
+			const int material_count = mesh.getMaterialCount();
+			const int max_material = materials && material_count > 1 ? material_count : 1;
+			for (int material_idx = 0; material_idx < max_material; ++material_idx)
+			{
+				const Material* material = material_idx < material_count ? mesh.getMaterial(material_idx) : nullptr;
+				MeshBatch* batch = nullptr;
+				for (int j = 0; j < tri_count; ++j)
+				{
+					const int tri = subset ? (*subset)[j] : j;
+					int tri_material = materials ? materials[tri] : 0;
+					if (tri_material != material_idx && (material_idx != 0 || (tri_material >= 0 && tri_material < material_count)))
+					{
+						continue;
+					}
+
+					if (!batch)
+					{
+						batch = getBatch(material);
+						first_index = (int)batch->indices.size();
+					}
+
+					int new_vertices = 0;
+					for (int i = 0; i < 3; ++i) new_vertices += local[triangles[tri * 3 + i]] < 0 ? 1 : 0;
+					const int vertex_count = (int)(batch->vertices.size() + range_vertices.size());
+					if (vertex_count + new_vertices > settings.max_vertices ||
+						(int)batch->indices.size() + 3 > settings.max_indices)
+					{
+						finishRange(batch, mesh, geom);
+						batch = newBatch(material);
+						first_index = 0;
+					}
+
+					const int first_vertex = (int)batch->vertices.size();
+					for (int i = 0; i < 3; ++i)
+					{
+						int v = triangles[tri * 3 + (flip_winding && i > 0 ? 3 - i : i)];
+						if (local[v] < 0)
+						{
+							local[v] = (int)range_vertices.size();
+							range_vertices.push_back(v);
+						}
+						batch->indices.push_back(first_vertex + local[v]);
+					}
+				}
+				if (batch) finishRange(batch, mesh, geom);
+			}
+		}
+
+
+		const BatchSettings& settings;
+		std::vector<MeshBatch>* batches;
+		std::unordered_map<const Material*, int> open_batches;
+		std::vector<int> local;
+		std::vector<int> range_vertices;
+		int first_index = 0;
+		Matrix world;
+		Matrix normal_matrix;
+	};
+
+
+	static bool isStatic(const Mesh& mesh)
+	{
+		const Geometry* geom = mesh.getGeometry();
+		return geom && !geom->getSkin() && !geom->getBlendShape();
+	}
+
+
+	void batchStaticMeshes(const IScene& scene, const BatchSettings& settings, std::vector<MeshBatch>* batches)
+	{
+		assert(batches);
+		assert(settings.max_vertices >= 3 && settings.max_indices >= 3);
+
+		batches->clear();
+		BatchBuilder builder(settings, batches);
+		for (int i = 0, c = scene.getMeshCount(); i < c; ++i)
+		{
+			const Mesh& mesh = *scene.getMesh(i);
+			if (isStatic(mesh)) builder.addMesh(mesh, nullptr);
+		}
+	}
+
+
+	void batchMeshParts(const std::vector<SceneCell::Part>& parts, const BatchSettings& settings, std::vector<MeshBatch>* batches)
+	{
+		assert(batches);
+		assert(settings.max_vertices >= 3 && settings.max_indices >= 3);
+
+		batches->clear();
+		BatchBuilder builder(settings, batches);
+		for (const SceneCell::Part& part : parts)
+		{
+			if (isStatic(*part.mesh)) builder.addMesh(*part.mesh, part.triangles.empty() ? nullptr : &part.triangles);
+		}
+	}
+
+} // namespace ofbx
@@ -0,0 +1,55 @@
+#include "ofbxImp.h"
+#include <algorithm>
+
+namespace ofbx
+{
+
+	void getAnimationChannels(const AnimationLayer& layer, std::vector<AnimationChannel>* channels)
+	{
+		assert(channels);
+		channels->clear();
+		for (int i = 0, c = layer.getCurveNodeCount(); i < c; ++i)
+		{
+			const AnimationChannel channel = layer.getCurveNode(i)->getChannel();
+			if (channel.target) channels->push_back(channel);
+		}
+	}
+
+
+	int sampleChannels(const AnimationChannel* channels,
+		int channel_count,
+		const ChannelSampleSettings& settings,
+		std::vector<float>* out)
+	{
+		assert(out);
+		std::vector<int> offsets(channel_count);
+		int stride = 0;
+		for (int i = 0; i < channel_count; ++i)
+		{
+			offsets[i] = stride;
+			stride += channels[i].getComponentCount();
+		}
+
+		const int frame_count = std::max(settings.frame_count, 0);
+		out->resize((size_t)frame_count * stride);
+		if (frame_count == 0 || stride == 0) return stride;
+
+		// contiguous chunks of frames, so that jobs write separate parts of out and each channel
+		// walks its keys forward within a chunk
+		const int MIN_JOB_FRAMES = 256;
+		int job_count = settings.thread_count > 0 ? settings.thread_count : (int)std::thread::hardware_concurrency();
+		job_count = std::max(1, std::min(job_count, frame_count / MIN_JOB_FRAMES));
+		const double frame_time = settings.frame_rate > 0 ? 1 / settings.frame_rate : 0;
+		parallelFor(job_count, job_count, [&](int job) {
+			const int from = int((long long)frame_count * job / job_count);
+			const int to = int((long long)frame_count * (job + 1) / job_count);
+			float* frames = out->data() + (size_t)from * stride;
+			for (int i = 0; i < channel_count; ++i)
+			{
+				channels[i].node->sample(settings.start_time + from * frame_time, frame_time, to - from, stride, frames + offsets[i]);
+			}
+		});
+		return stride;
+	}
+
+} // namespace ofbx
@@ -0,0 +1,181 @@
+#include "ofbxImp.h"
+#include <unordered_set>
+
+namespace ofbx
+{
+
+	struct GeometryCleaner
+	{
+		// triangle rotated so the smallest index comes first, winding is kept
+		struct TriangleKey
+		{
+			int v[3];
+			int material;
+
+			bool operator==(const TriangleKey& rhs) const
+			{
+				return v[0] == rhs.v[0] && v[1] == rhs.v[1] && v[2] == rhs.v[2] && material == rhs.material;
+			}
+		};
+
+		struct TriangleKeyHash
+		{
+			size_t operator()(const TriangleKey& key) const
+			{
+				size_t h = (size_t)key.material;
+				for (int i = 0; i < 3; ++i) h = h * 31 + (size_t)key.v[i];
+				return h;
+			}
+		};
+
+
+		explicit GeometryCleaner(GeometryImpl::Data* _data)
+			: data(*_data)
+		{
+		}
+
+
+		bool isDegenerate(int a, int b, int c) const
+		{
+			const std::vector<int>& to_old = data.to_old_vertices;
+			if (to_old[a] == to_old[b] || to_old[b] == to_old[c] || to_old[a] == to_old[c]) return true;
+
+			const Vec3& pa = data.vertices[a];
+			const Vec3& pb = data.vertices[b];
+			const Vec3& pc = data.vertices[c];
+			const Vec3 ab = {pb.x - pa.x, pb.y - pa.y, pb.z - pa.z};
+			const Vec3 ac = {pc.x - pa.x, pc.y - pa.y, pc.z - pa.z};
+			const Vec3 n = {ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x};
+			// squared sine of the angle at a, relative so it does not depend on the mesh scale
+			const double cross_sq = n.x * n.x + n.y * n.y + n.z * n.z;
+			const double len_sq = (ab.x * ab.x + ab.y * ab.y + ab.z * ab.z) * (ac.x * ac.x + ac.y * ac.y + ac.z * ac.z);
+			return cross_sq <= len_sq * 1e-12;
+		}
+
+
+		void removeTriangles()
+		{
+			std::vector<int>& triangles = data.triangles;
+			std::vector<int>& materials = data.materials;
+			std::vector<int>& triangle_polygons = data.adjacency.triangle_polygons;
+			const int tri_count = (int)triangles.size() / 3;
+			const bool has_materials = (int)materials.size() >= tri_count;
+			const bool has_polygons = (int)triangle_polygons.size() >= tri_count;
+
+			std::unordered_set<TriangleKey, TriangleKeyHash> seen;
+			seen.reserve(tri_count);
+			int kept = 0;
+			for (int tri = 0; tri < tri_count; ++tri)
+			{
+				const int* v = &triangles[tri * 3];
+				if (isDegenerate(v[0], v[1], v[2]))
+				{
+					++data.cleanup_report.degenerate_triangles;
+					continue;
+				}
+
+				const int first = v[0] < v[1] ? (v[0] < v[2] ? 0 : 2) : (v[1] < v[2] ? 1 : 2);
+				const int material = has_materials ? materials[tri] : 0;
+				const TriangleKey key = {{v[first], v[(first + 1) % 3], v[(first + 2) % 3]}, material};
+				if (!seen.insert(key).second)
+				{
+					++data.cleanup_report.duplicate_triangles;
+					continue;
+				}
+
+				for (int i = 0; i < 3; ++i) triangles[kept * 3 + i] = v[i];
+				if (has_materials) materials[kept] = material;
+				if (has_polygons) triangle_polygons[kept] = triangle_polygons[tri];
+				++kept;
+			}
+			triangles.resize(kept * 3);
+			if (has_materials) materials.resize(kept);
+			if (has_polygons) triangle_polygons.resize(kept);
+		}
+
+
+		template <typename T>
+		void compact(std::vector<T>* stream) const
+		{
+			if (stream->size() != remap.size()) return;
+			for (int i = 0, c = (int)remap.size(); i < c; ++i)
+			{
+				if (remap[i] >= 0) (*stream)[remap[i]] = (*stream)[i];
+			}
+			stream->resize(new_vertex_count);
+			stream->shrink_to_fit();
+		}
+
+
+		// keeps the original order, so control points stay in front of the vertices split from them
+		void removeVertices()
+		{
+			const int vertex_count = (int)data.vertices.size();
+			remap.assign(vertex_count, -1);
+			for (int v : data.triangles) remap[v] = 0;
+			new_vertex_count = 0;
+			for (int& r : remap)
+			{
+				if (r == 0) r = new_vertex_count++;
+			}
+			data.cleanup_report.unused_vertices = vertex_count - new_vertex_count;
+			if (new_vertex_count == vertex_count) return;
+
+			for (int& v : data.triangles) v = remap[v];
+			for (int& v : data.adjacency.vertices) v = remap[v];
+
+			compact(&data.normals);
+			compact(&data.tangents);
+			for (GeometryImpl::VertexLayer<Vec2>& layer : data.uvs) compact(&layer.data);
+			for (GeometryImpl::VertexLayer<Vec4>& layer : data.colors) compact(&layer.data);
+			compact(&data.to_old_vertices);
+			compact(&data.vertices);
+
+			// control points without any vertex left keep a single node with index -1
+			std::vector<GeometryImpl::NewVertex> to_new(data.to_new_vertices.size());
+			std::vector<GeometryImpl::NewVertex*> tails(to_new.size(), nullptr);
+			for (int i = 0; i < new_vertex_count; ++i)
+			{
+				const int old = data.to_old_vertices[i];
+				GeometryImpl::NewVertex* tail = tails[old];
+				if (tail)
+				{
+					tail->next = new GeometryImpl::NewVertex;
+					tail = tail->next;
+				}
+				else
+				{
+					tail = &to_new[old];
+				}
+				tail->index = i;
+				tails[old] = tail;
+			}
+			data.to_new_vertices.swap(to_new);
+		}
+
+
+		void run()
+		{
+			data.cleanup_report = {};
+			removeTriangles();
+			removeVertices();
+			data.triangles.shrink_to_fit();
+			data.materials.shrink_to_fit();
+			data.adjacency.triangle_polygons.shrink_to_fit();
+		}
+
+
+		GeometryImpl::Data& data;
+		std::vector<int> remap;
+		int new_vertex_count = 0;
+	};
+
+
+	void cleanupGeometry(GeometryImpl::Data* data)
+	{
+		assert(data);
+		GeometryCleaner cleaner(data);
+		cleaner.run();
+	}
+
+} // namespace ofbx
@@ -0,0 +1,585 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace ofbx
+{
+
+	static Vec3 sub(const Vec3& a, const Vec3& b)
+	{
+		return {a.x - b.x, a.y - b.y, a.z - b.z};
+	}
+
+
+	static Vec3 cross(const Vec3& a, const Vec3& b)
+	{
+		return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+	}
+
+
+	static double dot(const Vec3& a, const Vec3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+
+	struct QuickHull
+	{
+		struct Face
+		{
+			int v[3];
+			Vec3 normal;
+			double offset;
+			std::vector<int> outside; // points above the face, assigned to the face they are farthest from
+			bool removed;
+		};
+
+
+		QuickHull(const std::vector<Vec3>& _points, int _max_vertices)
+			: points(_points)
+			, max_vertices(std::max(4, _max_vertices))
+		{
+		}
+
+
+		static u64 edgeKey(int a, int b) { return ((u64)a << 32) | (u32)b; }
+
+
+		double distance(const Face& face, int point) const { return dot(face.normal, points[point]) - face.offset; }
+
+
+		void addFace(int a, int b, int c)
+		{
+			faces.emplace_back();
+			Face& face = faces.back();
+			face.v[0] = a;
+			face.v[1] = b;
+			face.v[2] = c;
+			Vec3 n = cross(sub(points[b], points[a]), sub(points[c], points[a]));
+			const double len = sqrt(dot(n, n));
+			if (len > 0) n = {n.x / len, n.y / len, n.z / len};
+			face.normal = n;
+			face.offset = dot(n, points[a]);
+			face.removed = false;
+
+			const int face_idx = (int)faces.size() - 1;
+			edge_faces[edgeKey(a, b)] = face_idx;
+			edge_faces[edgeKey(b, c)] = face_idx;
+			edge_faces[edgeKey(c, a)] = face_idx;
+		}
+
+
+		void removeEdges(int face_idx)
+		{
+			const Face& face = faces[face_idx];
+			for (int j = 0; j < 3; ++j)
+			{
+				auto iter = edge_faces.find(edgeKey(face.v[j], face.v[(j + 1) % 3]));
+				if (iter != edge_faces.end() && iter->second == face_idx) edge_faces.erase(iter);
+			}
+		}
+
+
+		void assign(const std::vector<int>& candidates, int first_face)
+		{
+			for (int point : candidates)
+			{
+				int best = -1;
+				double best_distance = eps;
+				for (int i = first_face, c = (int)faces.size(); i < c; ++i)
+				{
+					if (faces[i].removed) continue;
+					const double d = distance(faces[i], point);
+					if (d > best_distance)
+					{
+						best = i;
+						best_distance = d;
+					}
+				}
+				if (best >= 0) faces[best].outside.push_back(point);
+			}
+			// in index order, so the oldest face with outside points is processed first
+			for (int i = first_face, c = (int)faces.size(); i < c; ++i)
+			{
+				if (!faces[i].outside.empty()) pending.push_back(i);
+			}
+		}
+
+
+		bool initSimplex(int* simplex)
+		{
+			const int count = (int)points.size();
+			int extremes[6] = {0, 0, 0, 0, 0, 0};
+			for (int i = 1; i < count; ++i)
+			{
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					if ((&points[i].x)[axis] < (&points[extremes[axis * 2]].x)[axis]) extremes[axis * 2] = i;
+					if ((&points[i].x)[axis] > (&points[extremes[axis * 2 + 1]].x)[axis]) extremes[axis * 2 + 1] = i;
+				}
+			}
+
+			int a = 0, b = 0;
+			double max_distance = 0;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const Vec3 d = sub(points[extremes[axis * 2 + 1]], points[extremes[axis * 2]]);
+				if (dot(d, d) > max_distance)
+				{
+					max_distance = dot(d, d);
+					a = extremes[axis * 2];
+					b = extremes[axis * 2 + 1];
+				}
+			}
+			if (sqrt(max_distance) <= eps) return false;
+
+			const Vec3 ab = sub(points[b], points[a]);
+			int c = -1;
+			max_distance = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				const Vec3 n = cross(ab, sub(points[i], points[a]));
+				if (dot(n, n) > max_distance)
+				{
+					max_distance = dot(n, n);
+					c = i;
+				}
+			}
+			if (c < 0 || sqrt(max_distance) / sqrt(dot(ab, ab)) <= eps) return false;
+
+			Vec3 n = cross(ab, sub(points[c], points[a]));
+			const double len = sqrt(dot(n, n));
+			n = {n.x / len, n.y / len, n.z / len};
+			int d = -1;
+			max_distance = eps;
+			for (int i = 0; i < count; ++i)
+			{
+				const double dist = fabs(dot(n, sub(points[i], points[a])));
+				if (dist > max_distance)
+				{
+					max_distance = dist;
+					d = i;
+				}
+			}
+			if (d < 0) return false;
+
+			// d has to be below abc
+			if (dot(n, sub(points[d], points[a])) > 0) std::swap(b, c);
+			addFace(a, b, c);
+			addFace(a, d, b);
+			addFace(b, d, c);
+			addFace(a, c, d);
+			simplex[0] = a;
+			simplex[1] = b;
+			simplex[2] = c;
+			simplex[3] = d;
+			return true;
+		}
+
+
+		void addPoint(int face_idx)
+		{
+			const Face& face = faces[face_idx];
+			int eye = face.outside[0];
+			for (int point : face.outside)
+			{
+				if (distance(face, point) > distance(face, eye)) eye = point;
+			}
+
+			// faces visible from the eye point are replaced by a fan connecting their silhouette to it;
+			// the visible region is grown from the face over shared edges so it stays connected despite rounding
+			std::vector<int> orphans;
+			std::vector<u64> horizon;
+			std::vector<int> stack;
+			std::vector<int> visible;
+			stack.push_back(face_idx);
+			faces[face_idx].removed = true;
+			while (!stack.empty())
+			{
+				visible.push_back(stack.back());
+				Face& f = faces[stack.back()];
+				stack.pop_back();
+				for (int point : f.outside)
+				{
+					if (point != eye) orphans.push_back(point);
+				}
+				f.outside.clear();
+
+				for (int j = 0; j < 3; ++j)
+				{
+					const int a = f.v[j];
+					const int b = f.v[(j + 1) % 3];
+					auto neighbor = edge_faces.find(edgeKey(b, a));
+					if (neighbor == edge_faces.end()) continue;
+					Face& n = faces[neighbor->second];
+					if (n.removed) continue;
+					if (distance(n, eye) > eps)
+					{
+						n.removed = true;
+						stack.push_back(neighbor->second);
+					}
+					else
+					{
+						horizon.push_back(edgeKey(a, b));
+					}
+				}
+			}
+
+			for (int i : visible) removeEdges(i);
+			const int first_new = (int)faces.size();
+			for (u64 edge : horizon) addFace(int(edge >> 32), int(edge & 0xffffFFFF), eye);
+			assign(orphans, first_new);
+		}
+
+
+		bool build(ConvexHull* hull, double* volume)
+		{
+			if (points.size() < 4) return false;
+
+			double scale = 0;
+			for (const Vec3& p : points) scale = std::max(scale, std::max(fabs(p.x), std::max(fabs(p.y), fabs(p.z))));
+			eps = scale * 1e-10;
+
+			int simplex[4];
+			if (!initSimplex(simplex)) return false;
+
+			std::vector<int> candidates;
+			candidates.reserve(points.size());
+			for (int i = 0, c = (int)points.size(); i < c; ++i)
+			{
+				if (i != simplex[0] && i != simplex[1] && i != simplex[2] && i != simplex[3]) candidates.push_back(i);
+			}
+			assign(candidates, 0);
+
+			// faces get outside points only when they are created, so pending stays in index order
+			size_t next = 0;
+			for (int vertex_count = 4; vertex_count < max_vertices; ++vertex_count)
+			{
+				while (next < pending.size() && faces[pending[next]].removed) ++next;
+				if (next == pending.size()) break;
+				addPoint(pending[next]);
+			}
+
+			std::vector<int> remap(points.size(), -1);
+			hull->vertices.clear();
+			hull->planes.clear();
+			*volume = 0;
+			const Vec3 origin = points[simplex[0]];
+			for (const Face& face : faces)
+			{
+				if (face.removed) continue;
+				for (int v : face.v)
+				{
+					if (remap[v] >= 0) continue;
+					remap[v] = (int)hull->vertices.size();
+					hull->vertices.push_back(points[v]);
+				}
+				*volume += dot(sub(points[face.v[0]], origin), cross(sub(points[face.v[1]], origin), sub(points[face.v[2]], origin))) / 6;
+
+				// coplanar triangles share a plane
+				bool found = false;
+				for (const Vec4& plane : hull->planes)
+				{
+					if (dot({plane.x, plane.y, plane.z}, face.normal) > 1 - 1e-9 && fabs(-plane.w - face.offset) <= eps)
+					{
+						found = true;
+						break;
+					}
+				}
+				if (!found) hull->planes.push_back({face.normal.x, face.normal.y, face.normal.z, -face.offset});
+			}
+			return true;
+		}
+
+
+		const std::vector<Vec3>& points;
+		const int max_vertices;
+		double eps = 0;
+		std::vector<Face> faces;
+		std::unordered_map<u64, int> edge_faces; // directed edge of a live face -> the face
+		std::vector<int> pending; // faces that had outside points when they were created, in index order
+	};
+
+
+	struct ProxyBuilder
+	{
+		struct Part
+		{
+			std::vector<int> triangles;
+			ConvexHull hull;
+			double volume = 0;
+			bool final = false;
+		};
+
+
+		ProxyBuilder(const CollisionSettings& _settings)
+			: settings(_settings)
+		{
+		}
+
+
+		bool buildHull(const std::vector<Vec3>& points, ConvexHull* hull, double* volume) const
+		{
+			QuickHull quickhull(points, settings.max_hull_vertices);
+			return quickhull.build(hull, volume);
+		}
+
+
+		bool buildHull(const std::vector<int>& part_triangles, ConvexHull* hull, double* volume)
+		{
+			++stamp;
+			part_points.clear();
+			for (int tri : part_triangles)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					const int v = (*triangles)[tri * 3 + i];
+					if (marks[v] == stamp) continue;
+					marks[v] = stamp;
+					part_points.push_back(vertices[v]);
+				}
+			}
+			return buildHull(part_points, hull, volume);
+		}
+
+
+		// connected pieces of the geometry from its adjacency, joined over twin half edges
+		void findComponents(const Adjacency& adjacency)
+		{
+			const int tri_count = (int)triangles->size() / 3;
+			if ((int)adjacency.triangle_polygons.size() != tri_count) return;
+
+			std::vector<int> roots(adjacency.getPolygonCount());
+			for (int i = 0, c = (int)roots.size(); i < c; ++i) roots[i] = i;
+			auto find = [&](int poly) {
+				while (roots[poly] != poly)
+				{
+					roots[poly] = roots[roots[poly]];
+					poly = roots[poly];
+				}
+				return poly;
+			};
+			for (int i = 0, c = (int)adjacency.twins.size(); i < c; ++i)
+			{
+				const int twin = adjacency.twins[i];
+				if (twin < i) continue;
+				const int a = find(adjacency.polygons[i]);
+				const int b = find(adjacency.polygons[twin]);
+				if (a != b) roots[std::max(a, b)] = std::min(a, b);
+			}
+
+			components.resize(tri_count);
+			for (int tri = 0; tri < tri_count; ++tri) components[tri] = find(adjacency.triangle_polygons[tri]);
+			component_sizes.assign(roots.size(), 0);
+		}
+
+
+		// the largest connected piece of the part against the rest, false if the part is connected
+		bool splitComponents(const Part& part, Part* children)
+		{
+			int largest = -1;
+			for (int tri : part.triangles)
+			{
+				const int component = components[tri];
+				++component_sizes[component];
+				if (largest < 0 || component_sizes[component] > component_sizes[largest]) largest = component;
+			}
+			for (int tri : part.triangles) component_sizes[components[tri]] = 0;
+			for (int tri : part.triangles) children[components[tri] == largest ? 0 : 1].triangles.push_back(tri);
+			return !children[1].triangles.empty();
+		}
+
+
+		// cuts the part through the center of its triangles' bounds on the axis giving the smallest hulls,
+		// disconnected pieces are tried as a cut too
+		bool split(const Part& part, Part* children)
+		{
+			if (part.triangles.size() < 2) return false;
+
+			Vec3 min = {DBL_MAX, DBL_MAX, DBL_MAX};
+			Vec3 max = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+			for (int tri : part.triangles)
+			{
+				const Vec3& c = centers[tri];
+				min = {std::min(min.x, c.x), std::min(min.y, c.y), std::min(min.z, c.z)};
+				max = {std::max(max.x, c.x), std::max(max.y, c.y), std::max(max.z, c.z)};
+			}
+
+			double best_volume = (1 - settings.min_volume_gain) * part.volume;
+			bool found = false;
+			Part candidates[2];
+			if (!components.empty() && splitComponents(part, candidates)
+				&& buildHull(candidates[0].triangles, &candidates[0].hull, &candidates[0].volume)
+				&& buildHull(candidates[1].triangles, &candidates[1].hull, &candidates[1].volume)
+				&& candidates[0].volume + candidates[1].volume < best_volume)
+			{
+				best_volume = candidates[0].volume + candidates[1].volume;
+				found = true;
+				std::swap(children[0], candidates[0]);
+				std::swap(children[1], candidates[1]);
+			}
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const double mid = ((&min.x)[axis] + (&max.x)[axis]) * 0.5;
+				if (mid <= (&min.x)[axis]) continue;
+
+				candidates[0].triangles.clear();
+				candidates[1].triangles.clear();
+				for (int tri : part.triangles)
+				{
+					candidates[(&centers[tri].x)[axis] < mid ? 0 : 1].triangles.push_back(tri);
+				}
+				if (candidates[0].triangles.empty() || candidates[1].triangles.empty()) continue;
+				if (!buildHull(candidates[0].triangles, &candidates[0].hull, &candidates[0].volume)) continue;
+				if (!buildHull(candidates[1].triangles, &candidates[1].hull, &candidates[1].volume)) continue;
+
+				if (candidates[0].volume + candidates[1].volume < best_volume)
+				{
+					best_volume = candidates[0].volume + candidates[1].volume;
+					found = true;
+					std::swap(children[0], candidates[0]);
+					std::swap(children[1], candidates[1]);
+				}
+			}
+			return found;
+		}
+
+
+		void decompose(CollisionProxy* proxy)
+		{
+			const int tri_count = (int)triangles->size() / 3;
+			centers.resize(tri_count);
+			for (int tri = 0; tri < tri_count; ++tri)
+			{
+				const Vec3& a = vertices[(*triangles)[tri * 3]];
+				const Vec3& b = vertices[(*triangles)[tri * 3 + 1]];
+				const Vec3& c = vertices[(*triangles)[tri * 3 + 2]];
+				centers[tri] = {(a.x + b.x + c.x) / 3, (a.y + b.y + c.y) / 3, (a.z + b.z + c.z) / 3};
+			}
+			marks.assign(vertices.size(), 0);
+			stamp = 0;
+
+			std::vector<Part> parts(1);
+			parts[0].triangles.resize(tri_count);
+			for (int tri = 0; tri < tri_count; ++tri) parts[0].triangles[tri] = tri;
+			if (!buildHull(vertices, &parts[0].hull, &parts[0].volume)) return;
+
+			while (settings.decompose && (int)parts.size() < settings.max_hulls)
+			{
+				int best = -1;
+				for (int i = 0, c = (int)parts.size(); i < c; ++i)
+				{
+					if (!parts[i].final && (best < 0 || parts[i].volume > parts[best].volume)) best = i;
+				}
+				if (best < 0) break;
+
+				Part children[2];
+				if (!split(parts[best], children))
+				{
+					parts[best].final = true;
+					continue;
+				}
+				parts[best] = std::move(children[0]);
+				parts.push_back(std::move(children[1]));
+			}
+
+			for (Part& part : parts) proxy->hulls.push_back(std::move(part.hull));
+		}
+
+
+		void build(const std::vector<const Mesh*>& hints, CollisionProxy* proxy)
+		{
+			const Mesh& mesh = *proxy->mesh;
+			if (!hints.empty())
+			{
+				proxy->from_hints = true;
+				const Matrix to_mesh = getInverseAffine(mesh.getGlobalTransform());
+				for (const Mesh* hint : hints)
+				{
+					vertices = hint->getGeometry()->getVertices();
+					if (vertices.empty()) continue;
+					transformPoints(to_mesh * hint->getGlobalTransform() * hint->getGeometricMatrix(), &vertices[0], (int)vertices.size());
+
+					ConvexHull hull;
+					double volume;
+					if (buildHull(vertices, &hull, &volume)) proxy->hulls.push_back(std::move(hull));
+				}
+				return;
+			}
+
+			vertices = mesh.getGeometry()->getVertices();
+			triangles = &mesh.getGeometry()->getTriangles();
+			if (vertices.empty() || triangles->empty()) return;
+			transformPoints(mesh.getGeometricMatrix(), &vertices[0], (int)vertices.size());
+			const Adjacency* adjacency = mesh.getGeometry()->getAdjacency();
+			if (adjacency) findComponents(*adjacency);
+			decompose(proxy);
+		}
+
+
+		const CollisionSettings& settings;
+		std::vector<Vec3> vertices;
+		const std::vector<int>* triangles = nullptr;
+		std::vector<Vec3> centers;
+		std::vector<Vec3> part_points;
+		std::vector<int> marks;
+		int stamp = 0;
+		// connected component of each triangle, empty if the geometry has no adjacency
+		std::vector<int> components;
+		std::vector<int> component_sizes;
+	};
+
+
+	static bool isCollisionHint(const char* name)
+	{
+		return strncmp(name, "UCX_", 4) == 0 || strncmp(name, "UBX_", 4) == 0 || strncmp(name, "UCP_", 4) == 0 ||
+			   strncmp(name, "USP_", 4) == 0;
+	}
+
+
+	void buildCollisionProxies(const IScene& scene, const CollisionSettings& settings, std::vector<CollisionProxy>* proxies)
+	{
+		assert(proxies);
+
+		proxies->clear();
+		std::unordered_map<std::string, int> proxy_by_name;
+		for (int i = 0, c = scene.getMeshCount(); i < c; ++i)
+		{
+			const Mesh* mesh = scene.getMesh(i);
+			if (!mesh->getGeometry() || isCollisionHint(mesh->name)) continue;
+
+			proxy_by_name.insert({mesh->name, (int)proxies->size()});
+			proxies->push_back({mesh, false, {}});
+		}
+
+		std::vector<std::vector<const Mesh*>> hints(proxies->size());
+		for (int i = 0, c = scene.getMeshCount(); i < c; ++i)
+		{
+			const Mesh* mesh = scene.getMesh(i);
+			if (!mesh->getGeometry() || !isCollisionHint(mesh->name)) continue;
+
+			std::string name = mesh->name + 4;
+			auto iter = proxy_by_name.find(name);
+			if (iter == proxy_by_name.end())
+			{
+				// UCX_<name>_<number>
+				const size_t separator = name.find_last_of('_');
+				if (separator == std::string::npos || separator + 1 == name.size()) continue;
+				if (name.find_first_not_of("0123456789", separator + 1) != std::string::npos) continue;
+				iter = proxy_by_name.find(name.substr(0, separator));
+				if (iter == proxy_by_name.end()) continue;
+			}
+			hints[iter->second].push_back(mesh);
+		}
+
+		parallelFor((int)proxies->size(), settings.thread_count, [&](int i) {
+			ProxyBuilder builder(settings);
+			builder.build(hints[i], &(*proxies)[i]);
+		});
+	}
+
+} // namespace ofbx
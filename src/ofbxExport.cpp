@@ -0,0 +1,767 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace ofbx
+{
+
+	// shortest decimal that reads back as the same float, Ryu (Ulf Adams, 2018) for 32 bit floats;
+	// the power of 5 tables are computed once instead of being embedded
+	struct FloatFormatter
+	{
+		enum
+		{
+			POW5_INV_BITCOUNT = 59,
+			POW5_BITCOUNT = 61,
+			POW5_INV_TABLE_SIZE = 31,
+			POW5_TABLE_SIZE = 47
+		};
+
+		// just enough of a big integer to build the tables
+		struct BigInt
+		{
+			u32 limbs[5] = {};
+
+			void mul(u32 m)
+			{
+				u64 carry = 0;
+				for (u32& limb : limbs)
+				{
+					const u64 v = (u64)limb * m + carry;
+					limb = (u32)v;
+					carry = v >> 32;
+				}
+			}
+
+			void shiftLeft1(u32 bit)
+			{
+				for (u32& limb : limbs)
+				{
+					const u32 top = limb >> 31;
+					limb = (limb << 1) | bit;
+					bit = top;
+				}
+			}
+
+			bool operator>=(const BigInt& rhs) const
+			{
+				for (int i = 4; i >= 0; --i)
+				{
+					if (limbs[i] != rhs.limbs[i]) return limbs[i] > rhs.limbs[i];
+				}
+				return true;
+			}
+
+			void operator-=(const BigInt& rhs)
+			{
+				u64 borrow = 0;
+				for (int i = 0; i < 5; ++i)
+				{
+					const u64 v = (u64)limbs[i] - rhs.limbs[i] - borrow;
+					limbs[i] = (u32)v;
+					borrow = (v >> 32) & 1;
+				}
+			}
+
+			// 64 bits starting at bit `shift`
+			u64 bits(int shift) const
+			{
+				u64 res = 0;
+				for (int i = 0; i < 64; ++i)
+				{
+					const int bit = shift + i;
+					if (bit >= 0 && bit < 160 && (limbs[bit / 32] >> (bit % 32)) & 1) res |= u64(1) << i;
+				}
+				return res;
+			}
+		};
+
+
+		FloatFormatter()
+		{
+			BigInt pow5;
+			pow5.limbs[0] = 1;
+			for (int i = 0; i < POW5_TABLE_SIZE; ++i)
+			{
+				// top POW5_BITCOUNT bits of 5^i
+				pow5_split[i] = pow5.bits(pow5bits(i) - POW5_BITCOUNT);
+
+				if (i < POW5_INV_TABLE_SIZE)
+				{
+					// floor(2^(pow5bits(i) - 1 + POW5_INV_BITCOUNT) / 5^i) + 1, by long division
+					const int exponent = pow5bits(i) - 1 + POW5_INV_BITCOUNT;
+					BigInt remainder;
+					u64 quotient = 0;
+					for (int bit = exponent; bit >= 0; --bit)
+					{
+						remainder.shiftLeft1(bit == exponent ? 1 : 0);
+						quotient <<= 1;
+						if (remainder >= pow5)
+						{
+							remainder -= pow5;
+							quotient |= 1;
+						}
+					}
+					pow5_inv_split[i] = quotient + 1;
+				}
+				pow5.mul(5);
+			}
+		}
+
+
+		static const FloatFormatter& get()
+		{
+			static const FloatFormatter formatter;
+			return formatter;
+		}
+
+
+		static u32 log10Pow2(int e) { return (u32)(((u32)e * 78913) >> 18); }
+		static u32 log10Pow5(int e) { return (u32)(((u32)e * 732923) >> 20); }
+		// e == 0 ? 1 : ceil(log2(5^e))
+		static int pow5bits(int e) { return (int)((((u32)e * 1217359) >> 19) + 1); }
+
+		static u32 pow5Factor(u32 value)
+		{
+			u32 count = 0;
+			while (value % 5 == 0)
+			{
+				value /= 5;
+				++count;
+			}
+			return count;
+		}
+
+		static bool multipleOfPowerOf5(u32 value, u32 p) { return pow5Factor(value) >= p; }
+		static bool multipleOfPowerOf2(u32 value, u32 p) { return (value & ((1u << p) - 1)) == 0; }
+
+		static u32 mulShift(u32 m, u64 factor, int shift)
+		{
+			assert(shift > 32);
+			const u64 bits0 = (u64)m * (u32)factor;
+			const u64 bits1 = (u64)m * (u32)(factor >> 32);
+			const u64 sum = (bits0 >> 32) + bits1;
+			return (u32)(sum >> (shift - 32));
+		}
+
+		u32 mulPow5InvDivPow2(u32 m, u32 q, int j) const { return mulShift(m, pow5_inv_split[q], j); }
+		u32 mulPow5DivPow2(u32 m, u32 i, int j) const { return mulShift(m, pow5_split[i], j); }
+
+
+		// finite, non-zero, positive value = *mantissa * 10^*exponent
+		void toDecimal(u32 ieee_mantissa, u32 ieee_exponent, u32* mantissa, int* exponent) const
+		{
+			int e2;
+			u32 m2;
+			if (ieee_exponent == 0)
+			{
+				e2 = 1 - 127 - 23 - 2;
+				m2 = ieee_mantissa;
+			}
+			else
+			{
+				e2 = (int)ieee_exponent - 127 - 23 - 2;
+				m2 = (1u << 23) | ieee_mantissa;
+			}
+			const bool accept_bounds = (m2 & 1) == 0;
+
+			// interval of decimals that round to the value
+			const u32 mv = 4 * m2;
+			const u32 mp = 4 * m2 + 2;
+			const u32 mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+			const u32 mm = 4 * m2 - 1 - mm_shift;
+
+			u32 vr, vp, vm;
+			int e10;
+			bool vm_trailing_zeros = false;
+			bool vr_trailing_zeros = false;
+			u32 last_removed_digit = 0;
+			if (e2 >= 0)
+			{
+				const u32 q = log10Pow2(e2);
+				e10 = (int)q;
+				const int k = POW5_INV_BITCOUNT + pow5bits((int)q) - 1;
+				const int i = -e2 + (int)q + k;
+				vr = mulPow5InvDivPow2(mv, q, i);
+				vp = mulPow5InvDivPow2(mp, q, i);
+				vm = mulPow5InvDivPow2(mm, q, i);
+				if (q != 0 && (vp - 1) / 10 <= vm / 10)
+				{
+					const int l = POW5_INV_BITCOUNT + pow5bits((int)(q - 1)) - 1;
+					last_removed_digit = mulPow5InvDivPow2(mv, q - 1, -e2 + (int)q - 1 + l) % 10;
+				}
+				if (q <= 9)
+				{
+					// only one of mp, mv and mm can be a multiple of 5
+					if (mv % 5 == 0)
+					{
+						vr_trailing_zeros = multipleOfPowerOf5(mv, q);
+					}
+					else if (accept_bounds)
+					{
+						vm_trailing_zeros = multipleOfPowerOf5(mm, q);
+					}
+					else
+					{
+						vp -= multipleOfPowerOf5(mp, q);
+					}
+				}
+			}
+			else
+			{
+				const u32 q = log10Pow5(-e2);
+				e10 = (int)q + e2;
+				const int i = -e2 - (int)q;
+				const int k = pow5bits(i) - POW5_BITCOUNT;
+				int j = (int)q - k;
+				vr = mulPow5DivPow2(mv, (u32)i, j);
+				vp = mulPow5DivPow2(mp, (u32)i, j);
+				vm = mulPow5DivPow2(mm, (u32)i, j);
+				if (q != 0 && (vp - 1) / 10 <= vm / 10)
+				{
+					j = (int)q - 1 - (pow5bits(i + 1) - POW5_BITCOUNT);
+					last_removed_digit = mulPow5DivPow2(mv, (u32)(i + 1), j) % 10;
+				}
+				if (q <= 1)
+				{
+					// mv = 4 * m2 has at least two trailing zero bits
+					vr_trailing_zeros = true;
+					if (accept_bounds)
+					{
+						vm_trailing_zeros = mm_shift == 1;
+					}
+					else
+					{
+						--vp;
+					}
+				}
+				else if (q < 31)
+				{
+					vr_trailing_zeros = multipleOfPowerOf2(mv, q - 1);
+				}
+			}
+
+			// shortest decimal in the interval
+			int removed = 0;
+			u32 output;
+			if (vm_trailing_zeros || vr_trailing_zeros)
+			{
+				while (vp / 10 > vm / 10)
+				{
+					vm_trailing_zeros &= vm % 10 == 0;
+					vr_trailing_zeros &= last_removed_digit == 0;
+					last_removed_digit = vr % 10;
+					vr /= 10;
+					vp /= 10;
+					vm /= 10;
+					++removed;
+				}
+				if (vm_trailing_zeros)
+				{
+					while (vm % 10 == 0)
+					{
+						vr_trailing_zeros &= last_removed_digit == 0;
+						last_removed_digit = vr % 10;
+						vr /= 10;
+						vp /= 10;
+						vm /= 10;
+						++removed;
+					}
+				}
+				// round half to even if the exact value is ...50..0
+				if (vr_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0) last_removed_digit = 4;
+				output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed_digit >= 5);
+			}
+			else
+			{
+				while (vp / 10 > vm / 10)
+				{
+					last_removed_digit = vr % 10;
+					vr /= 10;
+					vp /= 10;
+					vm /= 10;
+					++removed;
+				}
+				output = vr + (vr == vm || last_removed_digit >= 5);
+			}
+			*mantissa = output;
+			*exponent = e10 + removed;
+		}
+
+
+		// plain notation for exponents in [-5, 9), scientific otherwise; at most 16 chars
+		char* write(char* out, float value) const
+		{
+			u32 bits;
+			memcpy(&bits, &value, sizeof(bits));
+			const u32 ieee_mantissa = bits & ((1u << 23) - 1);
+			const u32 ieee_exponent = (bits >> 23) & 0xff;
+			if (bits >> 31) *out++ = '-';
+
+			if (ieee_exponent == 0xff)
+			{
+				const char* str = ieee_mantissa ? "nan" : "inf";
+				memcpy(out, str, 3);
+				return out + 3;
+			}
+			if (ieee_exponent == 0 && ieee_mantissa == 0)
+			{
+				*out++ = '0';
+				return out;
+			}
+
+			u32 mantissa;
+			int exponent;
+			toDecimal(ieee_mantissa, ieee_exponent, &mantissa, &exponent);
+
+			char digits[10];
+			int digit_count = 0;
+			for (u32 m = mantissa; m; m /= 10) digits[9 - digit_count++] = char('0' + m % 10);
+			const char* first = digits + 10 - digit_count;
+
+			// position of the decimal point relative to the first digit
+			const int point = digit_count + exponent;
+			if (point > 0 && point <= 9)
+			{
+				if (exponent >= 0)
+				{
+					memcpy(out, first, digit_count);
+					out += digit_count;
+					for (int i = 0; i < exponent; ++i) *out++ = '0';
+					return out;
+				}
+				memcpy(out, first, point);
+				out += point;
+				*out++ = '.';
+				memcpy(out, first + point, digit_count - point);
+				return out + digit_count - point;
+			}
+			if (point <= 0 && point > -5)
+			{
+				*out++ = '0';
+				*out++ = '.';
+				for (int i = 0; i < -point; ++i) *out++ = '0';
+				memcpy(out, first, digit_count);
+				return out + digit_count;
+			}
+
+			*out++ = first[0];
+			if (digit_count > 1)
+			{
+				*out++ = '.';
+				memcpy(out, first + 1, digit_count - 1);
+				out += digit_count - 1;
+			}
+			*out++ = 'e';
+			int scientific_exponent = point - 1;
+			if (scientific_exponent < 0)
+			{
+				*out++ = '-';
+				scientific_exponent = -scientific_exponent;
+			}
+			if (scientific_exponent >= 10) *out++ = char('0' + scientific_exponent / 10);
+			*out++ = char('0' + scientific_exponent % 10);
+			return out;
+		}
+
+
+		u64 pow5_inv_split[POW5_INV_TABLE_SIZE];
+		u64 pow5_split[POW5_TABLE_SIZE];
+	};
+
+
+	struct SceneExporter
+	{
+		// a range of one mesh's vertices or triangles, formatted independently and written in order
+		struct Chunk
+		{
+			enum Kind
+			{
+				OBJECT,
+				POSITIONS,
+				UVS,
+				NORMALS,
+				FACES
+			};
+
+			Kind kind;
+			int mesh;
+			int from;
+			int to;
+		};
+
+		struct MeshInfo
+		{
+			const Mesh* mesh;
+			const Geometry* geom;
+			Matrix transform;
+			Matrix normal_transform;
+			bool flip_winding;
+			bool has_normals;
+			bool has_uvs;
+			// first index of the mesh's elements in the whole file, OBJ's are 1-based
+			int vertex_offset;
+			int uv_offset;
+			int normal_offset;
+		};
+
+		enum { CHUNK_SIZE = 16 * 1024 };
+
+
+		SceneExporter(const IScene& _scene, const ExportSettings& _settings)
+			: scene(_scene)
+			, settings(_settings)
+			, formatter(FloatFormatter::get())
+		{
+		}
+
+
+		void gatherMeshes()
+		{
+			int vertex_offset = 0;
+			int uv_offset = 0;
+			int normal_offset = 0;
+			for (int i = 0, c = scene.getMeshCount(); i < c; ++i)
+			{
+				const Mesh* mesh = scene.getMesh(i);
+				const Geometry* geom = mesh->getGeometry();
+				if (!geom || geom->getVertices().empty()) continue;
+
+				MeshInfo info;
+				info.mesh = mesh;
+				info.geom = geom;
+				info.transform = settings.world_space ? mesh->getGlobalTransform() * mesh->getGeometricMatrix() : makeIdentity();
+				info.normal_transform = getNormalMatrix(info.transform);
+				info.flip_winding = getDeterminant3x3(info.transform) < 0;
+				info.has_normals = geom->getNormals().size() == geom->getVertices().size();
+				info.has_uvs = geom->getUVs().size() == geom->getVertices().size();
+
+				const int vertex_count = (int)geom->getVertices().size();
+				const bool obj = settings.format == ExportSettings::OBJ;
+				info.vertex_offset = vertex_offset + obj;
+				info.uv_offset = uv_offset + obj;
+				info.normal_offset = normal_offset + obj;
+				vertex_offset += vertex_count;
+				if (info.has_uvs) uv_offset += vertex_count;
+				if (info.has_normals) normal_offset += vertex_count;
+				any_normals |= info.has_normals;
+				any_uvs |= info.has_uvs;
+				triangle_count += (int)geom->getTriangleCount();
+				meshes.push_back(info);
+			}
+			total_vertex_count = vertex_offset;
+		}
+
+
+		void addChunks(Chunk::Kind kind, int mesh, int count)
+		{
+			for (int from = 0; from < count; from += CHUNK_SIZE)
+			{
+				chunks.push_back({kind, mesh, from, std::min(from + CHUNK_SIZE, count)});
+			}
+		}
+
+
+		void gatherChunks()
+		{
+			const bool obj = settings.format == ExportSettings::OBJ;
+			for (int i = 0, c = (int)meshes.size(); i < c; ++i)
+			{
+				const MeshInfo& info = meshes[i];
+				const int vertex_count = (int)info.geom->getVertices().size();
+				if (obj)
+				{
+					chunks.push_back({Chunk::OBJECT, i, 0, 0});
+					addChunks(Chunk::POSITIONS, i, vertex_count);
+					if (info.has_uvs) addChunks(Chunk::UVS, i, vertex_count);
+					if (info.has_normals) addChunks(Chunk::NORMALS, i, vertex_count);
+				}
+				else
+				{
+					// PLY vertex records hold all attributes
+					addChunks(Chunk::POSITIONS, i, vertex_count);
+				}
+			}
+			for (int i = 0, c = (int)meshes.size(); i < c; ++i)
+			{
+				addChunks(Chunk::FACES, i, (int)meshes[i].geom->getTriangleCount());
+			}
+		}
+
+
+		static char* writeString(char* out, const char* str)
+		{
+			while (*str) *out++ = *str++;
+			return out;
+		}
+
+
+		static char* writeInt(char* out, int value)
+		{
+			char tmp[12];
+			int count = 0;
+			u32 v = value < 0 ? 0u - (u32)value : (u32)value;
+			do
+			{
+				tmp[count++] = char('0' + v % 10);
+				v /= 10;
+			} while (v);
+			if (value < 0) *out++ = '-';
+			while (count) *out++ = tmp[--count];
+			return out;
+		}
+
+
+		void getPositions(const MeshInfo& info, int from, int to, Vec3* out) const
+		{
+			memcpy(out, &info.geom->getVertices()[from], sizeof(Vec3) * (to - from));
+			transformPoints(info.transform, out, to - from);
+		}
+
+
+		void getNormals(const MeshInfo& info, int from, int to, Vec3* out) const
+		{
+			memcpy(out, &info.geom->getNormals()[from], sizeof(Vec3) * (to - from));
+			transformVectors(info.normal_transform, out, to - from, true);
+		}
+
+
+		void formatOBJ(const Chunk& chunk, std::vector<char>* buffer)
+		{
+			const MeshInfo& info = meshes[chunk.mesh];
+			const int count = chunk.to - chunk.from;
+			// longest float is 16 chars
+			const int MAX_LINE = 3 + 3 * 17 + 1;
+			const int MAX_FACE_LINE = 2 + 3 * (3 * 11 + 3) + 1;
+			switch (chunk.kind)
+			{
+				case Chunk::OBJECT: buffer->resize(sizeof(info.mesh->name) + 64); break;
+				case Chunk::FACES: buffer->resize(count * MAX_FACE_LINE); break;
+				default: buffer->resize(count * MAX_LINE); break;
+			}
+			char* out = buffer->data();
+
+			switch (chunk.kind)
+			{
+				case Chunk::OBJECT:
+				{
+					out = writeString(out, "o ");
+					if (info.mesh->name[0])
+					{
+						for (const char* c = info.mesh->name; *c; ++c) *out++ = *c == ' ' || *c == '\t' ? '_' : *c;
+					}
+					else
+					{
+						out = writeString(out, "mesh");
+						out = writeInt(out, chunk.mesh);
+					}
+					*out++ = '\n';
+					break;
+				}
+				case Chunk::POSITIONS:
+				case Chunk::NORMALS:
+				{
+					std::vector<Vec3> tmp(count);
+					if (chunk.kind == Chunk::POSITIONS)
+						getPositions(info, chunk.from, chunk.to, &tmp[0]);
+					else
+						getNormals(info, chunk.from, chunk.to, &tmp[0]);
+					const char* prefix = chunk.kind == Chunk::POSITIONS ? "v " : "vn ";
+					for (const Vec3& v : tmp)
+					{
+						out = writeString(out, prefix);
+						out = formatter.write(out, (float)v.x);
+						*out++ = ' ';
+						out = formatter.write(out, (float)v.y);
+						*out++ = ' ';
+						out = formatter.write(out, (float)v.z);
+						*out++ = '\n';
+					}
+					break;
+				}
+				case Chunk::UVS:
+				{
+					const Vec2* uvs = &info.geom->getUVs()[0];
+					for (int i = chunk.from; i < chunk.to; ++i)
+					{
+						out = writeString(out, "vt ");
+						out = formatter.write(out, (float)uvs[i].x);
+						*out++ = ' ';
+						out = formatter.write(out, (float)uvs[i].y);
+						*out++ = '\n';
+					}
+					break;
+				}
+				case Chunk::FACES:
+				{
+					const int* triangles = &info.geom->getTriangles()[0];
+					for (int tri = chunk.from; tri < chunk.to; ++tri)
+					{
+						*out++ = 'f';
+						for (int i = 0; i < 3; ++i)
+						{
+							const int corner = info.flip_winding ? 2 - i : i;
+							const int vertex = triangles[tri * 3 + corner];
+							*out++ = ' ';
+							out = writeInt(out, info.vertex_offset + vertex);
+							if (!info.has_uvs && !info.has_normals) continue;
+							*out++ = '/';
+							if (info.has_uvs) out = writeInt(out, info.uv_offset + vertex);
+							if (!info.has_normals) continue;
+							*out++ = '/';
+							out = writeInt(out, info.normal_offset + vertex);
+						}
+						*out++ = '\n';
+					}
+					break;
+				}
+			}
+			buffer->resize(out - buffer->data());
+		}
+
+
+		void formatPLY(const Chunk& chunk, std::vector<char>* buffer)
+		{
+			const MeshInfo& info = meshes[chunk.mesh];
+			const int count = chunk.to - chunk.from;
+			if (chunk.kind == Chunk::FACES)
+			{
+				const int RECORD_SIZE = 1 + 3 * sizeof(int);
+				buffer->resize(count * RECORD_SIZE);
+				char* out = buffer->data();
+				const int* triangles = &info.geom->getTriangles()[0];
+				for (int tri = chunk.from; tri < chunk.to; ++tri)
+				{
+					*out++ = 3;
+					for (int i = 0; i < 3; ++i)
+					{
+						const int corner = info.flip_winding ? 2 - i : i;
+						const int vertex = info.vertex_offset + triangles[tri * 3 + corner];
+						memcpy(out, &vertex, sizeof(vertex));
+						out += sizeof(vertex);
+					}
+				}
+				return;
+			}
+
+			assert(chunk.kind == Chunk::POSITIONS);
+			const int floats = 3 + (any_normals ? 3 : 0) + (any_uvs ? 2 : 0);
+			buffer->resize(count * floats * sizeof(float));
+			std::vector<Vec3> positions(count);
+			std::vector<Vec3> normals(info.has_normals ? count : 0);
+			getPositions(info, chunk.from, chunk.to, &positions[0]);
+			if (info.has_normals) getNormals(info, chunk.from, chunk.to, &normals[0]);
+
+			float* out = (float*)buffer->data();
+			for (int i = 0; i < count; ++i)
+			{
+				*out++ = (float)positions[i].x;
+				*out++ = (float)positions[i].y;
+				*out++ = (float)positions[i].z;
+				if (any_normals)
+				{
+					const Vec3 n = info.has_normals ? normals[i] : Vec3{0, 0, 0};
+					*out++ = (float)n.x;
+					*out++ = (float)n.y;
+					*out++ = (float)n.z;
+				}
+				if (any_uvs)
+				{
+					const Vec2 uv = info.has_uvs ? info.geom->getUVs()[chunk.from + i] : Vec2{0, 0};
+					*out++ = (float)uv.x;
+					*out++ = (float)uv.y;
+				}
+			}
+		}
+
+
+		bool writeHeader(FILE* fp)
+		{
+			char header[1024];
+			int size;
+			if (settings.format == ExportSettings::OBJ)
+			{
+				size = snprintf(header, sizeof(header), "# exported by OpenFBX\n# %d vertices, %d triangles\n", total_vertex_count, triangle_count);
+			}
+			else
+			{
+				u32 one = 1;
+				const bool little_endian = *(const u8*)&one == 1;
+				size = snprintf(header,
+					sizeof(header),
+					"ply\nformat %s 1.0\ncomment exported by OpenFBX\nelement vertex %d\nproperty float x\nproperty float y\nproperty float z\n%s%s"
+					"element face %d\nproperty list uchar int vertex_indices\nend_header\n",
+					little_endian ? "binary_little_endian" : "binary_big_endian",
+					total_vertex_count,
+					any_normals ? "property float nx\nproperty float ny\nproperty float nz\n" : "",
+					any_uvs ? "property float u\nproperty float v\n" : "",
+					triangle_count);
+			}
+			return fwrite(header, 1, size, fp) == (size_t)size;
+		}
+
+
+		bool run(const char* path)
+		{
+			gatherMeshes();
+			gatherChunks();
+
+			FILE* fp = fopen(path, "wb");
+			if (!fp)
+			{
+				Error::s_message = "Failed to open file for writing";
+				return false;
+			}
+
+			bool ok = writeHeader(fp);
+
+			// chunks are formatted in parallel a window at a time, then written sequentially
+			const int thread_count = settings.thread_count > 0 ? settings.thread_count : (int)std::thread::hardware_concurrency();
+			const int window = std::max(thread_count, 1) * 4;
+			std::vector<std::vector<char>> buffers(std::min(window, (int)chunks.size()));
+			for (int begin = 0, c = (int)chunks.size(); begin < c && ok; begin += window)
+			{
+				const int count = std::min(window, c - begin);
+				parallelFor(count, settings.thread_count, [&](int i) {
+					if (settings.format == ExportSettings::OBJ)
+						formatOBJ(chunks[begin + i], &buffers[i]);
+					else
+						formatPLY(chunks[begin + i], &buffers[i]);
+				});
+				for (int i = 0; i < count && ok; ++i)
+				{
+					ok = buffers[i].empty() || fwrite(buffers[i].data(), 1, buffers[i].size(), fp) == buffers[i].size();
+				}
+			}
+
+			if (fclose(fp) != 0) ok = false;
+			if (!ok) Error::s_message = "Failed to write file";
+			return ok;
+		}
+
+
+		const IScene& scene;
+		const ExportSettings& settings;
+		const FloatFormatter& formatter;
+		std::vector<MeshInfo> meshes;
+		std::vector<Chunk> chunks;
+		int total_vertex_count = 0;
+		int triangle_count = 0;
+		bool any_normals = false;
+		bool any_uvs = false;
+	};
+
+
+	int formatFloat(float value, char* out)
+	{
+		return int(FloatFormatter::get().write(out, value) - out);
+	}
+
+
+	bool exportScene(const IScene& scene, const char* path, const ExportSettings& settings)
+	{
+		SceneExporter exporter(scene, settings);
+		return exporter.run(path);
+	}
+
+} // namespace ofbx
@@ -0,0 +1,440 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#ifndef _WIN32
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+#ifdef __linux__
+	#include <linux/io_uring.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <sys/uio.h>
+#endif
+
+namespace ofbx
+{
+
+#ifdef __linux__
+	// the raw io_uring interface, only readv is used so it works on kernels since 5.1
+	struct IoUring
+	{
+		~IoUring()
+		{
+			if (sqes) munmap(sqes, sqes_size);
+			if (cq_ptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+			if (sq_ptr) munmap(sq_ptr, sq_size);
+			if (fd >= 0) close(fd);
+		}
+
+
+		bool init(unsigned requested_entries)
+		{
+			io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			fd = (int)syscall(__NR_io_uring_setup, requested_entries, &params);
+			if (fd < 0) return false;
+
+			sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (single_mmap) sq_size = cq_size = std::max(sq_size, cq_size);
+
+			void* sq = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+			if (sq == MAP_FAILED) return false;
+			sq_ptr = (u8*)sq;
+			if (single_mmap)
+			{
+				cq_ptr = sq_ptr;
+			}
+			else
+			{
+				void* cq = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+				if (cq == MAP_FAILED) return false;
+				cq_ptr = (u8*)cq;
+			}
+			sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+			void* sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+			if (sqes_ptr == MAP_FAILED) return false;
+			sqes = (io_uring_sqe*)sqes_ptr;
+
+			sq_tail = (unsigned*)(sq_ptr + params.sq_off.tail);
+			sq_mask = *(unsigned*)(sq_ptr + params.sq_off.ring_mask);
+			sq_array = (unsigned*)(sq_ptr + params.sq_off.array);
+			cq_head = (unsigned*)(cq_ptr + params.cq_off.head);
+			cq_tail = (unsigned*)(cq_ptr + params.cq_off.tail);
+			cq_mask = *(unsigned*)(cq_ptr + params.cq_off.ring_mask);
+			cqes = (io_uring_cqe*)(cq_ptr + params.cq_off.cqes);
+			entries = params.sq_entries;
+			return true;
+		}
+
+
+		// the caller keeps at most `entries` reads in flight, so the queue never overflows
+		void pushRead(int file, iovec* iov, u64 offset, u64 user_data)
+		{
+			const unsigned tail = *sq_tail;
+			const unsigned index = tail & sq_mask;
+			io_uring_sqe& sqe = sqes[index];
+			memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = IORING_OP_READV;
+			sqe.fd = file;
+			sqe.addr = (u64)(uintptr_t)iov;
+			sqe.len = 1;
+			sqe.off = offset;
+			sqe.user_data = user_data;
+			sq_array[index] = index;
+			__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+			++to_submit;
+		}
+
+
+		// submits queued reads and waits for at least one completion
+		bool submitAndWait()
+		{
+			for (;;)
+			{
+				const int res = (int)syscall(__NR_io_uring_enter, fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+				if (res >= 0)
+				{
+					to_submit -= (unsigned)res;
+					return true;
+				}
+				if (errno != EINTR) return false;
+			}
+		}
+
+
+		bool popCompletion(u64* user_data, int* res)
+		{
+			const unsigned head = *cq_head;
+			if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) return false;
+			const io_uring_cqe& cqe = cqes[head & cq_mask];
+			*user_data = cqe.user_data;
+			*res = cqe.res;
+			__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		int fd = -1;
+		unsigned entries = 0;
+		unsigned to_submit = 0;
+		u8* sq_ptr = nullptr;
+		u8* cq_ptr = nullptr;
+		size_t sq_size = 0;
+		size_t cq_size = 0;
+		size_t sqes_size = 0;
+		io_uring_sqe* sqes = nullptr;
+		unsigned* sq_tail = nullptr;
+		unsigned sq_mask = 0;
+		unsigned* sq_array = nullptr;
+		unsigned* cq_head = nullptr;
+		unsigned* cq_tail = nullptr;
+		unsigned cq_mask = 0;
+		io_uring_cqe* cqes = nullptr;
+	};
+#endif
+
+
+	struct FileReaderImpl
+	{
+		struct File
+		{
+			int index;
+			std::vector<u8> data;
+			bool ok;
+		};
+
+
+		FileReaderImpl(const char* const* _paths, int _count, const FileReadSettings& settings)
+			: paths(_paths)
+			, count(_count)
+			, queue_depth(std::max(settings.queue_depth, 1))
+		{
+		#ifdef __linux__
+			if (settings.backend != FileReadSettings::THREAD_POOL && ring.init((unsigned)queue_depth))
+			{
+				queue_depth = std::min(queue_depth, (int)ring.entries);
+				threads.push_back(startThread([this]() { readWithRing(); }));
+				return;
+			}
+		#endif
+			int thread_count = settings.thread_count > 0 ? settings.thread_count : std::max(queue_depth / 8, 1);
+			thread_count = std::min(thread_count, count);
+			for (int i = 0; i < thread_count; ++i) threads.push_back(startThread([this]() { readWithThread(); }));
+		}
+
+
+		~FileReaderImpl()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				cancelled = true;
+			}
+			room.notify_all();
+			for (std::thread& thread : threads) thread.join();
+		}
+
+
+		// blocks while the parsers are behind by queue_depth files, returns false if the reader is destroyed
+		bool waitForRoom()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			room.wait(lock, [&]() { return cancelled || (int)ready.size() + reading < queue_depth; });
+			if (cancelled) return false;
+			++reading;
+			return true;
+		}
+
+
+		void deliver(int index, std::vector<u8>* data, bool ok)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.push_back({index, std::vector<u8>(), ok});
+			ready.back().data.swap(*data);
+			--reading;
+			arrived.notify_one();
+		}
+
+
+		bool next(int* index, std::vector<u8>* data, bool* ok)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			arrived.wait(lock, [&]() { return !ready.empty() || handed_out == count; });
+			if (ready.empty()) return false;
+
+			File& file = ready.front();
+			*index = file.index;
+			*ok = file.ok;
+			data->swap(file.data);
+			ready.pop_front();
+			++handed_out;
+			if (handed_out == count) arrived.notify_all();
+			room.notify_one();
+			return true;
+		}
+
+
+	#ifndef _WIN32
+		// opens the file and sizes the buffer, returns -1 on failure; an empty file is a valid zero sized one
+		static int openFile(const char* path, std::vector<u8>* data)
+		{
+			const int file = open(path, O_RDONLY | O_CLOEXEC);
+			if (file < 0) return -1;
+			struct stat info;
+			if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size > INT_MAX)
+			{
+				close(file);
+				return -1;
+			}
+			data->resize((size_t)info.st_size);
+			return file;
+		}
+	#endif
+
+
+		static bool readFile(const char* path, std::vector<u8>* data)
+		{
+		#ifdef _WIN32
+			FILE* fp = fopen(path, "rb");
+			if (!fp) return false;
+			bool ok = fseek(fp, 0, SEEK_END) == 0;
+			const long size = ok ? ftell(fp) : -1;
+			ok = size >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+			if (ok)
+			{
+				data->resize((size_t)size);
+				ok = size == 0 || fread(data->data(), 1, (size_t)size, fp) == (size_t)size;
+			}
+			fclose(fp);
+			return ok;
+		#else
+			const int file = openFile(path, data);
+			if (file < 0) return false;
+			size_t offset = 0;
+			while (offset < data->size())
+			{
+				const ssize_t res = pread(file, data->data() + offset, data->size() - offset, (off_t)offset);
+				if (res < 0 && errno == EINTR) continue;
+				if (res <= 0) break;
+				offset += (size_t)res;
+			}
+			close(file);
+			return offset == data->size();
+		#endif
+		}
+
+
+		void readWithThread()
+		{
+			while (waitForRoom())
+			{
+				const int index = next_file++;
+				if (index >= count)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					--reading;
+					room.notify_all();
+					return;
+				}
+				std::vector<u8> data;
+				const bool ok = readFile(paths[index], &data);
+				if (!ok) data.clear();
+				deliver(index, &data, ok);
+			}
+		}
+
+
+	#ifdef __linux__
+		// keeps up to queue_depth reads in flight, a read returning less than asked for is resubmitted for the rest
+		void readWithRing()
+		{
+			struct Slot
+			{
+				int index;
+				int file;
+				std::vector<u8> data;
+				size_t offset;
+				iovec iov;
+			};
+
+			std::vector<Slot> slots(queue_depth);
+			std::vector<int> free_slots;
+			for (int i = queue_depth - 1; i >= 0; --i) free_slots.push_back(i);
+			int in_flight = 0;
+			bool stop = false;
+			bool ring_failed = false;
+
+			auto submit = [&](int slot_index) {
+				Slot& slot = slots[slot_index];
+				slot.iov.iov_base = slot.data.data() + slot.offset;
+				slot.iov.iov_len = slot.data.size() - slot.offset;
+				ring.pushRead(slot.file, &slot.iov, slot.offset, (u64)slot_index);
+			};
+			auto finish = [&](int slot_index, bool ok) {
+				Slot& slot = slots[slot_index];
+				close(slot.file);
+				if (!ok) slot.data.clear();
+				deliver(slot.index, &slot.data, ok);
+				free_slots.push_back(slot_index);
+				--in_flight;
+			};
+
+			for (;;)
+			{
+				// new files are only opened while there is room, completions are reaped regardless
+				while (!stop && !free_slots.empty() && next_file < count)
+				{
+					if (in_flight > 0)
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						if (cancelled) stop = true;
+						if (stop || (int)ready.size() + reading >= queue_depth) break;
+						++reading;
+					}
+					else if (!waitForRoom())
+					{
+						stop = true;
+						break;
+					}
+
+					const int index = next_file++;
+					const int slot_index = free_slots.back();
+					Slot& slot = slots[slot_index];
+					slot.index = index;
+					slot.offset = 0;
+					slot.file = openFile(paths[index], &slot.data);
+					if (slot.file < 0 || slot.data.empty())
+					{
+						if (slot.file >= 0) close(slot.file);
+						std::vector<u8> empty;
+						deliver(index, &empty, slot.file >= 0);
+						continue;
+					}
+					free_slots.pop_back();
+					++in_flight;
+					submit(slot_index);
+				}
+				if (in_flight == 0) break;
+
+				if (!ring.submitAndWait())
+				{
+					// the ring is unusable, every read in flight fails with it
+					for (int i = 0; i < queue_depth; ++i)
+					{
+						if (std::find(free_slots.begin(), free_slots.end(), i) == free_slots.end()) finish(i, false);
+					}
+					ring_failed = true;
+					break;
+				}
+
+				u64 user_data;
+				int res;
+				while (ring.popCompletion(&user_data, &res))
+				{
+					const int slot_index = (int)user_data;
+					Slot& slot = slots[slot_index];
+					if (res == -EINTR || res == -EAGAIN)
+					{
+						submit(slot_index);
+						continue;
+					}
+					if (res <= 0)
+					{
+						finish(slot_index, false);
+						continue;
+					}
+					slot.offset += (size_t)res;
+					if (slot.offset < slot.data.size())
+						submit(slot_index);
+					else
+						finish(slot_index, true);
+				}
+			}
+
+			// files not opened because the ring failed are read the slow way
+			if (ring_failed) readWithThread();
+		}
+
+		IoUring ring;
+	#endif
+
+
+		const char* const* paths;
+		const int count;
+		int queue_depth;
+		std::vector<std::thread> threads;
+		std::atomic<int> next_file{0};
+		std::mutex mutex;
+		std::condition_variable arrived;
+		std::condition_variable room;
+		std::deque<File> ready; // the rest is guarded by mutex
+		int reading = 0;
+		int handed_out = 0;
+		bool cancelled = false;
+	};
+
+
+	FileReader::FileReader(const char* const* paths, int count, const FileReadSettings& settings)
+		: impl(new FileReaderImpl(paths, count, settings))
+	{
+	}
+
+
+	FileReader::~FileReader() = default;
+
+
+	bool FileReader::next(int* index, std::vector<u8>* data, bool* ok)
+	{
+		return impl->next(index, data, ok);
+	}
+
+} // namespace ofbx
@@ -1,134 +1,341 @@
 #include "ofbxImp.h"
+#include <algorithm>
 
 namespace ofbx
 {
 
-	template <typename T>
-	static void generateIndices(
-		std::vector<int>* indices,
-		const std::vector<T>& data,
-		GeometryImpl::VertexDataMapping mapping,
-		const std::vector<int>& vertiex_indices)
+	ScratchArena::Scope::Scope(ScratchArena& _arena)
+		: arena(_arena)
+		, block(_arena.current)
+		, offset(_arena.offset)
+	{
+		++arena.depth;
+	}
+
+
+	ScratchArena::Scope::~Scope()
 	{
-		assert(indices);
-		assert(!data.empty());
-		assert(!vertiex_indices.empty());
+		arena.current = block;
+		arena.offset = offset;
+		--arena.depth;
 
-		if (!indices->empty())
+		// the last parse spilled into more blocks, merge them so the next one fits in a single block
+		if (arena.depth == 0 && arena.blocks.size() > 1)
 		{
-			assert(indices->size() == vertiex_indices.size());
+			size_t size = 0;
+			for (size_t block_size : arena.block_sizes) size += block_size;
+			arena.releaseMemory();
+			arena.reserve(size);
+		}
+	}
+
+
+	ScratchArena& ScratchArena::get()
+	{
+		static thread_local ScratchArena arena;
+		return arena;
+	}
+
+
+	void ScratchArena::reserve(size_t size)
+	{
+		size = (size + 7) & ~size_t(7);
+		if (current < (int)blocks.size() && offset + size <= block_sizes[current]) return;
+
+		// live allocations stay where they are, the reserved range starts in the next block big enough
+		for (int i = current + 1; i < (int)blocks.size(); ++i)
+		{
+			if (block_sizes[i] < size) continue;
+			current = i;
+			offset = 0;
 			return;
 		}
+		blocks.emplace_back(new u8[size]);
+		block_sizes.push_back(size);
+		current = (int)blocks.size() - 1;
+		offset = 0;
+	}
 
-		size_t count = vertiex_indices.size();
-		indices->resize(count);
-		if (mapping == GeometryImpl::BY_POLYGON_VERTEX)
+
+	void* ScratchArena::allocBytes(size_t size)
+	{
+		const size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+		// keeps every allocation 8 byte aligned
+		size = (size + 7) & ~size_t(7);
+		if (current >= (int)blocks.size() || offset + size > block_sizes[current]) reserve(std::max(size, MIN_BLOCK_SIZE));
+		void* ptr = blocks[current].get() + offset;
+		offset += size;
+		return ptr;
+	}
+
+
+	void ScratchArena::releaseMemory()
+	{
+		assert(depth == 0);
+		blocks.clear();
+		block_sizes.clear();
+		current = 0;
+		offset = 0;
+	}
+
+
+	void releaseScratchMemory()
+	{
+		ScratchArena::get().releaseMemory();
+	}
+
+
+	ThreadHooks g_thread_hooks;
+
+
+	void setThreadHooks(const ThreadHooks& hooks)
+	{
+		g_thread_hooks = hooks;
+	}
+
+
+	template <typename T>
+	static bool parseArray(ScratchArena& arena, const Property& property, ScratchArray<T>* out)
+	{
+		int elem_size = 1;
+		switch (property.type)
 		{
-			for (int i = 0; i < count; ++i)
+			case 'd': elem_size = 8; break;
+			case 'f': elem_size = 4; break;
+			case 'i': elem_size = 4; break;
+			default: return false;
+		}
+		if ((int)sizeof(T) < elem_size) return false;
+
+		out->size = int(getArrayCount(property) / (sizeof(T) / elem_size));
+		out->data = arena.alloc<T>(out->size);
+		return parseBinaryArrayRaw(property, out->data, int(sizeof(T) * out->size));
+	}
+
+
+	// like parseDoubleVecData, float arrays are widened to double
+	template <typename T>
+	static bool parseDoubleVecArray(ScratchArena& arena, const Property& property, ScratchArray<T>* out)
+	{
+		if (property.type == 'd') return parseArray(arena, property, out);
+		if (property.type != 'f') return false;
+
+		const int elem_count = sizeof(T) / sizeof(double);
+		out->size = (int)getArrayCount(property) / elem_count;
+		out->data = arena.alloc<T>(out->size);
+
+		ScratchArena::Scope scope(arena);
+		ScratchArray<float> tmp;
+		if (!parseArray(arena, property, &tmp)) return false;
+		double* dst = &out->data[0].x;
+		for (int i = 0, c = out->size * elem_count; i < c; ++i) dst[i] = tmp[i];
+		return true;
+	}
+
+
+	// polygon vertices of the geometry, polygons are [starts[i], starts[i + 1])
+	struct PolygonVertices
+	{
+		ScratchArray<int> control_points;
+		ScratchArray<int> starts;
+		const int* identity = nullptr;
+	};
+
+
+	// attribute values as stored in the file and the value index of every polygon vertex
+	template <typename T>
+	struct RawLayer
+	{
+		DataView name;
+		ScratchArray<T> data;
+		const int* indices = nullptr;
+	};
+
+
+	template <typename T>
+	static bool parseLayer(ScratchArena& arena,
+		const Element& element,
+		const char* name,
+		const char* index_name,
+		PolygonVertices* polygon_vertices,
+		RawLayer<T>* layer)
+	{
+		const Element* data_element = findChild(element, name);
+		if (!data_element || !data_element->first_property) return false;
+
+		GeometryImpl::VertexDataMapping mapping = GeometryImpl::BY_POLYGON_VERTEX;
+		const Element* indices_element;
+		if (!parseVertexDataLayout(element, index_name, &mapping, &indices_element)) return false;
+		if (!parseDoubleVecArray(arena, *data_element->first_property, &layer->data)) return false;
+
+		const ScratchArray<int>& control_points = polygon_vertices->control_points;
+		if (indices_element)
+		{
+			ScratchArray<int> indices;
+			if (!parseArray(arena, *indices_element->first_property, &indices)) return false;
+			if (indices.size == control_points.size)
+			{
+				layer->indices = indices.data;
+				return true;
+			}
+			if (mapping != GeometryImpl::BY_VERTEX) return false;
+
+			// indexed by control point
+			int* per_polygon_vertex = arena.alloc<int>(control_points.size);
+			for (int i = 0; i < control_points.size; ++i)
 			{
-				(*indices)[i] = i;
+				const int control_point = control_points[i];
+				per_polygon_vertex[i] = control_point < indices.size ? indices[control_point] : -1;
 			}
+			layer->indices = per_polygon_vertex;
+			return true;
 		}
-		else if (mapping == GeometryImpl::BY_VERTEX)
+
+		switch (mapping)
 		{
-			memcpy(&(*indices)[0], &vertiex_indices[0], sizeof(vertiex_indices[0]) * count);
-		}
-		else {
-			assert(false);
+			case GeometryImpl::BY_POLYGON_VERTEX:
+				if (!polygon_vertices->identity)
+				{
+					int* identity = arena.alloc<int>(control_points.size);
+					for (int i = 0; i < control_points.size; ++i) identity[i] = i;
+					polygon_vertices->identity = identity;
+				}
+				layer->indices = polygon_vertices->identity;
+				break;
+			case GeometryImpl::BY_VERTEX: layer->indices = control_points.data; break;
+			default:
+			{
+				assert(false);
+				int* zeros = arena.alloc<int>(control_points.size);
+				memset(zeros, 0, sizeof(zeros[0]) * control_points.size);
+				layer->indices = zeros;
+				break;
+			}
 		}
+		return true;
 	}
 
 
-	class VertexData {
-		int pos;
-		int nrm;
-		int tan;
-		int clr;
-		int uv;
-
-	public:
-		VertexData() {}
+	template <typename T>
+	static bool parseLayers(ScratchArena& arena,
+		const Element& element,
+		const char* layer_name,
+		const char* name,
+		const char* index_name,
+		PolygonVertices* polygon_vertices,
+		ScratchArray<RawLayer<T>>* layers)
+	{
+		int count = 0;
+		for (const Element* layer = element.child; layer; layer = layer->sibling)
+		{
+			if (layer->id == layer_name) ++count;
+		}
+		layers->data = arena.alloc<RawLayer<T>>(count);
+		layers->size = 0;
 
-		enum EXCLUDE {
-			EXCLUDE_VERTEX  = 0x01,
-			EXCLUDE_NORMAL  = 0x02,
-			EXCLUDE_TANGENT = 0x04,
-			EXCLUDE_COLOR   = 0x08,
-			EXCLUDE_UV		= 0x10,
-		};
+		for (const Element* layer = element.child; layer; layer = layer->sibling)
+		{
+			if (layer->id != layer_name) continue;
 
-		VertexData(const GeometryImpl& geom, size_t index, int mask) {
-			pos = geom.vertex_indices.empty() || (mask&EXCLUDE_VERTEX) ?
-				-1 : geom.vertex_indices[index];
+			RawLayer<T>& out = (*layers)[layers->size];
+			out = RawLayer<T>();
+			const Element* name_element = findChild(*layer, "Name");
+			if (name_element && name_element->first_property) out.name = name_element->first_property->value;
 
-			nrm = geom.normal_indices.empty() || (mask&EXCLUDE_NORMAL) ?
-				-1 : geom.normal_indices[index];
+			if (!parseLayer(arena, *layer, name, index_name, polygon_vertices, &out)) return false;
+			if (out.data.size > 0) ++layers->size;
+		}
+		return true;
+	}
 
-			tan = geom.tangent_indices.empty() || (mask&EXCLUDE_TANGENT) ?
-				-1 : geom.tangent_indices[index];
 
-			clr = geom.color_indices.empty() || (mask&EXCLUDE_COLOR) ?
-				-1 : geom.color_indices[index];
+	// attribute index streams (one int per polygon vertex) which together with the control point
+	// define a unique rendering vertex
+	struct VertexKey
+	{
+		VertexKey(ScratchArena& arena, int max_count)
+			: streams(arena.alloc<const int*>(max_count))
+		{
+		}
 
-			uv =  geom.uv_indices.empty() || (mask&EXCLUDE_UV) ?
-				-1 : geom.uv_indices[index];
+		template <typename T>
+		void add(const RawLayer<T>& layer)
+		{
+			if (layer.data.size > 0) streams[count++] = layer.indices;
 		}
 
-		// overload operator==
-		bool operator!=(const VertexData& p) {
-			return this->pos != p.pos ||
-				this->nrm != p.nrm ||
-				this->tan != p.tan ||
-				this->clr != p.clr ||
-				this->uv != p.uv;
+		bool equal(int a, int b) const
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				if (streams[i][a] != streams[i][b]) return false;
+			}
+			return true;
 		}
+
+		const int** streams;
+		int count = 0;
 	};
 
 
 	template <typename T>
-	static void expand(std::vector<T>& data, std::vector<int>& indices, const GeometryImpl& geom, int mask)
+	static void gatherForRendering(std::vector<T>* out, const RawLayer<T>& layer, const int* first_use, int vertex_count)
 	{
-		std::unordered_map<size_t, VertexData> map;
-		std::unordered_map<size_t, VertexData>::iterator it;
+		if (layer.data.size == 0) return;
 
-		const size_t count = indices.size();
-		map.reserve(count);
+		out->resize(vertex_count);
+		for (int i = 0; i < vertex_count; ++i)
+		{
+			const int src = first_use[i];
+			const int idx = src < 0 ? -1 : layer.indices[src];
+			(*out)[i] = idx < 0 || idx >= layer.data.size ? T() : layer.data[idx];
+		}
+	}
 
-		VertexData vtx(geom, 0, mask);
-		map[indices[0]] = vtx;
 
-		for (size_t i = 1; i < count; ++i) {
-			size_t idx = indices[i];
-			VertexData vtx(geom, i, mask);
-			it = map.find(idx);
-			if (it == map.end()) {
-				map[idx] = vtx;
+	// upper bound of the scratch memory parseGeometryForRendering needs, so it's reserved at once
+	static size_t getArraysScratchSize(const Element& element, int polygon_vertex_count)
+	{
+		size_t size = 0;
+		for (const Element* child = element.child; child; child = child->sibling)
+		{
+			const Property* prop = child->first_property;
+			if (prop)
+			{
+				switch (prop->type)
+				{
+					case 'd': size += getArrayCount(*prop) * sizeof(double) + 8; break;
+					case 'i': size += getArrayCount(*prop) * sizeof(int) + 8; break;
+					// widened to double
+					case 'f': size += getArrayCount(*prop) * (sizeof(float) + sizeof(double)) + 16; break;
+					default: break;
+				}
 			}
-			else if (it->second != vtx) {
-				// expand data
-				int new_idx = (int)data.size();
-				data.push_back(data[idx]);
-				indices[i] = new_idx;
-				map[new_idx] = vtx;
+			// index array per polygon vertex, if the layer has none or it's indexed by control point
+			if (child->id.begin && child->id.end - child->id.begin > 12 && memcmp(child->id.begin, "LayerElement", 12) == 0)
+			{
+				size += polygon_vertex_count * sizeof(int) + sizeof(RawLayer<Vec4>) + 16;
 			}
+			size += getArraysScratchSize(*child, polygon_vertex_count);
 		}
+		return size;
 	}
 
-	template <typename T>
-	static void remapForRendering(std::vector<T>* out, const std::vector<int>& indices, const std::vector<int>& mapping)
-	{
-		if (out->empty()) return;
 
-		std::vector<T> old(*out);
-		for (size_t i = 0, c = indices.size(); i < c; ++i)
-		{
-			const int idx = mapping[i];
-			const int ref = indices[i];
-			(*out)[idx] = old[ref];
-		}
+	static size_t getScratchSize(const Element& element, int control_point_count, int polygon_vertex_count)
+	{
+		const size_t P = polygon_vertex_count;
+		const size_t C = control_point_count;
+		size_t size = getArraysScratchSize(element, polygon_vertex_count);
+		size += P * sizeof(int) * 4; // control points, polygon starts, identity, rendering vertex
+		size += P * sizeof(int) * 3; // triangles
+		size += (C + P) * sizeof(int) * 2; // first use, next vertex
+		return size + 1024;
 	}
 
-	OptionalError<Object*> parseGeometryForRendering(const Scene& scene, const Element& element)
+
+	OptionalError<Object*> parseGeometryForRendering(const Scene& scene, const Element& element, int thread_count)
 	{
 		assert(element.first_property);
 
@@ -139,13 +346,54 @@ namespace ofbx
 		if (!polys_element || !polys_element->first_property) return Error("Indices missing");
 
 		std::unique_ptr<GeometryImpl> geom = std::make_unique<GeometryImpl>(scene, element);
+		GeometryImpl::Data& data = *geom->data;
+
+		// temporaries come from the thread's scratch arena, only data's final streams are heap allocated
+		ScratchArena& arena = ScratchArena::get();
+		ScratchArena::Scope scope(arena);
+		arena.reserve(getScratchSize(element, getArrayCount(*vertices_element->first_property) / 3, getArrayCount(*polys_element->first_property)));
+
+		ScratchArray<Vec3> control_points;
+		if (!parseDoubleVecArray(arena, *vertices_element->first_property, &control_points)) return Error("Failed to parse vertices");
+
+		// negative index ends a polygon
+		ScratchArray<int> polygon_indices;
+		if (!parseArray(arena, *polys_element->first_property, &polygon_indices)) return Error("Failed to parse indices");
+
+		const int polygon_vertex_count = polygon_indices.size;
+		PolygonVertices polygon_vertices;
+		polygon_vertices.control_points.data = arena.alloc<int>(polygon_vertex_count);
+		polygon_vertices.control_points.size = polygon_vertex_count;
+		polygon_vertices.starts.data = arena.alloc<int>(polygon_vertex_count + 1);
+		ScratchArray<int>& starts = polygon_vertices.starts;
+		starts[0] = 0;
+		int triangle_count = 0;
+		for (int i = 0; i < polygon_vertex_count; ++i)
+		{
+			const int idx = polygon_indices[i];
+			polygon_vertices.control_points[i] = idx < 0 ? -idx - 1 : idx;
+			if (idx >= 0 && i + 1 < polygon_vertex_count) continue;
+
+			const int size = i + 1 - starts[starts.size];
+			if (size >= 3) triangle_count += size - 2;
+			++starts.size;
+			starts[starts.size] = i + 1;
+		}
 
-		if (!parseDoubleVecData(*vertices_element->first_property, &geom->vertices)) return Error("Failed to parse vertices");
-
-		if (!parseBinaryArray(*polys_element->first_property, &geom->vertex_indices)) return Error("Failed to parse indices");
-
-		std::vector<int> to_old_indices;
-		geom->triangulate(geom->vertex_indices, &geom->triangles, &to_old_indices);
+		// fan triangulation, indices into polygon vertices
+		int* to_old_indices = arena.alloc<int>(triangle_count * 3);
+		int* to_old_index = to_old_indices;
+		for (int poly = 0; poly < starts.size; ++poly)
+		{
+			const int from = starts[poly];
+			for (int i = from + 2; i < starts[poly + 1]; ++i)
+			{
+				to_old_index[0] = from;
+				to_old_index[1] = i - 1;
+				to_old_index[2] = i;
+				to_old_index += 3;
+			}
+		}
 
 		const Element* layer_material_element = findChild(element, "LayerElementMaterial");
 		if (layer_material_element)
@@ -153,28 +401,24 @@ namespace ofbx
 			const Element* mapping_element = findChild(*layer_material_element, "MappingInformationType");
 			const Element* reference_element = findChild(*layer_material_element, "ReferenceInformationType");
 
-			std::vector<int> tmp;
-
 			if (!mapping_element || !reference_element) return Error("Invalid LayerElementMaterial");
 
 			if (mapping_element->first_property->value == "ByPolygon" &&
 				reference_element->first_property->value == "IndexToDirect")
 			{
-				geom->materials.reserve(geom->vertices.size() / 3);
-				for (int& i : geom->materials) i = -1;
-
 				const Element* indices_element = findChild(*layer_material_element, "Materials");
 				if (!indices_element || !indices_element->first_property) return Error("Invalid LayerElementMaterial");
 
-				if (!parseBinaryArray(*indices_element->first_property, &tmp)) return Error("Failed to parse material indices");
+				ScratchArray<int> polygon_materials;
+				if (!parseArray(arena, *indices_element->first_property, &polygon_materials)) return Error("Failed to parse material indices");
 
-				int tmp_i = 0;
-				for (int poly = 0, c = (int)tmp.size(); poly < c; ++poly)
+				data.materials.reserve(triangle_count);
+				for (int poly = 0, c = std::min(polygon_materials.size, starts.size); poly < c; ++poly)
 				{
-					int tri_count = getTriCountFromPoly(geom->vertex_indices, &tmp_i);
+					const int tri_count = starts[poly + 1] - starts[poly] - 2;
 					for (int i = 0; i < tri_count; ++i)
 					{
-						geom->materials.push_back(tmp[poly]);
+						data.materials.push_back(polygon_materials[poly]);
 					}
 				}
 			}
@@ -183,84 +427,189 @@ namespace ofbx
 				if (mapping_element->first_property->value != "AllSame") return Error("Mapping not supported");
 			}
 		}
-		
-		size_t max_count = geom->vertices.size();
-		const Element* layer_uv_element = findChild(element, "LayerElementUV");
-		GeometryImpl::VertexDataMapping mapping;
-		if (layer_uv_element)
-		{
-			if (!parseVertexData(*layer_uv_element, "UV", "UVIndex", &geom->uvs, &geom->uv_indices, &mapping))
-				return Error("Invalid UVs");
-			generateIndices(&geom->uv_indices, geom->uvs, mapping, geom->vertex_indices);
-		}
 
+		ScratchArray<RawLayer<Vec2>> uvs;
+		if (!parseLayers(arena, element, "LayerElementUV", "UV", "UVIndex", &polygon_vertices, &uvs))
+			return Error("Invalid UVs");
+
+		RawLayer<Vec3> tangents;
 		const Element* layer_tangent_element = findChild(element, "LayerElementTangents");
 		if (layer_tangent_element)
 		{
 			if (findChild(*layer_tangent_element, "Tangents"))
 			{
-				if (!parseVertexData(*layer_tangent_element, "Tangents", "TangentsIndex", &geom->tangents, &geom->tangent_indices, &mapping))
+				if (!parseLayer(arena, *layer_tangent_element, "Tangents", "TangentsIndex", &polygon_vertices, &tangents))
 					return Error("Invalid tangets");
 			}
 			else
 			{
-				if (!parseVertexData(*layer_tangent_element, "Tangent", "TangentIndex", &geom->tangents, &geom->tangent_indices, &mapping))
+				if (!parseLayer(arena, *layer_tangent_element, "Tangent", "TangentIndex", &polygon_vertices, &tangents))
 					return Error("Invalid tangets");
 			}
-			generateIndices(&geom->tangent_indices, geom->tangents, mapping, geom->vertex_indices);
 		}
 
-		const Element* layer_color_element = findChild(element, "LayerElementColor");
-		if (layer_color_element)
-		{
-			if (!parseVertexData(*layer_color_element, "Colors", "ColorIndex", &geom->colors, &geom->color_indices, &mapping))
-				return Error("Invalid colors");
-			generateIndices(&geom->color_indices, geom->colors, mapping, geom->vertex_indices);
-		}
+		ScratchArray<RawLayer<Vec4>> colors;
+		if (!parseLayers(arena, element, "LayerElementColor", "Colors", "ColorIndex", &polygon_vertices, &colors))
+			return Error("Invalid colors");
 
+		RawLayer<Vec3> normals;
 		const Element* layer_normal_element = findChild(element, "LayerElementNormal");
 		if (layer_normal_element)
 		{
-			if (!parseVertexData(*layer_normal_element, "Normals", "NormalsIndex", &geom->normals, &geom->normal_indices, &mapping))
+			if (!parseLayer(arena, *layer_normal_element, "Normals", "NormalsIndex", &polygon_vertices, &normals))
 				return Error("Invalid normals");
-			generateIndices(&geom->normal_indices, geom->normals, mapping, geom->vertex_indices);
 		}
 
-		// remap attributes to align vertex indices and expand buffer for rendering
-		const GeometryImpl& geomImpl = *geom.get();
-		expand(geom->vertices, geom->vertex_indices, geomImpl, VertexData::EXCLUDE_VERTEX);
+		// coordinate conversion goes over the raw arrays, which are at most as long as the rendering streams
+		const Scene::Conversion& conversion = scene.m_conversion;
+		if (conversion.enabled)
+		{
+			transformPoints(conversion.matrix, control_points.data, control_points.size);
+			transformVectors(conversion.axes, normals.data.data, normals.data.size, false);
+			transformVectors(conversion.axes, tangents.data.data, tangents.data.size, false);
+		}
+
+		// lightmap UVs are one more indexed layer, so their chart seams split vertices in the unification below
+		std::vector<Vec2> lightmap_uvs;
+		std::vector<int> lightmap_indices;
+		if (scene.m_settings.lightmap_uvs)
+		{
+			for (int i = 0; i < polygon_vertex_count; ++i)
+			{
+				const int vertex = polygon_vertices.control_points[i];
+				if (vertex < 0 || vertex >= control_points.size) return Error("Invalid vertex index");
+			}
+			generateLightmapUVs(control_points.data,
+				polygon_vertices.control_points.data,
+				starts.data,
+				starts.size,
+				control_points.size,
+				scene.m_settings.lightmap,
+				thread_count,
+				conversion.flip_winding,
+				&lightmap_uvs,
+				&lightmap_indices);
+
+			static const char LIGHTMAP_NAME[] = "Lightmap";
+			ScratchArray<RawLayer<Vec2>> all_uvs;
+			all_uvs.data = arena.alloc<RawLayer<Vec2>>(uvs.size + 1);
+			all_uvs.size = uvs.size + 1;
+			for (int i = 0; i < uvs.size; ++i) all_uvs[i] = uvs[i];
+			RawLayer<Vec2>& lightmap = all_uvs[uvs.size];
+			lightmap = RawLayer<Vec2>();
+			lightmap.name.begin = (const u8*)LIGHTMAP_NAME;
+			lightmap.name.end = (const u8*)LIGHTMAP_NAME + sizeof(LIGHTMAP_NAME) - 1;
+			lightmap.data.data = lightmap_uvs.data();
+			lightmap.data.size = (int)lightmap_uvs.size();
+			lightmap.indices = lightmap_indices.data();
+			uvs = all_uvs;
+		}
+
+		// unify all attributes in one pass: polygon vertices sharing the control point and every attribute index
+		// share a rendering vertex, the first one keeps the control point's index, others are appended
+		VertexKey key(arena, 2 + uvs.size + colors.size);
+		key.add(normals);
+		key.add(tangents);
+		for (const RawLayer<Vec2>& layer : uvs) key.add(layer);
+		for (const RawLayer<Vec4>& layer : colors) key.add(layer);
+
+		const int control_point_count = control_points.size;
+		int* first_use = arena.alloc<int>(control_point_count + polygon_vertex_count);
+		int* next_vertex = arena.alloc<int>(control_point_count + polygon_vertex_count);
+		int* rendering_vertex = arena.alloc<int>(polygon_vertex_count);
+		for (int i = 0; i < control_point_count; ++i)
+		{
+			first_use[i] = -1;
+			next_vertex[i] = -1;
+		}
+		int vertex_count = control_point_count;
+		for (int i = 0; i < polygon_vertex_count; ++i)
+		{
+			int vertex = polygon_vertices.control_points[i];
+			if (vertex < 0 || vertex >= control_point_count) return Error("Invalid vertex index");
+			if (first_use[vertex] < 0)
+			{
+				first_use[vertex] = i;
+				rendering_vertex[i] = vertex;
+				continue;
+			}
 
-		if (!geom->normals.empty()) {
-			expand(geom->normals, geom->normal_indices, geomImpl, VertexData::EXCLUDE_NORMAL);
-			// remap other attributes by vertex indices
-			remapForRendering(&geom->normals, geom->normal_indices, geom->vertex_indices);
+			for (;;)
+			{
+				if (key.equal(i, first_use[vertex])) break;
+				if (next_vertex[vertex] < 0)
+				{
+					next_vertex[vertex] = vertex_count;
+					vertex = vertex_count;
+					first_use[vertex_count] = i;
+					next_vertex[vertex_count] = -1;
+					++vertex_count;
+					break;
+				}
+				vertex = next_vertex[vertex];
+			}
+			rendering_vertex[i] = vertex;
 		}
 
-		if (!geom->tangents.empty()) {
-			expand(geom->tangents, geom->tangent_indices, geomImpl, VertexData::EXCLUDE_TANGENT);
-			// remap other attributes by vertex indices
-			remapForRendering(&geom->tangents, geom->tangent_indices, geom->vertex_indices);
+		// rendering vertex <-> control point, used to map clusters and shapes onto the expanded vertices
+		data.to_old_vertices.resize(vertex_count);
+		data.to_new_vertices.resize(control_point_count);
+		for (int i = 0; i < control_point_count; ++i)
+		{
+			data.to_old_vertices[i] = i;
+			GeometryImpl::NewVertex* vtx = &data.to_new_vertices[i];
+			vtx->index = i;
+			for (int next = next_vertex[i]; next >= 0; next = next_vertex[next])
+			{
+				data.to_old_vertices[next] = i;
+				vtx->next = new GeometryImpl::NewVertex;
+				vtx = vtx->next;
+				vtx->index = next;
+			}
 		}
 
-		if (!geom->colors.empty()) {
-			expand(geom->colors, geom->color_indices, geomImpl, VertexData::EXCLUDE_COLOR);
-			// remap other attributes by vertex indices
-			remapForRendering(&geom->colors, geom->color_indices, geom->vertex_indices);
+		data.vertices.resize(vertex_count);
+		for (int i = 0; i < vertex_count; ++i)
+		{
+			data.vertices[i] = control_points[data.to_old_vertices[i]];
+		}
+		gatherForRendering(&data.normals, normals, first_use, vertex_count);
+		gatherForRendering(&data.tangents, tangents, first_use, vertex_count);
+		data.uvs.resize(uvs.size);
+		for (int i = 0; i < uvs.size; ++i)
+		{
+			data.uvs[i].name = uvs[i].name;
+			gatherForRendering(&data.uvs[i].data, uvs[i], first_use, vertex_count);
+		}
+		data.colors.resize(colors.size);
+		for (int i = 0; i < colors.size; ++i)
+		{
+			data.colors[i].name = colors[i].name;
+			gatherForRendering(&data.colors[i].data, colors[i], first_use, vertex_count);
 		}
 
-		if (!geom->uvs.empty()) {
-			expand(geom->uvs, geom->uv_indices, geomImpl, VertexData::EXCLUDE_UV);
-			// remap other attributes by vertex indices
-			remapForRendering(&geom->uvs, geom->uv_indices, geom->vertex_indices);
+		// mirroring conversions flip the winding, so front faces stay front faces
+		const int second = conversion.flip_winding ? 2 : 1;
+		data.triangles.resize(triangle_count * 3);
+		for (int i = 0, c = triangle_count * 3; i < c; i += 3)
+		{
+			data.triangles[i] = rendering_vertex[to_old_indices[i]];
+			data.triangles[i + 1] = rendering_vertex[to_old_indices[i + second]];
+			data.triangles[i + 2] = rendering_vertex[to_old_indices[i + 3 - second]];
 		}
 
-		// remap triangle indices
-		size_t count = geom->triangles.size();
-		for (int i = 0; i < count; ++i) {
-			geom->triangles[i] = geom->vertex_indices[to_old_indices[i]];
+		if (scene.m_settings.adjacency)
+		{
+			buildAdjacency(polygon_vertices.control_points.data,
+				rendering_vertex,
+				starts.data,
+				starts.size,
+				control_point_count,
+				&data.adjacency);
 		}
+		if (scene.m_settings.clean_meshes) cleanupGeometry(&data);
 
 		return geom.release();
 	}
 
-}//namespace
+} // namespace ofbx
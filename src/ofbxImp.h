@@ -2,8 +2,16 @@
 
 #include "ofbx.h"
 #include <cassert>
+#include <cstring>
 #include <unordered_map>
 #include <memory>
+#include <atomic>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define OFBX_SSE2
+	#include <emmintrin.h>
+#endif
 
 namespace ofbx
 {
@@ -32,7 +40,8 @@ namespace ofbx
 		Error() {}
 		Error(const char* msg) { s_message = msg; }
 
-		static const char* s_message;
+		// per thread, loads can run in parallel
+		static thread_local const char* s_message;
 	};
 
 
@@ -146,6 +155,9 @@ namespace ofbx
 	};
 
 
+	// resolved texture files and the prefetch threads reading them, shared by clones
+	struct TextureFiles;
+
 	struct Scene : IScene
 	{
 		struct Connection
@@ -168,6 +180,29 @@ namespace ofbx
 			Object* object;
 		};
 
+		// LoadSettings::convert_coordinates, target = matrix * source
+		struct Conversion
+		{
+			void init(const GlobalSettings& source, const GlobalSettings& target);
+			// transform expressed in target space
+			Matrix convert(const Matrix& mtx) const;
+
+			bool enabled = false;
+			bool flip_winding = false;
+			Matrix matrix; // axes and unit scale
+			Matrix inverse;
+			Matrix axes; // without scale, for normals and tangents
+		};
+
+		// source bytes and the element tree pointing into them, immutable and shared by clones
+		struct Document
+		{
+			~Document();
+
+			std::vector<u8> data;
+			Element* root = nullptr;
+		};
+
 
 		int getAnimationStackCount() const { return (int)m_animation_stacks.size(); }
 		int getMeshCount() const override { return (int)m_meshes.size(); }
@@ -177,6 +212,7 @@ namespace ofbx
 
 
 		int getAllObjectCount() const override { return (int)m_all_objects.size(); }
+		const LoadStats& getLoadStats() const override { return m_load_stats; }
 
 
 		const AnimationStack* getAnimationStack(int index) const override
@@ -207,11 +243,19 @@ namespace ofbx
 
 		const IElement* getRootElement() const override { return m_root_element; }
 		const Object* getRoot() const override { return m_root; }
+		const GlobalSettings& getGlobalSettings() const override { return m_global_settings; }
+		int getTextureFileCount() const override;
+		const TextureFile& getTextureFile(int index) const override;
+		const TextureFile* getTextureFile(const Texture& texture) const override;
+
+		IScene* clone() const override { return clone(m_settings); }
+		IScene* clone(const LoadSettings& settings) const override;
 
 		void destroy() override { delete this; }
 
 		virtual ~Scene();
 		
+		std::shared_ptr<const Document> m_document;
 		Element* m_root_element = nullptr;
 		Root* m_root = nullptr;
 		std::unordered_map<u64, ObjectPair> m_object_map;
@@ -219,8 +263,12 @@ namespace ofbx
 		std::vector<Mesh*> m_meshes;
 		std::vector<AnimationStack*> m_animation_stacks;
 		std::vector<Connection> m_connections;
-		std::vector<u8> m_data;
 		std::vector<TakeInfo> m_take_infos;
+		LoadSettings m_settings;
+		LoadStats m_load_stats;
+		GlobalSettings m_global_settings;
+		Conversion m_conversion;
+		std::shared_ptr<TextureFiles> m_texture_files;
 	};
 
 
@@ -235,52 +283,99 @@ namespace ofbx
 
 		struct NewVertex
 		{
+			NewVertex() {}
+			NewVertex(const NewVertex& rhs)
+				: index(rhs.index)
+				, next(rhs.next ? new NewVertex(*rhs.next) : nullptr)
+			{
+			}
 			~NewVertex() { delete next; }
+			void operator=(const NewVertex&) = delete;
 
 			int index = -1;
 			NewVertex* next = nullptr;
 		};
 
-		std::vector<Vec3> vertices;
-		std::vector<Vec3> normals;
+		template <typename T>
+		struct VertexLayer
+		{
+			DataView name;
+			std::vector<T> data;
+		};
 
-		// only support one uv coordinate
-		std::vector<Vec2> uvs;
-		std::vector<Vec4> colors;
-		std::vector<Vec3> tangents;
-		std::vector<int> materials;
+		// everything parsed from the geometry element, shared by clones of the scene
+		struct Data
+		{
+			std::vector<Vec3> vertices;
+			std::vector<Vec3> normals;
 
-		const Skin* skin = nullptr;
+			// one entry per LayerElementUV / LayerElementColor, in file order
+			std::vector<VertexLayer<Vec2>> uvs;
+			std::vector<VertexLayer<Vec4>> colors;
+			std::vector<Vec3> tangents;
+			std::vector<int> materials;
 
-		std::vector<int> to_old_vertices;
-		std::vector<NewVertex> to_new_vertices;
+			std::vector<int> to_old_vertices;
+			std::vector<NewVertex> to_new_vertices;
 
-		std::vector<int> vertex_indices;
-		std::vector<int> normal_indices;
-		std::vector<int> uv_indices;
-		std::vector<int> color_indices;
-		std::vector<int> tangent_indices;
-		std::vector<int> triangles;
+			std::vector<int> triangles;
+
+			// empty unless LoadSettings::adjacency is set
+			Adjacency adjacency;
+			CleanupReport cleanup_report;
+		};
+
+		std::shared_ptr<Data> data;
+		const Skin* skin = nullptr;
+		const BlendShape* blend_shape = nullptr;
+		// depends on LoadSettings::bone_palette_size, replaced as a whole when a clone uses another one
+		std::shared_ptr<const std::vector<SkinPartition>> skin_partitions;
+		// depends on LoadSettings::bone_bounds_min_weight, shared with clones the same way
+		std::shared_ptr<const std::vector<BoneBounds>> bone_bounds;
 
 		GeometryImpl(const Scene& _scene, const IElement& _element)
 			: Geometry(_scene, _element)
+			, data(std::make_shared<Data>())
 		{
 		}
 
 
 		Type getType() const override { return Type::GEOMETRY; }
 
-		const std::vector<Vec3>& getVertices() const override { return vertices; }
-		const std::vector<Vec3>& getNormals() const override { return normals; }
-		const std::vector<Vec2>& getUVs() const override { return uvs; }
-		const std::vector<Vec4>& getColors() const override { return colors; }
-		const std::vector<Vec3>& getTangents() const override { return tangents; }
+		const std::vector<Vec3>& getVertices() const override { return data->vertices; }
+		const std::vector<Vec3>& getNormals() const override { return data->normals; }
+		const std::vector<Vec2>& getUVs(int index) const override
+		{
+			static const std::vector<Vec2> empty;
+			return index < (int)data->uvs.size() ? data->uvs[index].data : empty;
+		}
+		int getUVSetCount() const override { return (int)data->uvs.size(); }
+		DataView getUVSetName(int index) const override { return data->uvs[index].name; }
+		const std::vector<Vec4>& getColors(int index) const override
+		{
+			static const std::vector<Vec4> empty;
+			return index < (int)data->colors.size() ? data->colors[index].data : empty;
+		}
+		int getColorSetCount() const override { return (int)data->colors.size(); }
+		DataView getColorSetName(int index) const override { return data->colors[index].name; }
+		const std::vector<Vec3>& getTangents() const override { return data->tangents; }
+		const std::vector<int>& getVertexControlPoints() const override { return data->to_old_vertices; }
+		int getControlPointCount() const override { return (int)data->to_new_vertices.size(); }
 
 		const Skin* getSkin() const override { return skin; }
-		const int* getMaterials() const override { return materials.empty() ? nullptr : &materials[0]; }
+		int getSkinPartitionCount() const override { return skin_partitions ? (int)skin_partitions->size() : 0; }
+		const SkinPartition& getSkinPartition(int idx) const override { return (*skin_partitions)[idx]; }
+		const BlendShape* getBlendShape() const override { return blend_shape; }
+		const int* getMaterials() const override { return data->materials.empty() ? nullptr : &data->materials[0]; }
+		const CleanupReport& getCleanupReport() const override { return data->cleanup_report; }
+		const BoneBounds* getBoneBounds() const override { return bone_bounds ? bone_bounds->data() : nullptr; }
+		const Adjacency* getAdjacency() const override
+		{
+			return data->adjacency.polygon_starts.empty() ? nullptr : &data->adjacency;
+		}
 
-		const std::vector<int>& getTriangles() const override { return triangles; }
-		size_t getTriangleCount() const override { return triangles.size() / 3; }
+		const std::vector<int>& getTriangles() const override { return data->triangles; }
+		size_t getTriangleCount() const override { return data->triangles.size() / 3; }
 
 		void triangulate(std::vector<int>& old_indices, std::vector<int>* indices, std::vector<int>* to_old)
 		{
@@ -320,6 +415,49 @@ namespace ofbx
 		}
 	};
 
+	// bump allocator for parsing temporaries, one per thread. Everything allocated inside a Scope is released
+	// when the scope ends, the memory is kept for the next parse, see releaseScratchMemory()
+	struct ScratchArena
+	{
+		struct Scope
+		{
+			explicit Scope(ScratchArena& _arena);
+			~Scope();
+
+			ScratchArena& arena;
+			int block;
+			size_t offset;
+		};
+
+		static ScratchArena& get();
+
+		// the next allocations totalling up to `size` bytes won't touch the heap
+		void reserve(size_t size);
+		// uninitialized, T must be trivially destructible
+		template <typename T> T* alloc(int count) { return (T*)allocBytes(sizeof(T) * count); }
+		void releaseMemory();
+		void* allocBytes(size_t size);
+
+		std::vector<std::unique_ptr<u8[]>> blocks;
+		std::vector<size_t> block_sizes;
+		int current = 0;
+		size_t offset = 0;
+		int depth = 0;
+	};
+
+	template <typename T>
+	struct ScratchArray
+	{
+		T& operator[](int i) const { return data[i]; }
+		T* begin() const { return data; }
+		T* end() const { return data + size; }
+
+		T* data = nullptr;
+		int size = 0;
+	};
+
+	const Element* findChild(const Element& element, const char* id);
+
 	inline u32 getArrayCount(const Property& property)
 	{
 		return *(const u32*)property.value.begin;
@@ -396,12 +534,16 @@ namespace ofbx
 
 		assert(property.type == 'f');
 		assert(sizeof((*out_vec)[0].x) == sizeof(double));
-		std::vector<float> tmp;
-		if (!parseBinaryArray(property, &tmp)) return false;
+		ScratchArena& arena = ScratchArena::get();
+		ScratchArena::Scope scope(arena);
+		const int count = (int)getArrayCount(property);
+		float* tmp = arena.alloc<float>(count);
+		if (!parseBinaryArrayRaw(property, tmp, int(sizeof(float) * count))) return false;
 		int elem_count = sizeof((*out_vec)[0]) / sizeof((*out_vec)[0].x);
-		out_vec->resize(tmp.size() / elem_count);
+		out_vec->resize(count / elem_count);
+		if (out_vec->empty()) return true;
 		double* out = &(*out_vec)[0].x;
-		for (int i = 0, c = (int)tmp.size(); i < c; ++i)
+		for (int i = 0, c = (int)out_vec->size() * elem_count; i < c; ++i)
 		{
 			out[i] = tmp[i];
 		}
@@ -409,18 +551,15 @@ namespace ofbx
 	}
 
 
-	template <typename T>
-	static bool parseVertexData(const Element& element,
-		const char* name,
+	// *indices_element is nullptr unless the layer is IndexToDirect and has the index array
+	inline bool parseVertexDataLayout(const Element& element,
 		const char* index_name,
-		std::vector<T>* out,
-		std::vector<int>* out_indices,
-		GeometryImpl::VertexDataMapping* mapping)
+		GeometryImpl::VertexDataMapping* mapping,
+		const Element** indices_element)
 	{
-		assert(out);
 		assert(mapping);
-		const Element* data_element = findChild(element, name);
-		if (!data_element || !data_element->first_property) 	return false;
+		assert(indices_element);
+		*indices_element = nullptr;
 
 		const Element* mapping_element = findChild(element, "MappingInformationType");
 		const Element* reference_element = findChild(element, "ReferenceInformationType");
@@ -449,23 +588,166 @@ namespace ofbx
 		{
 			if (reference_element->first_property->value == "IndexToDirect")
 			{
-				const Element* indices_element = findChild(element, index_name);
-				if (indices_element && indices_element->first_property)
-				{
-					if (!parseBinaryArray(*indices_element->first_property, out_indices)) return false;
-				}
+				const Element* element_indices = findChild(element, index_name);
+				if (element_indices && element_indices->first_property) *indices_element = element_indices;
 			}
 			else if (reference_element->first_property->value != "Direct")
 			{
 				return false;
 			}
 		}
+		return true;
+	}
+
+
+	template <typename T>
+	static bool parseVertexData(const Element& element,
+		const char* name,
+		const char* index_name,
+		std::vector<T>* out,
+		std::vector<int>* out_indices,
+		GeometryImpl::VertexDataMapping* mapping)
+	{
+		assert(out);
+		assert(mapping);
+		const Element* data_element = findChild(element, name);
+		if (!data_element || !data_element->first_property) 	return false;
+
+		const Element* indices_element;
+		if (!parseVertexDataLayout(element, index_name, mapping, &indices_element)) return false;
+		if (indices_element && !parseBinaryArray(*indices_element->first_property, out_indices)) return false;
 		return parseDoubleVecData(*data_element->first_property, out);
 	}
 
-	const Element* findChild(const Element& element, const char* id);
+	Matrix operator*(const Matrix& lhs, const Matrix& rhs);
+	Matrix makeIdentity();
+	double getDeterminant3x3(const Matrix& mtx);
+	// inverse transpose of the upper 3x3, for transforming normals
+	Matrix getNormalMatrix(const Matrix& mtx);
+	// inverse of a matrix without projection
+	Matrix getInverseAffine(const Matrix& mtx);
+	void transformPoints(const Matrix& mtx, Vec3* points, int count);
+	void transformVectors(const Matrix& mtx, Vec3* vectors, int count, bool normalize);
+
+	// batchStaticMeshes limited to the given parts
+	void batchMeshParts(const std::vector<SceneCell::Part>& parts, const BatchSettings& settings, std::vector<MeshBatch>* batches);
+
+	// resolves the texture objects' paths and starts the prefetch, called before objects are parsed
+	void resolveTextures(Scene* scene);
+
+	// control_points and rendering_vertices have one element per polygon vertex, polygon p is
+	// [starts[p], starts[p + 1]); triangles are expected to be fan triangulated in polygon order
+	void buildAdjacency(const int* control_points,
+		const int* rendering_vertices,
+		const int* starts,
+		int polygon_count,
+		int control_point_count,
+		Adjacency* adjacency);
+
+	// lightmap UV of each polygon vertex i is uvs[indices[i]], polygon vertices of a chart sharing a control point share
+	// the value; flip_winding mirrors the charts for geometries whose triangles are flipped by the coordinate conversion
+	void generateLightmapUVs(const Vec3* positions,
+		const int* control_points,
+		const int* starts,
+		int polygon_count,
+		int control_point_count,
+		const LightmapSettings& settings,
+		int thread_count,
+		bool flip_winding,
+		std::vector<Vec2>* uvs,
+		std::vector<int>* indices);
+
+	// world space rendering vertices and normals of the mesh with layer evaluated at time (nodes' own transforms if
+	// layer is null), with animated blend shapes and skinning like bakeVertexAnimation(); the mesh must have a geometry
+	void poseMesh(const Mesh& mesh, const AnimationLayer* layer, double time, std::vector<Vec3>* positions, std::vector<Vec3>* normals);
+
+	// removes degenerate and duplicate triangles and compacts all vertex streams, called right after the geometry is parsed
+	void cleanupGeometry(GeometryImpl::Data* data);
+
+	// up to SkinPartition::MAX_INFLUENCES strongest (cluster index, weight) pairs per rendering vertex,
+	// sorted by weight, unused slots have weight 0
+	void gatherSkinInfluences(const Skin& skin, int vertex_count, std::vector<int>* bones, std::vector<double>* weights);
+	void partitionSkin(GeometryImpl* geom, int palette_size);
+	void computeBoneBounds(GeometryImpl* geom, double min_weight);
+
+	// decides whether a child of parent (the root for top level elements) is tokenized, rejected elements are
+	// skipped with all their children without reading their properties
+	typedef bool (*ElementFilter)(const Element& parent, const DataView& id);
+	OptionalError<Element*> tokenize(const u8* data, size_t size, ElementFilter filter = nullptr);
+	void deleteElement(Element* el);
+	GlobalSettings parseGlobalSettings(const Element& root);
+
+	extern ThreadHooks g_thread_hooks;
+
+	// every thread of the library is started with this, so it runs the application's ThreadHooks
+	template <typename F>
+	std::thread startThread(F f)
+	{
+		const ThreadHooks hooks = g_thread_hooks;
+		void* context = hooks.capture ? hooks.capture() : nullptr;
+		return std::thread([hooks, context, f]() mutable {
+			if (hooks.enter) hooks.enter(context);
+			f();
+			if (hooks.leave) hooks.leave(context);
+		});
+	}
+
+	// calls job(i) for each i in [0, count) on up to thread_count threads, 0 means hardware concurrency
+	template <typename F>
+	void parallelFor(int count, int thread_count, F job)
+	{
+		if (thread_count <= 0) thread_count = (int)std::thread::hardware_concurrency();
+		if (thread_count > count) thread_count = count;
+		if (thread_count <= 1)
+		{
+			for (int i = 0; i < count; ++i) job(i);
+			return;
+		}
+
+		std::atomic<int> next(0);
+		auto worker = [&]() {
+			for (int i = next++; i < count; i = next++) job(i);
+		};
+		std::vector<std::thread> threads;
+		threads.reserve(thread_count - 1);
+		for (int i = 0; i < thread_count - 1; ++i) threads.push_back(startThread(worker));
+		worker();
+		for (std::thread& t : threads) t.join();
+	}
+
+	struct FileReaderImpl;
+
+	// reads whole files in the background with the FileReadSettings backend, files are handed out in order of arrival
+	struct FileReader
+	{
+		FileReader(const char* const* paths, int count, const FileReadSettings& settings);
+		~FileReader();
+		// waits for the next file, returns false once all were handed out; ok is false if the file could not be read
+		bool next(int* index, std::vector<u8>* data, bool* ok);
+
+		std::unique_ptr<FileReaderImpl> impl;
+	};
+
+	// calls job(index, data, ok) for every file as soon as it's read, on up to thread_count threads,
+	// 0 means hardware concurrency
+	template <typename F>
+	void forEachFile(const char* const* paths, int count, const FileReadSettings& settings, int thread_count, F job)
+	{
+		if (thread_count <= 0) thread_count = (int)std::thread::hardware_concurrency();
+		if (thread_count > count) thread_count = count;
+		if (thread_count < 1) thread_count = 1;
+		FileReader reader(paths, count, settings);
+		parallelFor(thread_count, thread_count, [&](int) {
+			int index;
+			std::vector<u8> data;
+			bool ok;
+			while (reader.next(&index, &data, &ok)) job(index, data, ok);
+		});
+	}
+
 	int getTriCountFromPoly(const std::vector<int>& indices, int* idx);
 
-	OptionalError<Object*> parseGeometryForRendering(const Scene& scene, const Element& element);
+	// thread_count is used for LoadSettings::lightmap_uvs
+	OptionalError<Object*> parseGeometryForRendering(const Scene& scene, const Element& element, int thread_count = 1);
 
 } // namespace ofbx
\ No newline at end of file
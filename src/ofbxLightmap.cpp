@@ -0,0 +1,848 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+namespace ofbx
+{
+
+	static Vec3 sub(const Vec3& a, const Vec3& b)
+	{
+		return {a.x - b.x, a.y - b.y, a.z - b.z};
+	}
+
+
+	static Vec3 cross(const Vec3& a, const Vec3& b)
+	{
+		return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+	}
+
+
+	static double dot(const Vec3& a, const Vec3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+
+	static Vec3 normalize(const Vec3& v)
+	{
+		const double len = sqrt(dot(v, v));
+		return len > 0 ? Vec3{v.x / len, v.y / len, v.z / len} : Vec3{0, 0, 0};
+	}
+
+
+	// twice the signed area
+	static double area2(const Vec2& a, const Vec2& b, const Vec2& c)
+	{
+		return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	}
+
+
+	struct LightmapBuilder
+	{
+		struct Chart
+		{
+			int first_polygon; // into chart_polygons
+			int polygon_count;
+			int first_vertex; // into chart_vertices
+			int vertex_count;
+			int first_triangle; // into chart_triangles
+			int triangle_count;
+			Vec3 normal;
+			double area;
+			Vec2 size;
+			Vec2 offset; // in texels, set by the packer
+			bool valid; // false if the chart folds over itself
+		};
+
+
+		LightmapBuilder(const Vec3* _positions,
+			const int* _control_points,
+			const int* _starts,
+			int _polygon_count,
+			int _control_point_count,
+			const LightmapSettings& _settings)
+			: positions(_positions)
+			, control_points(_control_points)
+			, starts(_starts)
+			, polygon_count(_polygon_count)
+			, control_point_count(_control_point_count)
+			, settings(_settings)
+		{
+		}
+
+
+		// files often store a control point per polygon vertex, charts are grown over control points welded by position
+		void weld()
+		{
+			std::vector<int> order(control_point_count);
+			for (int i = 0; i < control_point_count; ++i) order[i] = i;
+			auto less = [&](int a, int b) {
+				const Vec3& p = positions[a];
+				const Vec3& q = positions[b];
+				if (p.x != q.x) return p.x < q.x;
+				if (p.y != q.y) return p.y < q.y;
+				if (p.z != q.z) return p.z < q.z;
+				return a < b;
+			};
+			std::sort(order.begin(), order.end(), less);
+
+			std::vector<int> welded_points(control_point_count);
+			for (int i = 0; i < control_point_count; ++i)
+			{
+				const int cp = order[i];
+				const Vec3& p = positions[cp];
+				const Vec3* prev = i > 0 ? &positions[order[i - 1]] : nullptr;
+				const bool same = prev && prev->x == p.x && prev->y == p.y && prev->z == p.z;
+				welded_points[cp] = same ? welded_points[order[i - 1]] : cp;
+			}
+
+			const int polygon_vertex_count = starts[polygon_count];
+			welded.resize(polygon_vertex_count);
+			for (int i = 0; i < polygon_vertex_count; ++i) welded[i] = welded_points[control_points[i]];
+		}
+
+
+		// Newell's normal, its length is twice the polygon's area
+		void initPolygons()
+		{
+			polygon_normals.resize(polygon_count);
+			polygon_areas.resize(polygon_count);
+			double max_area = 0;
+			for (int poly = 0; poly < polygon_count; ++poly)
+			{
+				Vec3 n = {0, 0, 0};
+				for (int i = starts[poly]; i < starts[poly + 1]; ++i)
+				{
+					const int next = i + 1 == starts[poly + 1] ? starts[poly] : i + 1;
+					const Vec3& a = positions[control_points[i]];
+					const Vec3& b = positions[control_points[next]];
+					n.x += (a.y - b.y) * (a.z + b.z);
+					n.y += (a.z - b.z) * (a.x + b.x);
+					n.z += (a.x - b.x) * (a.y + b.y);
+				}
+				polygon_areas[poly] = starts[poly + 1] - starts[poly] < 3 ? 0 : sqrt(dot(n, n)) * 0.5;
+				polygon_normals[poly] = normalize(n);
+				max_area = std::max(max_area, polygon_areas[poly]);
+			}
+			min_area = max_area * 1e-10;
+		}
+
+
+		// region growing from the biggest unassigned polygon over manifold edges, a polygon joins the chart
+		// if its normal is within max_chart_angle of the chart's area weighted normal; degenerate polygons
+		// join any neighbour
+		void segment()
+		{
+			// not Geometry::getAdjacency(): that one is built after the unification into rendering vertices, which
+			// needs the lightmap seams first, and its twins match control points; charts need twins between welded
+			// points or they would stop at every polygon of files storing a control point per polygon vertex
+			buildAdjacency(welded.data(), welded.data(), starts, polygon_count, control_point_count, &adjacency);
+
+			std::vector<int> order(polygon_count);
+			for (int i = 0; i < polygon_count; ++i) order[i] = i;
+			std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return polygon_areas[a] > polygon_areas[b]; });
+
+			const double min_cos = cos(settings.max_chart_angle * 3.14159265358979323846 / 180);
+			polygon_charts.assign(polygon_count, -1);
+			std::vector<int> queue;
+			for (int seed : order)
+			{
+				if (polygon_charts[seed] >= 0 || starts[seed + 1] - starts[seed] < 3) continue;
+
+				const int chart = chart_count++;
+				Vec3 normal_sum = {0, 0, 0};
+				auto add = [&](int poly) {
+					polygon_charts[poly] = chart;
+					const double area = polygon_areas[poly];
+					const Vec3& n = polygon_normals[poly];
+					normal_sum = {normal_sum.x + n.x * area, normal_sum.y + n.y * area, normal_sum.z + n.z * area};
+					queue.push_back(poly);
+				};
+				queue.clear();
+				add(seed);
+				for (size_t q = 0; q < queue.size(); ++q)
+				{
+					const int poly = queue[q];
+					for (int i = starts[poly]; i < starts[poly + 1]; ++i)
+					{
+						const int twin = adjacency.twins[i];
+						if (twin < 0) continue;
+						const int other = adjacency.polygons[twin];
+						if (polygon_charts[other] >= 0 || starts[other + 1] - starts[other] < 3) continue;
+						if (polygon_areas[other] > min_area && dot(polygon_normals[other], normalize(normal_sum)) < min_cos) continue;
+						add(other);
+					}
+				}
+			}
+		}
+
+
+		// chart vertices are the distinct welded control points of the chart's polygons,
+		// triangles are fan triangulated polygons indexing them
+		void buildCharts()
+		{
+			charts.resize(chart_count);
+			std::vector<int> polygon_offsets(chart_count + 1, 0);
+			for (int poly = 0; poly < polygon_count; ++poly)
+			{
+				if (polygon_charts[poly] >= 0) ++polygon_offsets[polygon_charts[poly] + 1];
+			}
+			for (int i = 0; i < chart_count; ++i) polygon_offsets[i + 1] += polygon_offsets[i];
+			chart_polygons.resize(polygon_offsets[chart_count]);
+			{
+				std::vector<int> offsets(polygon_offsets.begin(), polygon_offsets.end() - 1);
+				for (int poly = 0; poly < polygon_count; ++poly)
+				{
+					if (polygon_charts[poly] >= 0) chart_polygons[offsets[polygon_charts[poly]]++] = poly;
+				}
+			}
+
+			corner_vertices.assign(starts[polygon_count], -1);
+			std::vector<int> stamps(control_point_count, -1);
+			std::vector<int> local(control_point_count);
+			for (int c = 0; c < chart_count; ++c)
+			{
+				Chart& chart = charts[c];
+				chart.first_polygon = polygon_offsets[c];
+				chart.polygon_count = polygon_offsets[c + 1] - polygon_offsets[c];
+				chart.first_vertex = (int)chart_vertices.size();
+				chart.first_triangle = (int)chart_triangles.size() / 3;
+				chart.area = 0;
+				chart.valid = true;
+				Vec3 normal = {0, 0, 0};
+				for (int p = polygon_offsets[c]; p < polygon_offsets[c + 1]; ++p)
+				{
+					const int poly = chart_polygons[p];
+					for (int i = starts[poly]; i < starts[poly + 1]; ++i)
+					{
+						const int cp = welded[i];
+						if (stamps[cp] != c)
+						{
+							stamps[cp] = c;
+							local[cp] = (int)chart_vertices.size() - chart.first_vertex;
+							chart_vertices.push_back(cp);
+						}
+						corner_vertices[i] = chart.first_vertex + local[cp];
+					}
+					for (int i = starts[poly] + 2; i < starts[poly + 1]; ++i)
+					{
+						chart_triangles.push_back(corner_vertices[starts[poly]] - chart.first_vertex);
+						chart_triangles.push_back(corner_vertices[i - 1] - chart.first_vertex);
+						chart_triangles.push_back(corner_vertices[i] - chart.first_vertex);
+					}
+					const double area = polygon_areas[poly];
+					const Vec3& n = polygon_normals[poly];
+					normal = {normal.x + n.x * area, normal.y + n.y * area, normal.z + n.z * area};
+					chart.area += area;
+				}
+				chart.vertex_count = (int)chart_vertices.size() - chart.first_vertex;
+				chart.triangle_count = (int)chart_triangles.size() / 3 - chart.first_triangle;
+				chart.normal = normalize(normal);
+			}
+			chart_uvs.resize(chart_vertices.size());
+		}
+
+
+		// orthographic projection along the chart's normal, the start and the fallback of LSCM
+		void project(const Chart& chart, Vec2* uvs) const
+		{
+			const Vec3 n = chart.normal;
+			const Vec3 axis = fabs(n.x) < fabs(n.y) ? (fabs(n.x) < fabs(n.z) ? Vec3{1, 0, 0} : Vec3{0, 0, 1})
+													: (fabs(n.y) < fabs(n.z) ? Vec3{0, 1, 0} : Vec3{0, 0, 1});
+			const Vec3 t = normalize(cross(axis, n));
+			const Vec3 b = cross(n, t);
+			for (int i = 0; i < chart.vertex_count; ++i)
+			{
+				const Vec3& p = positions[chart_vertices[chart.first_vertex + i]];
+				uvs[i] = {dot(p, t), dot(p, b)};
+			}
+		}
+
+
+		// separating axis test of two triangles, touching ones do not overlap
+		static bool trianglesOverlap(const Vec2* a, const Vec2* b, double epsilon)
+		{
+			for (int t = 0; t < 2; ++t)
+			{
+				const Vec2* tri = t == 0 ? a : b;
+				for (int i = 0; i < 3; ++i)
+				{
+					const Vec2 axis = {tri[i].y - tri[(i + 1) % 3].y, tri[(i + 1) % 3].x - tri[i].x};
+					double min_a = DBL_MAX, max_a = -DBL_MAX, min_b = DBL_MAX, max_b = -DBL_MAX;
+					for (int j = 0; j < 3; ++j)
+					{
+						const double pa = a[j].x * axis.x + a[j].y * axis.y;
+						const double pb = b[j].x * axis.x + b[j].y * axis.y;
+						min_a = std::min(min_a, pa);
+						max_a = std::max(max_a, pa);
+						min_b = std::min(min_b, pb);
+						max_b = std::max(max_b, pb);
+					}
+					const double tolerance = epsilon * sqrt(axis.x * axis.x + axis.y * axis.y);
+					if (max_a <= min_b + tolerance || max_b <= min_a + tolerance) return false;
+				}
+			}
+			return true;
+		}
+
+
+		// triangles not sharing an edge whose interiors intersect, pairs are found over a uniform grid
+		bool hasOverlaps(const Chart& chart, const Vec2* uvs) const
+		{
+			const int triangle_count = chart.triangle_count;
+			const int* tris = &chart_triangles[chart.first_triangle * 3];
+			if (triangle_count < 2) return false;
+
+			Vec2 min = {DBL_MAX, DBL_MAX};
+			Vec2 max = {-DBL_MAX, -DBL_MAX};
+			for (int i = 0; i < chart.vertex_count; ++i)
+			{
+				min = {std::min(min.x, uvs[i].x), std::min(min.y, uvs[i].y)};
+				max = {std::max(max.x, uvs[i].x), std::max(max.y, uvs[i].y)};
+			}
+			const double extent = std::max(max.x - min.x, max.y - min.y);
+			if (extent <= 0) return false;
+
+			const int grid = std::max(1, std::min((int)sqrt((double)triangle_count), 256));
+			const double to_cell = grid / extent * (1 - 1e-9);
+			auto getCells = [&](int tri, int* from, int* to) {
+				Vec2 tmin = uvs[tris[tri * 3]];
+				Vec2 tmax = tmin;
+				for (int j = 1; j < 3; ++j)
+				{
+					const Vec2& uv = uvs[tris[tri * 3 + j]];
+					tmin = {std::min(tmin.x, uv.x), std::min(tmin.y, uv.y)};
+					tmax = {std::max(tmax.x, uv.x), std::max(tmax.y, uv.y)};
+				}
+				from[0] = int((tmin.x - min.x) * to_cell);
+				from[1] = int((tmin.y - min.y) * to_cell);
+				to[0] = int((tmax.x - min.x) * to_cell);
+				to[1] = int((tmax.y - min.y) * to_cell);
+			};
+
+			// counting sort of triangles into the cells their bounds touch
+			std::vector<int> cell_starts(grid * grid + 1, 0);
+			for (int i = 0; i < triangle_count; ++i)
+			{
+				int from[2], to[2];
+				getCells(i, from, to);
+				for (int y = from[1]; y <= to[1]; ++y)
+				{
+					for (int x = from[0]; x <= to[0]; ++x) ++cell_starts[y * grid + x + 1];
+				}
+			}
+			for (int i = 0; i < grid * grid; ++i) cell_starts[i + 1] += cell_starts[i];
+			std::vector<int> cells(cell_starts.back());
+			std::vector<int> offsets(cell_starts.begin(), cell_starts.end() - 1);
+			for (int i = 0; i < triangle_count; ++i)
+			{
+				int from[2], to[2];
+				getCells(i, from, to);
+				for (int y = from[1]; y <= to[1]; ++y)
+				{
+					for (int x = from[0]; x <= to[0]; ++x) cells[offsets[y * grid + x]++] = i;
+				}
+			}
+
+			const double epsilon = extent * 1e-9;
+			for (int cell = 0; cell < grid * grid; ++cell)
+			{
+				for (int i = cell_starts[cell]; i < cell_starts[cell + 1]; ++i)
+				{
+					const int* a = tris + cells[i] * 3;
+					const Vec2 ta[3] = {uvs[a[0]], uvs[a[1]], uvs[a[2]]};
+					for (int j = i + 1; j < cell_starts[cell + 1]; ++j)
+					{
+						const int* b = tris + cells[j] * 3;
+						int shared = 0;
+						for (int k = 0; k < 3; ++k) shared += (b[k] == a[0]) + (b[k] == a[1]) + (b[k] == a[2]);
+						// neighbours across an edge do not overlap unless one is flipped, duplicates do
+						if (shared == 2) continue;
+						if (shared == 3) return true;
+						const Vec2 tb[3] = {uvs[b[0]], uvs[b[1]], uvs[b[2]]};
+						if (trianglesOverlap(ta, tb, epsilon)) return true;
+					}
+				}
+			}
+			return false;
+		}
+
+
+		bool hasFlips(const Chart& chart, const Vec2* uvs) const
+		{
+			const int* tris = &chart_triangles[chart.first_triangle * 3];
+			for (int i = 0; i < chart.triangle_count; ++i)
+			{
+				const int* t = tris + i * 3;
+				if (t[0] == t[1] || t[1] == t[2] || t[2] == t[0]) continue;
+				if (area2(uvs[t[0]], uvs[t[1]], uvs[t[2]]) <= 0) return true;
+			}
+			return false;
+		}
+
+
+		// least squares conformal map with the two vertices farthest apart along the projection's u pinned,
+		// solved with CGLS starting from the projection in uvs, which is already the solution for planar charts
+		void lscm(const Chart& chart, Vec2* uvs) const
+		{
+			const int vertex_count = chart.vertex_count;
+			const int triangle_count = chart.triangle_count;
+			const int* tris = &chart_triangles[chart.first_triangle * 3];
+			if (vertex_count < 4) return;
+
+			int pins[2] = {0, 0};
+			for (int i = 1; i < vertex_count; ++i)
+			{
+				if (uvs[i].x < uvs[pins[0]].x) pins[0] = i;
+				if (uvs[i].x > uvs[pins[1]].x) pins[1] = i;
+			}
+			if (pins[0] == pins[1]) return;
+
+			// per triangle the complex coefficients W of sum(W_j * (u_j + i v_j)) = 0, scaled by 1 / sqrt(2 area)
+			std::vector<double> coefs(triangle_count * 6);
+			for (int i = 0; i < triangle_count; ++i)
+			{
+				const int* t = tris + i * 3;
+				const Vec3& p0 = positions[chart_vertices[chart.first_vertex + t[0]]];
+				const Vec3 e1 = sub(positions[chart_vertices[chart.first_vertex + t[1]]], p0);
+				const Vec3 e2 = sub(positions[chart_vertices[chart.first_vertex + t[2]]], p0);
+				const Vec3 n = cross(e1, e2);
+				const double double_area = sqrt(dot(n, n));
+				double* w = &coefs[i * 6];
+				if (double_area <= 0)
+				{
+					for (int j = 0; j < 6; ++j) w[j] = 0;
+					continue;
+				}
+				const Vec3 x = normalize(e1);
+				const Vec3 y = normalize(cross(n, e1));
+				const Vec2 q[3] = {{0, 0}, {dot(e1, x), 0}, {dot(e2, x), dot(e2, y)}};
+				const double scale = 1 / sqrt(double_area);
+				for (int j = 0; j < 3; ++j)
+				{
+					const Vec2& a = q[(j + 2) % 3];
+					const Vec2& b = q[(j + 1) % 3];
+					w[j * 2 + 0] = (a.x - b.x) * scale;
+					w[j * 2 + 1] = (a.y - b.y) * scale;
+				}
+			}
+
+			auto multiply = [&](const Vec2* x, double* out) {
+				for (int i = 0; i < triangle_count; ++i)
+				{
+					const int* t = tris + i * 3;
+					const double* w = &coefs[i * 6];
+					double re = 0, im = 0;
+					for (int j = 0; j < 3; ++j)
+					{
+						const Vec2& u = x[t[j]];
+						re += w[j * 2] * u.x - w[j * 2 + 1] * u.y;
+						im += w[j * 2 + 1] * u.x + w[j * 2] * u.y;
+					}
+					out[i * 2] = re;
+					out[i * 2 + 1] = im;
+				}
+			};
+			auto multiplyTransposed = [&](const double* r, Vec2* out) {
+				for (int i = 0; i < vertex_count; ++i) out[i] = {0, 0};
+				for (int i = 0; i < triangle_count; ++i)
+				{
+					const int* t = tris + i * 3;
+					const double* w = &coefs[i * 6];
+					for (int j = 0; j < 3; ++j)
+					{
+						out[t[j]].x += w[j * 2] * r[i * 2] + w[j * 2 + 1] * r[i * 2 + 1];
+						out[t[j]].y += -w[j * 2 + 1] * r[i * 2] + w[j * 2] * r[i * 2 + 1];
+					}
+				}
+				out[pins[0]] = out[pins[1]] = {0, 0};
+			};
+			auto length2 = [](const Vec2* v, int count) {
+				double sum = 0;
+				for (int i = 0; i < count; ++i) sum += v[i].x * v[i].x + v[i].y * v[i].y;
+				return sum;
+			};
+
+			std::vector<Vec2> x(uvs, uvs + vertex_count);
+			std::vector<double> r(triangle_count * 2);
+			std::vector<double> q(triangle_count * 2);
+			std::vector<Vec2> s(vertex_count);
+			std::vector<Vec2> p(vertex_count);
+			multiply(x.data(), q.data());
+			for (int i = 0; i < triangle_count * 2; ++i) r[i] = -q[i];
+			multiplyTransposed(r.data(), s.data());
+			p = s;
+			double gamma = length2(s.data(), vertex_count);
+			const double tolerance = gamma * 1e-12;
+
+			const int MAX_ITERATIONS = 256;
+			for (int iter = 0; iter < MAX_ITERATIONS && gamma > tolerance && gamma > 0; ++iter)
+			{
+				multiply(p.data(), q.data());
+				double qq = 0;
+				for (double v : q) qq += v * v;
+				if (qq <= 0) break;
+				const double alpha = gamma / qq;
+				for (int i = 0; i < vertex_count; ++i) x[i] = {x[i].x + alpha * p[i].x, x[i].y + alpha * p[i].y};
+				for (int i = 0; i < triangle_count * 2; ++i) r[i] -= alpha * q[i];
+				multiplyTransposed(r.data(), s.data());
+				const double new_gamma = length2(s.data(), vertex_count);
+				const double beta = new_gamma / gamma;
+				gamma = new_gamma;
+				for (int i = 0; i < vertex_count; ++i) p[i] = {s[i].x + beta * p[i].x, s[i].y + beta * p[i].y};
+			}
+
+			memcpy(uvs, x.data(), sizeof(Vec2) * vertex_count);
+		}
+
+
+		// angle of the rotation giving the smallest bounding rectangle, one of the convex hull's edges is on its side
+		static double getPackingAngle(const Vec2* uvs, int count)
+		{
+			std::vector<Vec2> points(uvs, uvs + count);
+			std::sort(points.begin(), points.end(), [](const Vec2& a, const Vec2& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+
+			// monotone chain
+			std::vector<Vec2> hull(points.size() * 2);
+			int k = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				while (k >= 2 && area2(hull[k - 2], hull[k - 1], points[i]) <= 0) --k;
+				hull[k++] = points[i];
+			}
+			for (int i = count - 2, lower = k + 1; i >= 0; --i)
+			{
+				while (k >= lower && area2(hull[k - 2], hull[k - 1], points[i]) <= 0) --k;
+				hull[k++] = points[i];
+			}
+			const int hull_size = std::max(k - 1, 0);
+
+			// quadratic in the hull size, which is small for most charts; huge hulls try a fixed number of edges
+			const int step = std::max(1, hull_size / 256);
+			double best_area = DBL_MAX;
+			double best_angle = 0;
+			for (int i = 0; i < hull_size; i += step)
+			{
+				const Vec2& a = hull[i];
+				const Vec2& b = hull[i + 1];
+				const double len = sqrt((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+				if (len <= 0) continue;
+				const Vec2 u = {(b.x - a.x) / len, (b.y - a.y) / len};
+				double min_u = DBL_MAX, max_u = -DBL_MAX, min_v = DBL_MAX, max_v = -DBL_MAX;
+				for (int j = 0; j < hull_size; ++j)
+				{
+					const double pu = hull[j].x * u.x + hull[j].y * u.y;
+					const double pv = -hull[j].x * u.y + hull[j].y * u.x;
+					min_u = std::min(min_u, pu);
+					max_u = std::max(max_u, pu);
+					min_v = std::min(min_v, pv);
+					max_v = std::max(max_v, pv);
+				}
+				const double area = (max_u - min_u) * (max_v - min_v);
+				if (area < best_area)
+				{
+					best_area = area;
+					best_angle = atan2(u.y, u.x);
+				}
+			}
+			return best_angle;
+		}
+
+
+		// uniform texel density: uv area equals surface area, then the chart is rotated to its smallest
+		// bounding rectangle, wider than high
+		void normalizeChart(Chart& chart, Vec2* uvs) const
+		{
+			const int* tris = &chart_triangles[chart.first_triangle * 3];
+			double uv_area = 0;
+			for (int i = 0; i < chart.triangle_count; ++i)
+			{
+				const int* t = tris + i * 3;
+				uv_area += fabs(area2(uvs[t[0]], uvs[t[1]], uvs[t[2]])) * 0.5;
+			}
+			const double scale = uv_area > 0 && chart.area > 0 ? sqrt(chart.area / uv_area) : 1;
+
+			const double angle = getPackingAngle(uvs, chart.vertex_count);
+			const double c = cos(angle) * scale;
+			const double s = sin(angle) * scale;
+
+			Vec2 min = {DBL_MAX, DBL_MAX};
+			Vec2 max = {-DBL_MAX, -DBL_MAX};
+			for (int i = 0; i < chart.vertex_count; ++i)
+			{
+				const Vec2 uv = uvs[i];
+				uvs[i] = {c * uv.x + s * uv.y, -s * uv.x + c * uv.y};
+				min = {std::min(min.x, uvs[i].x), std::min(min.y, uvs[i].y)};
+				max = {std::max(max.x, uvs[i].x), std::max(max.y, uvs[i].y)};
+			}
+			// rotating by 90 degrees keeps the orientation
+			const bool rotate = max.y - min.y > max.x - min.x;
+			for (int i = 0; i < chart.vertex_count; ++i)
+			{
+				const Vec2 uv = {uvs[i].x - min.x, uvs[i].y - min.y};
+				uvs[i] = rotate ? Vec2{max.y - min.y - uv.y, uv.x} : uv;
+			}
+			chart.size = rotate ? Vec2{max.y - min.y, max.x - min.x} : Vec2{max.x - min.x, max.y - min.y};
+		}
+
+
+		// LSCM, or the projection if LSCM folds the chart; valid is cleared if both fold it
+		void parameterizeChart(Chart& chart)
+		{
+			Vec2* uvs = &chart_uvs[chart.first_vertex];
+			project(chart, uvs);
+			std::vector<Vec2> projected(uvs, uvs + chart.vertex_count);
+			lscm(chart, uvs);
+			if (hasFlips(chart, uvs) || hasOverlaps(chart, uvs))
+			{
+				memcpy(uvs, projected.data(), sizeof(Vec2) * chart.vertex_count);
+				chart.valid = chart.polygon_count == 1 || (!hasFlips(chart, uvs) && !hasOverlaps(chart, uvs));
+			}
+			normalizeChart(chart, uvs);
+		}
+
+
+		// every polygon of the chart becomes a chart of its own, the chart is left empty
+		void splitChart(int index)
+		{
+			const Chart chart = charts[index];
+			charts[index].vertex_count = 0;
+			charts[index].triangle_count = 0;
+			charts[index].polygon_count = 0;
+			charts[index].size = {0, 0};
+			for (int p = chart.first_polygon; p < chart.first_polygon + chart.polygon_count; ++p)
+			{
+				const int poly = chart_polygons[p];
+				Chart piece = {};
+				piece.first_polygon = p;
+				piece.polygon_count = 1;
+				piece.first_vertex = (int)chart_vertices.size();
+				piece.first_triangle = (int)chart_triangles.size() / 3;
+				piece.normal = polygon_normals[poly];
+				piece.area = polygon_areas[poly];
+				piece.valid = true;
+				for (int i = starts[poly]; i < starts[poly + 1]; ++i)
+				{
+					corner_vertices[i] = (int)chart_vertices.size();
+					chart_vertices.push_back(welded[i]);
+				}
+				for (int i = 2, c = starts[poly + 1] - starts[poly]; i < c; ++i)
+				{
+					chart_triangles.push_back(0);
+					chart_triangles.push_back(i - 1);
+					chart_triangles.push_back(i);
+				}
+				piece.vertex_count = (int)chart_vertices.size() - piece.first_vertex;
+				piece.triangle_count = (int)chart_triangles.size() / 3 - piece.first_triangle;
+				charts.push_back(piece);
+			}
+		}
+
+
+		void parameterize(int thread_count)
+		{
+			parallelFor(chart_count, thread_count, [&](int c) { parameterizeChart(charts[c]); });
+
+			const int first_piece = chart_count;
+			for (int c = 0; c < first_piece; ++c)
+			{
+				if (!charts[c].valid) splitChart(c);
+			}
+			chart_count = (int)charts.size();
+			chart_uvs.resize(chart_vertices.size());
+			parallelFor(chart_count - first_piece, thread_count, [&](int c) { parameterizeChart(charts[first_piece + c]); });
+		}
+
+
+		// skyline bottom-left packing of the charts' rectangles scaled by texels per unit,
+		// returns false if they do not fit
+		bool pack(double scale, const std::vector<int>& order)
+		{
+			const int padding = std::max(settings.padding, 0);
+			const int size = settings.resolution - padding;
+			struct Segment
+			{
+				int x, y, width;
+			};
+			std::vector<Segment> skyline = {{0, 0, size}};
+
+			for (int c : order)
+			{
+				Chart& chart = charts[c];
+				const int w = (int)ceil(chart.size.x * scale) + 1 + padding;
+				const int h = (int)ceil(chart.size.y * scale) + 1 + padding;
+				if (w > size || h > size) return false;
+
+				int best = -1;
+				int best_y = INT_MAX;
+				for (int i = 0; i < (int)skyline.size(); ++i)
+				{
+					const int x = skyline[i].x;
+					if (x + w > size) break;
+					int y = 0;
+					for (int j = i, remaining = w; remaining > 0; ++j)
+					{
+						y = std::max(y, skyline[j].y);
+						remaining -= skyline[j].width;
+					}
+					if (y + h <= size && y < best_y)
+					{
+						best = i;
+						best_y = y;
+					}
+				}
+				if (best < 0) return false;
+
+				const int x = skyline[best].x;
+				chart.offset = {double(x + padding), double(best_y + padding)};
+
+				// the new segment replaces the ones it covers, a partially covered one is cut
+				int end = best;
+				while (end < (int)skyline.size() && skyline[end].x + skyline[end].width <= x + w) ++end;
+				if (end < (int)skyline.size() && skyline[end].x < x + w)
+				{
+					skyline[end].width -= x + w - skyline[end].x;
+					skyline[end].x = x + w;
+				}
+				skyline.erase(skyline.begin() + best, skyline.begin() + end);
+				skyline.insert(skyline.begin() + best, {x, best_y + h, w});
+				for (int i = std::max(best - 1, 0); i + 1 < (int)skyline.size();)
+				{
+					if (skyline[i].y == skyline[i + 1].y)
+					{
+						skyline[i].width += skyline[i + 1].width;
+						skyline.erase(skyline.begin() + i + 1);
+					}
+					else if (i > best) break;
+					else ++i;
+				}
+			}
+			return true;
+		}
+
+
+		// biggest scale at which the charts fit, found by bracketing and bisection
+		double packCharts()
+		{
+			// charts left empty by splitting take no space
+			std::vector<int> order;
+			double total = 0;
+			for (int i = 0; i < chart_count; ++i)
+			{
+				if (charts[i].vertex_count == 0) continue;
+				order.push_back(i);
+				total += charts[i].size.x * charts[i].size.y;
+			}
+			std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return charts[a].size.y > charts[b].size.y; });
+
+			const double side = settings.resolution - std::max(settings.padding, 0);
+			double scale = total > 0 ? sqrt(side * side * 0.5 / total) : 1;
+			double lo = 0;
+			double hi = 0;
+			for (int i = 0; i < 64 && (lo == 0 || hi == 0); ++i)
+			{
+				if (pack(scale, order))
+				{
+					lo = scale;
+					scale *= 1.25;
+				}
+				else
+				{
+					hi = scale;
+					scale *= 0.8;
+				}
+			}
+			if (lo == 0) return 0;
+			for (int i = 0; i < 8 && hi > 0; ++i)
+			{
+				const double mid = (lo + hi) * 0.5;
+				if (pack(mid, order))
+					lo = mid;
+				else
+					hi = mid;
+			}
+			pack(lo, order);
+			return lo;
+		}
+
+
+		void run(int thread_count, bool flip_winding, std::vector<Vec2>* uvs, std::vector<int>* indices)
+		{
+			weld();
+			initPolygons();
+			segment();
+			buildCharts();
+			parameterize(thread_count);
+			double scale = chart_count > 0 ? packCharts() : 0;
+
+			// charts which did not fit even when tiny overlap at the origin
+			if (scale == 0)
+			{
+				for (Chart& chart : charts) chart.offset = {0, 0};
+			}
+
+			const double texel = 1.0 / settings.resolution;
+			uvs->resize(chart_vertices.size() + 1);
+			for (const Chart& chart : charts)
+			{
+				for (int i = 0; i < chart.vertex_count; ++i)
+				{
+					const Vec2& uv = chart_uvs[chart.first_vertex + i];
+					// mirrored positions with flipped triangles keep the charts' orientation
+					const double u = flip_winding ? chart.size.x - uv.x : uv.x;
+					(*uvs)[chart.first_vertex + i] = {(chart.offset.x + u * scale) * texel, (chart.offset.y + uv.y * scale) * texel};
+				}
+			}
+			// polygons with less than 3 vertices share the last value
+			uvs->back() = {0, 0};
+			indices->resize(corner_vertices.size());
+			for (int i = 0, c = (int)corner_vertices.size(); i < c; ++i)
+			{
+				(*indices)[i] = corner_vertices[i] < 0 ? (int)chart_vertices.size() : corner_vertices[i];
+			}
+		}
+
+
+		const Vec3* positions;
+		const int* control_points;
+		const int* starts;
+		const int polygon_count;
+		const int control_point_count;
+		const LightmapSettings& settings;
+
+		std::vector<int> welded; // per polygon vertex
+		std::vector<Vec3> polygon_normals;
+		std::vector<double> polygon_areas;
+		double min_area = 0;
+		Adjacency adjacency;
+		std::vector<int> polygon_charts;
+		int chart_count = 0;
+		std::vector<Chart> charts;
+		std::vector<int> chart_polygons; // polygons sorted by chart
+		std::vector<int> chart_vertices; // control point of each chart vertex
+		std::vector<int> chart_triangles; // chart local vertex indices
+		std::vector<Vec2> chart_uvs;
+		std::vector<int> corner_vertices; // chart vertex of each polygon vertex, -1 if not in a chart
+	};
+
+
+	void generateLightmapUVs(const Vec3* positions,
+		const int* control_points,
+		const int* starts,
+		int polygon_count,
+		int control_point_count,
+		const LightmapSettings& settings,
+		int thread_count,
+		bool flip_winding,
+		std::vector<Vec2>* uvs,
+		std::vector<int>* indices)
+	{
+		assert(uvs && indices);
+		LightmapBuilder builder(positions, control_points, starts, polygon_count, control_point_count, settings);
+		builder.run(thread_count, flip_winding, uvs, indices);
+	}
+
+} // namespace ofbx
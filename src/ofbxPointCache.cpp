@@ -0,0 +1,178 @@
+#include "ofbxImp.h"
+#include <cmath>
+
+namespace ofbx
+{
+
+#ifdef OFBX_SSE2
+	static void loadPoint(const Vec3* points, int index, __m128d* xy, __m128d* z)
+	{
+		const double* p = &points[index].x;
+		*xy = _mm_loadu_pd(p);
+		*z = _mm_load_sd(p + 2);
+	}
+
+
+	static void loadPoint(const float* points, int index, __m128d* xy, __m128d* z)
+	{
+		const float* p = points + index * 3;
+		*xy = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)p)));
+		*z = _mm_set_sd(p[2]);
+	}
+#else
+	static Vec3 loadPoint(const Vec3* points, int index) { return points[index]; }
+
+
+	static Vec3 loadPoint(const float* points, int index)
+	{
+		const float* p = points + index * 3;
+		return {p[0], p[1], p[2]};
+	}
+#endif
+
+
+	// out[i] = points[indices[i]], transformed by mtx if it's not null
+	template <typename T>
+	static void gatherPoints(const T* points, const int* indices, int count, const Matrix* mtx, Vec3* out)
+	{
+#ifdef OFBX_SSE2
+		__m128d xy, z;
+		if (!mtx)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				loadPoint(points, indices[i], &xy, &z);
+				_mm_storeu_pd(&out[i].x, xy);
+				_mm_store_sd(&out[i].z, z);
+			}
+			return;
+		}
+
+		const double* m = mtx->m;
+		const __m128d c0 = _mm_loadu_pd(m + 0);
+		const __m128d c1 = _mm_loadu_pd(m + 4);
+		const __m128d c2 = _mm_loadu_pd(m + 8);
+		const __m128d c3 = _mm_loadu_pd(m + 12);
+		const __m128d z0 = _mm_load_sd(m + 2);
+		const __m128d z1 = _mm_load_sd(m + 6);
+		const __m128d z2 = _mm_load_sd(m + 10);
+		const __m128d z3 = _mm_load_sd(m + 14);
+		for (int i = 0; i < count; ++i)
+		{
+			loadPoint(points, indices[i], &xy, &z);
+			const __m128d px = _mm_unpacklo_pd(xy, xy);
+			const __m128d py = _mm_unpackhi_pd(xy, xy);
+			const __m128d pz = _mm_unpacklo_pd(z, z);
+			const __m128d out_xy = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(c0, px), _mm_mul_pd(c1, py)), _mm_mul_pd(c2, pz)), c3);
+			const __m128d out_z = _mm_add_sd(_mm_add_sd(_mm_add_sd(_mm_mul_sd(z0, px), _mm_mul_sd(z1, py)), _mm_mul_sd(z2, pz)), z3);
+			_mm_storeu_pd(&out[i].x, out_xy);
+			_mm_store_sd(&out[i].z, out_z);
+		}
+#else
+		for (int i = 0; i < count; ++i) out[i] = loadPoint(points, indices[i]);
+		if (mtx) transformPoints(*mtx, out, count);
+#endif
+	}
+
+
+	static bool equal(const Vec3& a, const Vec3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+
+	// area weighted face normals summed per smoothing group: rendering vertices of a control point with the same
+	// loaded normal (all of them if there are none) were split only by other attributes and stay smooth
+	static void computeNormals(const GeometryImpl::Data& data, const Vec3* positions, Vec3* out_normals)
+	{
+		const int vertex_count = (int)data.to_old_vertices.size();
+		const int control_point_count = (int)data.to_new_vertices.size();
+		const bool has_normals = (int)data.normals.size() == vertex_count;
+
+		ScratchArena& arena = ScratchArena::get();
+		ScratchArena::Scope scope(arena);
+		int* groups = arena.alloc<int>(vertex_count);
+		int* next_group = arena.alloc<int>(vertex_count); // next group of the same control point
+		int* first_group = arena.alloc<int>(control_point_count);
+		Vec3* sums = arena.alloc<Vec3>(vertex_count);
+		for (int i = 0; i < control_point_count; ++i) first_group[i] = -1;
+
+		for (int v = 0; v < vertex_count; ++v)
+		{
+			sums[v] = {0, 0, 0};
+			const int control_point = data.to_old_vertices[v];
+			int group = first_group[control_point];
+			if (group < 0)
+			{
+				first_group[control_point] = v;
+				groups[v] = v;
+				next_group[v] = -1;
+				continue;
+			}
+			for (;;)
+			{
+				if (!has_normals || equal(data.normals[group], data.normals[v]))
+				{
+					groups[v] = group;
+					break;
+				}
+				if (next_group[group] < 0)
+				{
+					next_group[group] = v;
+					groups[v] = v;
+					next_group[v] = -1;
+					break;
+				}
+				group = next_group[group];
+			}
+		}
+
+		const int* triangles = data.triangles.data();
+		for (int i = 0, c = (int)data.triangles.size(); i < c; i += 3)
+		{
+			const Vec3& p0 = positions[triangles[i]];
+			const Vec3& p1 = positions[triangles[i + 1]];
+			const Vec3& p2 = positions[triangles[i + 2]];
+			const Vec3 e1 = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+			const Vec3 e2 = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+			const Vec3 n = {e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x};
+			for (int j = 0; j < 3; ++j)
+			{
+				Vec3& sum = sums[groups[triangles[i + j]]];
+				sum = {sum.x + n.x, sum.y + n.y, sum.z + n.z};
+			}
+		}
+
+		for (int v = 0; v < vertex_count; ++v)
+		{
+			const Vec3& sum = sums[groups[v]];
+			const double len = sqrt(sum.x * sum.x + sum.y * sum.y + sum.z * sum.z);
+			if (len > 0)
+				out_normals[v] = {sum.x / len, sum.y / len, sum.z / len};
+			else
+				out_normals[v] = has_normals ? data.normals[v] : Vec3{0, 0, 0};
+		}
+	}
+
+
+	template <typename T>
+	static void scatter(const Geometry& geometry, const T* control_points, Vec3* out_positions, Vec3* out_normals)
+	{
+		assert(control_points && out_positions);
+		const GeometryImpl::Data& data = *((const GeometryImpl&)geometry).data;
+		const Scene::Conversion& conversion = ((const Scene&)geometry.getScene()).m_conversion;
+		const Matrix* mtx = conversion.enabled ? &conversion.matrix : nullptr;
+		gatherPoints(control_points, data.to_old_vertices.data(), (int)data.to_old_vertices.size(), mtx, out_positions);
+		if (out_normals) computeNormals(data, out_positions, out_normals);
+	}
+
+
+	void scatterControlPoints(const Geometry& geometry, const Vec3* control_points, Vec3* out_positions, Vec3* out_normals)
+	{
+		scatter(geometry, control_points, out_positions, out_normals);
+	}
+
+
+	void scatterControlPoints(const Geometry& geometry, const float* control_points, Vec3* out_positions, Vec3* out_normals)
+	{
+		scatter(geometry, control_points, out_positions, out_normals);
+	}
+
+} // namespace ofbx
@@ -0,0 +1,230 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <cstring>
+
+namespace ofbx
+{
+
+	struct SkeletonBuilder
+	{
+		SkeletonBuilder(const Scene& _scene)
+			: scene(_scene)
+		{
+		}
+
+
+		Object* getObject(u64 id) const
+		{
+			auto iter = scene.m_object_map.find(id);
+			return iter == scene.m_object_map.end() ? nullptr : iter->second.object;
+		}
+
+
+		// one pass over connections instead of getParent() / resolveObjectLink() per node
+		void gatherLinks()
+		{
+			for (const Scene::Connection& con : scene.m_connections)
+			{
+				Object* from = getObject(con.from);
+				Object* to = getObject(con.to);
+				if (!from || !to) continue;
+
+				if (con.type == Scene::Connection::OBJECT_OBJECT && from->isNode() && to->isNode())
+				{
+					if (to->getType() != Object::Type::ROOT) parents[from] = to;
+					children[to].push_back(from);
+				}
+				else if (from->getType() == Object::Type::ANIMATION_CURVE_NODE && to->isNode())
+				{
+					needed[to] = true;
+				}
+				else if (from->getType() == Object::Type::GEOMETRY && to->getType() == Object::Type::MESH)
+				{
+					if (!((const Geometry*)from)->getSkin()) needed[to] = true;
+				}
+			}
+
+			for (const Object* obj : scene.m_all_objects)
+			{
+				if (obj->getType() != Object::Type::SKIN) continue;
+				const Skin* skin = (const Skin*)obj;
+				for (int i = 0, c = skin->getClusterCount(); i < c; ++i)
+				{
+					const Object* link = skin->getCluster(i)->getLink();
+					if (link) needed[link] = true;
+				}
+			}
+		}
+
+
+		void visit(const Object* node, int parent, const Matrix& offset)
+		{
+			int bone = parent;
+			Matrix child_offset = offset;
+			if (needed[node])
+			{
+				bone = (int)skeleton->bones.size();
+				bone_map[node] = bone;
+				skeleton->bones.push_back({node, parent, offset});
+				child_offset = makeIdentity();
+			}
+			else
+			{
+				child_offset = offset * node->evalLocal(node->getLocalTranslation(), node->getLocalRotation());
+			}
+
+			auto iter = children.find(node);
+			if (iter == children.end()) return;
+			for (const Object* child : iter->second) visit(child, bone, child_offset);
+		}
+
+
+		const Scene& scene;
+		Skeleton* skeleton = nullptr;
+		std::unordered_map<const Object*, const Object*> parents;
+		std::unordered_map<const Object*, std::vector<const Object*>> children;
+		std::unordered_map<const Object*, bool> needed;
+		std::unordered_map<const Object*, int> bone_map;
+	};
+
+
+	int Skeleton::findBone(const char* name) const
+	{
+		for (int i = 0, c = (int)bones.size(); i < c; ++i)
+		{
+			if (strcmp(bones[i].node->name, name) == 0) return i;
+		}
+		return -1;
+	}
+
+
+	void optimizeSkeleton(const IScene& scene, const char* const* keep_names, int keep_count, Skeleton* skeleton)
+	{
+		assert(skeleton);
+		skeleton->bones.clear();
+		skeleton->skins.clear();
+
+		const Scene& scene_impl = (const Scene&)scene;
+		SkeletonBuilder builder(scene_impl);
+		builder.skeleton = skeleton;
+		builder.gatherLinks();
+
+		for (const Object* obj : scene_impl.m_all_objects)
+		{
+			if (!obj->isNode()) continue;
+			for (int i = 0; i < keep_count; ++i)
+			{
+				if (strcmp(obj->name, keep_names[i]) == 0) builder.needed[obj] = true;
+			}
+		}
+
+		// walk from every node without a parent node so that parents end up before children
+		for (const Object* obj : scene_impl.m_all_objects)
+		{
+			if (!obj->isNode() || builder.parents.find(obj) != builder.parents.end()) continue;
+			builder.visit(obj, -1, makeIdentity());
+		}
+
+		for (const Object* obj : scene_impl.m_all_objects)
+		{
+			if (obj->getType() != Object::Type::SKIN) continue;
+
+			const Skin* skin = (const Skin*)obj;
+			skeleton->skins.emplace_back();
+			Skeleton::SkinBones& skin_bones = skeleton->skins.back();
+			skin_bones.skin = skin;
+			skin_bones.cluster_bones.resize(skin->getClusterCount());
+			for (int i = 0, c = skin->getClusterCount(); i < c; ++i)
+			{
+				auto iter = builder.bone_map.find(skin->getCluster(i)->getLink());
+				skin_bones.cluster_bones[i] = iter == builder.bone_map.end() ? -1 : iter->second;
+			}
+		}
+	}
+
+
+	static Matrix getNodeLocal(const Object& node)
+	{
+		return node.evalLocal(node.getLocalTranslation(), node.getLocalRotation());
+	}
+
+
+	void Pose::init(const Skeleton& _skeleton)
+	{
+		skeleton = &_skeleton;
+		const int count = (int)_skeleton.bones.size();
+		locals.resize(count);
+		globals.resize(count);
+		for (int i = 0; i < count; ++i) locals[i] = getNodeLocal(*_skeleton.bones[i].node);
+
+		child_offsets.assign(count + 1, 0);
+		for (const Skeleton::Bone& bone : _skeleton.bones)
+		{
+			if (bone.parent >= 0) ++child_offsets[bone.parent + 1];
+		}
+		for (int i = 0; i < count; ++i) child_offsets[i + 1] += child_offsets[i];
+		children.resize(child_offsets[count]);
+		std::vector<int> fill(child_offsets.begin(), child_offsets.end() - 1);
+		for (int i = 0; i < count; ++i)
+		{
+			const int parent = _skeleton.bones[i].parent;
+			if (parent >= 0) children[fill[parent]++] = i;
+		}
+
+		// everything is dirty so the first update() computes all globals
+		dirty.assign(count, true);
+		dirty_bones.resize(count);
+		for (int i = 0; i < count; ++i) dirty_bones[i] = i;
+		changed.clear();
+	}
+
+
+	void Pose::setLocal(int bone, const Matrix& local)
+	{
+		assert(bone >= 0 && bone < (int)locals.size());
+		locals[bone] = local;
+		if (dirty[bone]) return;
+
+		// a dirty bone always has its whole subtree dirty, so the walk stops there
+		const size_t first = dirty_bones.size();
+		dirty[bone] = true;
+		dirty_bones.push_back(bone);
+		for (size_t i = first; i < dirty_bones.size(); ++i)
+		{
+			const int b = dirty_bones[i];
+			for (int j = child_offsets[b], end = child_offsets[b + 1]; j < end; ++j)
+			{
+				const int child = children[j];
+				if (dirty[child]) continue;
+				dirty[child] = true;
+				dirty_bones.push_back(child);
+			}
+		}
+	}
+
+
+	void Pose::resetLocal(int bone)
+	{
+		assert(skeleton);
+		setLocal(bone, getNodeLocal(*skeleton->bones[bone].node));
+	}
+
+
+	const std::vector<int>& Pose::update()
+	{
+		assert(skeleton);
+		// parents have lower indices than their children
+		std::sort(dirty_bones.begin(), dirty_bones.end());
+		for (int bone : dirty_bones)
+		{
+			const Skeleton::Bone& b = skeleton->bones[bone];
+			const Matrix parent_offset = b.parent < 0 ? b.offset : globals[b.parent] * b.offset;
+			globals[bone] = parent_offset * locals[bone];
+			dirty[bone] = false;
+		}
+		changed.swap(dirty_bones);
+		dirty_bones.clear();
+		return changed;
+	}
+
+} // namespace ofbx
@@ -0,0 +1,368 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace ofbx
+{
+
+	void gatherSkinInfluences(const Skin& skin, int vertex_count, std::vector<int>* bones, std::vector<double>* weights)
+	{
+		assert(bones && weights);
+		const int MAX = SkinPartition::MAX_INFLUENCES;
+
+		bones->assign(vertex_count * MAX, 0);
+		weights->assign(vertex_count * MAX, 0);
+		for (int cluster_idx = 0, c = skin.getClusterCount(); cluster_idx < c; ++cluster_idx)
+		{
+			const Cluster& cluster = *skin.getCluster(cluster_idx);
+			const int* indices = cluster.getIndices();
+			const double* cluster_weights = cluster.getWeights();
+			for (int i = 0, ic = cluster.getIndicesCount(); i < ic; ++i)
+			{
+				const int vertex = indices[i];
+				const double weight = cluster_weights[i];
+				if (vertex < 0 || vertex >= vertex_count || weight <= 0) continue;
+
+				// insertion into the vertex's sorted slots, the weakest influence drops out
+				int* vb = &(*bones)[vertex * MAX];
+				double* vw = &(*weights)[vertex * MAX];
+				int slot = MAX;
+				while (slot > 0 && vw[slot - 1] < weight) --slot;
+				if (slot == MAX) continue;
+				for (int j = MAX - 1; j > slot; --j)
+				{
+					vb[j] = vb[j - 1];
+					vw[j] = vw[j - 1];
+				}
+				vb[slot] = cluster_idx;
+				vw[slot] = weight;
+			}
+		}
+	}
+
+
+	struct SkinPartitioner
+	{
+		enum { MAX_TRIANGLE_BONES = 3 * SkinPartition::MAX_INFLUENCES };
+
+		SkinPartitioner(const Skin& _skin, const GeometryImpl::Data& _data, int _palette_size)
+			: skin(_skin)
+			, data(_data)
+			, palette_size(_palette_size)
+		{
+		}
+
+
+		void gatherTriangleBones()
+		{
+			const int MAX = SkinPartition::MAX_INFLUENCES;
+			const int tri_count = (int)data.triangles.size() / 3;
+			triangle_bones.resize(tri_count * MAX_TRIANGLE_BONES);
+			triangle_bone_count.resize(tri_count);
+			bone_triangles.resize(skin.getClusterCount());
+
+			for (int tri = 0; tri < tri_count; ++tri)
+			{
+				int* tb = &triangle_bones[tri * MAX_TRIANGLE_BONES];
+				int count = 0;
+				for (int i = 0; i < 3; ++i)
+				{
+					const int vertex = data.triangles[tri * 3 + i];
+					for (int j = 0; j < MAX; ++j)
+					{
+						if (weights[vertex * MAX + j] <= 0) break;
+						int bone = bones[vertex * MAX + j];
+						if (std::find(tb, tb + count, bone) == tb + count) tb[count++] = bone;
+					}
+				}
+				triangle_bone_count[tri] = count;
+				for (int i = 0; i < count; ++i) bone_triangles[tb[i]].push_back(tri);
+			}
+		}
+
+
+		void addBone(int bone, std::vector<int>* partition_triangles)
+		{
+			bone_in_partition[bone] = true;
+			partition_bones.push_back(bone);
+			for (int tri : bone_triangles[bone])
+			{
+				if (assigned[tri]) continue;
+				--missing[tri];
+				if (missing[tri] == 0)
+				{
+					assigned[tri] = true;
+					partition_triangles->push_back(tri);
+				}
+			}
+		}
+
+
+		// grows one partition: repeatedly takes the unassigned triangle needing the fewest new bones,
+		// every triangle covered by the bones added so far joins for free
+		void buildPartition(std::vector<int>* partition_triangles)
+		{
+			const int tri_count = (int)triangle_bone_count.size();
+			partition_bones.clear();
+			for (int tri = 0; tri < tri_count; ++tri)
+			{
+				if (!assigned[tri] && triangle_bone_count[tri] == 0)
+				{
+					assigned[tri] = true;
+					partition_triangles->push_back(tri);
+				}
+				missing[tri] = triangle_bone_count[tri];
+			}
+
+			for (;;)
+			{
+				const int free_slots = palette_size - (int)partition_bones.size();
+				int best = -1;
+				for (int tri = first_unassigned; tri < tri_count; ++tri)
+				{
+					if (assigned[tri]) continue;
+					if (missing[tri] > free_slots) continue;
+					if (best < 0 || missing[tri] < missing[best]) best = tri;
+					if (missing[best] == 1) break;
+				}
+				if (best < 0) break;
+
+				const int* tb = &triangle_bones[best * MAX_TRIANGLE_BONES];
+				for (int i = 0; i < triangle_bone_count[best]; ++i)
+				{
+					if (!bone_in_partition[tb[i]]) addBone(tb[i], partition_triangles);
+				}
+			}
+
+			for (int bone : partition_bones) bone_in_partition[bone] = false;
+			while (first_unassigned < tri_count && assigned[first_unassigned]) ++first_unassigned;
+		}
+
+
+		void fillPartition(const std::vector<int>& partition_triangles, SkinPartition* partition)
+		{
+			const int MAX = SkinPartition::MAX_INFLUENCES;
+			partition->bones = partition_bones;
+			for (int i = 0, c = (int)partition_bones.size(); i < c; ++i) local_bone[partition_bones[i]] = i;
+
+			partition->triangles = partition_triangles;
+			std::sort(partition->triangles.begin(), partition->triangles.end());
+			partition->indices.reserve(partition->triangles.size() * 3);
+			for (int tri : partition->triangles)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					const int vertex = data.triangles[tri * 3 + i];
+					if (local_vertex[vertex] < 0)
+					{
+						local_vertex[vertex] = (int)partition->vertices.size();
+						partition->vertices.push_back(vertex);
+					}
+					partition->indices.push_back(local_vertex[vertex]);
+				}
+			}
+
+			partition->bone_indices.resize(partition->vertices.size() * MAX);
+			partition->weights.resize(partition->vertices.size() * MAX);
+			for (int i = 0, c = (int)partition->vertices.size(); i < c; ++i)
+			{
+				const int vertex = partition->vertices[i];
+				local_vertex[vertex] = -1;
+
+				double sum = 0;
+				for (int j = 0; j < MAX; ++j) sum += weights[vertex * MAX + j];
+				for (int j = 0; j < MAX; ++j)
+				{
+					const double w = weights[vertex * MAX + j];
+					partition->bone_indices[i * MAX + j] = w > 0 ? (u8)local_bone[bones[vertex * MAX + j]] : 0;
+					partition->weights[i * MAX + j] = sum > 0 ? float(w / sum) : 0;
+				}
+			}
+		}
+
+
+		void run(std::vector<SkinPartition>* partitions)
+		{
+			const int vertex_count = (int)data.vertices.size();
+			const int tri_count = (int)data.triangles.size() / 3;
+			const int bone_count = skin.getClusterCount();
+
+			gatherSkinInfluences(skin, vertex_count, &bones, &weights);
+			gatherTriangleBones();
+
+			assigned.assign(tri_count, false);
+			missing.resize(tri_count);
+			bone_in_partition.assign(bone_count, false);
+			local_bone.assign(bone_count, -1);
+			local_vertex.assign(vertex_count, -1);
+
+			std::vector<int> partition_triangles;
+			while (first_unassigned < tri_count)
+			{
+				partition_triangles.clear();
+				buildPartition(&partition_triangles);
+				if (partition_triangles.empty()) break;
+
+				partitions->emplace_back();
+				fillPartition(partition_triangles, &partitions->back());
+			}
+		}
+
+
+		const Skin& skin;
+		const GeometryImpl::Data& data;
+		const int palette_size;
+		int first_unassigned = 0;
+		std::vector<int> bones;
+		std::vector<double> weights;
+		std::vector<int> triangle_bones;
+		std::vector<int> triangle_bone_count;
+		std::vector<std::vector<int>> bone_triangles;
+		std::vector<int> missing;
+		std::vector<bool> assigned;
+		std::vector<bool> bone_in_partition;
+		std::vector<int> partition_bones;
+		std::vector<int> local_bone;
+		std::vector<int> local_vertex;
+	};
+
+
+	void partitionSkin(GeometryImpl* geom, int palette_size)
+	{
+		assert(geom && geom->skin);
+		// a triangle can reference up to 3 * MAX_INFLUENCES bones, local indices are stored in u8
+		if (palette_size < SkinPartitioner::MAX_TRIANGLE_BONES) palette_size = SkinPartitioner::MAX_TRIANGLE_BONES;
+		if (palette_size > 256) palette_size = 256;
+
+		auto partitions = std::make_shared<std::vector<SkinPartition>>();
+		SkinPartitioner partitioner(*geom->skin, *geom->data, palette_size);
+		partitioner.run(partitions.get());
+		geom->skin_partitions = partitions;
+	}
+
+
+	void computeBoneBounds(GeometryImpl* geom, double min_weight)
+	{
+		assert(geom && geom->skin);
+		const int MAX = SkinPartition::MAX_INFLUENCES;
+		const Skin& skin = *geom->skin;
+		const std::vector<Vec3>& vertices = geom->data->vertices;
+		const int vertex_count = (int)vertices.size();
+		const int cluster_count = skin.getClusterCount();
+
+		std::vector<int> bones;
+		std::vector<double> weights;
+		gatherSkinInfluences(skin, vertex_count, &bones, &weights);
+
+		// geometry space -> link node space in bind pose
+		std::vector<Matrix> to_bone(cluster_count);
+		for (int i = 0; i < cluster_count; ++i)
+		{
+			const Cluster& cluster = *skin.getCluster(i);
+			to_bone[i] = cluster.getTransformMatrix();
+		}
+
+		const BoneBounds empty = {{DBL_MAX, DBL_MAX, DBL_MAX}, {-DBL_MAX, -DBL_MAX, -DBL_MAX}};
+		auto bounds = std::make_shared<std::vector<BoneBounds>>(cluster_count, empty);
+		for (int v = 0; v < vertex_count; ++v)
+		{
+			const int* vb = &bones[v * MAX];
+			const double* vw = &weights[v * MAX];
+			const double total = vw[0] + vw[1] + vw[2] + vw[3];
+			// influences are sorted by weight
+			for (int j = 0; j < MAX && vw[j] > 0 && (j == 0 || vw[j] >= min_weight * total); ++j)
+			{
+				const double* m = to_bone[vb[j]].m;
+				const Vec3& p = vertices[v];
+				const Vec3 q = {m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+					m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+					m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]};
+				BoneBounds& b = (*bounds)[vb[j]];
+				b.min = {std::min(b.min.x, q.x), std::min(b.min.y, q.y), std::min(b.min.z, q.z)};
+				b.max = {std::max(b.max.x, q.x), std::max(b.max.y, q.y), std::max(b.max.z, q.z)};
+			}
+		}
+		geom->bone_bounds = bounds;
+	}
+
+
+	bool getSkinnedBounds(const Geometry& geometry, const Matrix* cluster_transforms, Vec3* min, Vec3* max)
+	{
+		assert(cluster_transforms && min && max);
+		const GeometryImpl& geom = (const GeometryImpl&)geometry;
+		if (!geom.bone_bounds) return false;
+
+		// each box is transformed as center and extents, the extents by the absolute value of the matrix
+		bool any = false;
+#ifdef OFBX_SSE2
+		const __m128d abs_mask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+		__m128d min_xy = _mm_set1_pd(DBL_MAX);
+		__m128d min_z = min_xy;
+		__m128d max_xy = _mm_set1_pd(-DBL_MAX);
+		__m128d max_z = max_xy;
+		for (int i = 0, c = (int)geom.bone_bounds->size(); i < c; ++i)
+		{
+			const BoneBounds& b = (*geom.bone_bounds)[i];
+			if (b.min.x > b.max.x) continue;
+			any = true;
+
+			const double* m = cluster_transforms[i].m;
+			const __m128d c0 = _mm_loadu_pd(m + 0);
+			const __m128d c1 = _mm_loadu_pd(m + 4);
+			const __m128d c2 = _mm_loadu_pd(m + 8);
+			const __m128d z0 = _mm_load_sd(m + 2);
+			const __m128d z1 = _mm_load_sd(m + 6);
+			const __m128d z2 = _mm_load_sd(m + 10);
+			const __m128d cx = _mm_set1_pd((b.min.x + b.max.x) * 0.5);
+			const __m128d cy = _mm_set1_pd((b.min.y + b.max.y) * 0.5);
+			const __m128d cz = _mm_set1_pd((b.min.z + b.max.z) * 0.5);
+			const __m128d ex = _mm_set1_pd((b.max.x - b.min.x) * 0.5);
+			const __m128d ey = _mm_set1_pd((b.max.y - b.min.y) * 0.5);
+			const __m128d ez = _mm_set1_pd((b.max.z - b.min.z) * 0.5);
+
+			const __m128d center_xy = _mm_add_pd(
+				_mm_add_pd(_mm_mul_pd(c0, cx), _mm_mul_pd(c1, cy)), _mm_add_pd(_mm_mul_pd(c2, cz), _mm_loadu_pd(m + 12)));
+			const __m128d center_z = _mm_add_sd(
+				_mm_add_sd(_mm_mul_sd(z0, cx), _mm_mul_sd(z1, cy)), _mm_add_sd(_mm_mul_sd(z2, cz), _mm_load_sd(m + 14)));
+			const __m128d extent_xy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_and_pd(c0, abs_mask), ex), _mm_mul_pd(_mm_and_pd(c1, abs_mask), ey)),
+				_mm_mul_pd(_mm_and_pd(c2, abs_mask), ez));
+			const __m128d extent_z = _mm_add_sd(_mm_add_sd(_mm_mul_sd(_mm_and_pd(z0, abs_mask), ex), _mm_mul_sd(_mm_and_pd(z1, abs_mask), ey)),
+				_mm_mul_sd(_mm_and_pd(z2, abs_mask), ez));
+
+			min_xy = _mm_min_pd(min_xy, _mm_sub_pd(center_xy, extent_xy));
+			max_xy = _mm_max_pd(max_xy, _mm_add_pd(center_xy, extent_xy));
+			min_z = _mm_min_sd(min_z, _mm_sub_sd(center_z, extent_z));
+			max_z = _mm_max_sd(max_z, _mm_add_sd(center_z, extent_z));
+		}
+		_mm_storeu_pd(&min->x, min_xy);
+		_mm_store_sd(&min->z, min_z);
+		_mm_storeu_pd(&max->x, max_xy);
+		_mm_store_sd(&max->z, max_z);
+#else
+		*min = {DBL_MAX, DBL_MAX, DBL_MAX};
+		*max = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+		for (int i = 0, c = (int)geom.bone_bounds->size(); i < c; ++i)
+		{
+			const BoneBounds& b = (*geom.bone_bounds)[i];
+			if (b.min.x > b.max.x) continue;
+			any = true;
+
+			const double* m = cluster_transforms[i].m;
+			const double center[3] = {(b.min.x + b.max.x) * 0.5, (b.min.y + b.max.y) * 0.5, (b.min.z + b.max.z) * 0.5};
+			const double extent[3] = {(b.max.x - b.min.x) * 0.5, (b.max.y - b.min.y) * 0.5, (b.max.z - b.min.z) * 0.5};
+			double* out_min = &min->x;
+			double* out_max = &max->x;
+			for (int j = 0; j < 3; ++j)
+			{
+				const double mid = m[j] * center[0] + m[4 + j] * center[1] + m[8 + j] * center[2] + m[12 + j];
+				const double ext = fabs(m[j]) * extent[0] + fabs(m[4 + j]) * extent[1] + fabs(m[8 + j]) * extent[2];
+				out_min[j] = std::min(out_min[j], mid - ext);
+				out_max[j] = std::max(out_max[j], mid + ext);
+			}
+		}
+#endif
+		return any;
+	}
+
+} // namespace ofbx
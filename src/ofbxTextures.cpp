@@ -0,0 +1,321 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <dirent.h>
+#endif
+
+namespace ofbx
+{
+
+	struct TextureFiles
+	{
+		~TextureFiles()
+		{
+			// files not started yet are skipped, the ones being read are finished
+			cancelled = true;
+			for (std::thread& thread : threads) thread.join();
+		}
+
+
+		void startPrefetch(int thread_count)
+		{
+			done.assign(files.size(), 1);
+			int to_read = 0;
+			for (int i = 0, c = (int)files.size(); i < c; ++i)
+			{
+				if (files[i].status != TextureFile::FOUND) continue;
+				done[i] = 0;
+				++to_read;
+			}
+
+			thread_count = std::min(std::max(thread_count, 1), to_read);
+			for (int i = 0; i < thread_count; ++i) threads.push_back(startThread([this]() { prefetch(); }));
+		}
+
+
+		void prefetch()
+		{
+			for (int i = next_file++; i < (int)files.size() && !cancelled; i = next_file++)
+			{
+				if (files[i].status != TextureFile::FOUND) continue;
+
+				std::vector<u8> data;
+				const bool ok = readFile(files[i].path, &data);
+				std::lock_guard<std::mutex> lock(mutex);
+				files[i].data.swap(data);
+				files[i].status = ok ? TextureFile::READY : TextureFile::READ_FAILED;
+				done[i] = 1;
+				ready.notify_all();
+			}
+		}
+
+
+		static bool readFile(const char* path, std::vector<u8>* data)
+		{
+			FILE* fp = fopen(path, "rb");
+			if (!fp) return false;
+
+			bool ok = fseek(fp, 0, SEEK_END) == 0;
+			const long size = ok ? ftell(fp) : -1;
+			ok = size >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+			if (ok)
+			{
+				data->resize((size_t)size);
+				ok = size == 0 || fread(data->data(), 1, (size_t)size, fp) == (size_t)size;
+			}
+			fclose(fp);
+			if (!ok) data->clear();
+			return ok;
+		}
+
+
+		const TextureFile& get(int index)
+		{
+			assert(index >= 0 && index < (int)files.size());
+			if (!threads.empty())
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				ready.wait(lock, [&]() { return done[index] != 0; });
+			}
+			return files[index];
+		}
+
+
+		std::vector<TextureFile> files;
+		std::vector<std::string> paths; // TextureFile::path points into these
+		std::unordered_map<const IElement*, int> indices; // texture element -> file
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::vector<u8> done; // guarded by mutex
+		std::atomic<int> next_file{0};
+		std::atomic<bool> cancelled{false};
+	};
+
+
+	// '\' to '/', drops empty and "." segments and folds "dir/.."
+	static std::string normalizePath(std::string path)
+	{
+		std::replace(path.begin(), path.end(), '\\', '/');
+
+		std::string root;
+		if (path.compare(0, 2, "//") == 0)
+			root = "//";
+		else if (!path.empty() && path[0] == '/')
+			root = "/";
+		else if (path.size() >= 2 && path[1] == ':')
+			root = path.substr(0, path.size() > 2 && path[2] == '/' ? 3 : 2);
+
+		std::vector<std::string> segments;
+		size_t pos = root.size();
+		while (pos <= path.size())
+		{
+			size_t end = path.find('/', pos);
+			if (end == std::string::npos) end = path.size();
+			const std::string segment = path.substr(pos, end - pos);
+			pos = end + 1;
+
+			if (segment.empty() || segment == ".") continue;
+			if (segment == ".." && !segments.empty() && segments.back() != "..")
+				segments.pop_back();
+			else if (segment != ".." || root.empty())
+				segments.push_back(segment);
+		}
+
+		std::string result = root;
+		for (size_t i = 0; i < segments.size(); ++i)
+		{
+			if (i > 0) result += '/';
+			result += segments[i];
+		}
+		return result;
+	}
+
+
+	static std::string toLower(std::string str)
+	{
+		for (char& c : str) c = (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+		return str;
+	}
+
+
+	// each directory is listed once, file names are matched case-insensitively since
+	// files authored on Windows often reference textures with a different case
+	struct DirectoryCache
+	{
+		using Listing = std::unordered_map<std::string, std::string>; // lower case name -> name
+
+		const Listing& list(const std::string& dir)
+		{
+			auto iter = listings.find(dir);
+			if (iter != listings.end()) return iter->second;
+
+			Listing& listing = listings[dir];
+		#ifdef _WIN32
+			WIN32_FIND_DATAA data;
+			HANDLE handle = FindFirstFileA((dir + "/*").c_str(), &data);
+			if (handle == INVALID_HANDLE_VALUE) return listing;
+			do
+			{
+				if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+				listing.insert({toLower(data.cFileName), data.cFileName});
+			} while (FindNextFileA(handle, &data));
+			FindClose(handle);
+		#else
+			DIR* handle = opendir(dir.c_str());
+			if (!handle) return listing;
+			while (dirent* entry = readdir(handle))
+			{
+				if (entry->d_type == DT_DIR) continue;
+				listing.insert({toLower(entry->d_name), entry->d_name});
+			}
+			closedir(handle);
+		#endif
+			return listing;
+		}
+
+
+		// path is normalized
+		bool find(const std::string& path, std::string* found)
+		{
+			const size_t separator = path.find_last_of('/');
+			const std::string name = separator == std::string::npos ? path : path.substr(separator + 1);
+			if (name.empty() || name == "..") return false;
+
+			std::string dir = separator == std::string::npos ? "." : path.substr(0, separator);
+			if (dir.empty() || (dir.size() == 2 && dir[1] == ':')) dir += '/';
+			const Listing& listing = list(dir);
+			auto iter = listing.find(toLower(name));
+			if (iter == listing.end()) return false;
+
+			*found = separator == std::string::npos ? iter->second : path.substr(0, separator + 1) + iter->second;
+			return true;
+		}
+
+
+		std::unordered_map<std::string, Listing> listings;
+	};
+
+
+	struct TextureResolver
+	{
+		explicit TextureResolver(const LoadSettings& settings)
+		{
+			for (const char* path : settings.texture_search_paths)
+			{
+				if (path && path[0]) search_paths.push_back(normalizePath(path));
+			}
+			if (search_paths.empty()) search_paths.push_back(".");
+		}
+
+
+		bool resolve(const std::string& file_name, const std::string& relative_name, std::string* found)
+		{
+			if (!relative_name.empty())
+			{
+				for (const std::string& dir : search_paths)
+				{
+					if (directories.find(normalizePath(dir + "/" + relative_name), found)) return true;
+				}
+			}
+			if (!file_name.empty() && directories.find(file_name, found)) return true;
+
+			const std::string& any_name = file_name.empty() ? relative_name : file_name;
+			const std::string base_name = any_name.substr(any_name.find_last_of('/') + 1);
+			for (const std::string& dir : search_paths)
+			{
+				if (directories.find(normalizePath(dir + "/" + base_name), found)) return true;
+			}
+			return false;
+		}
+
+
+		static std::string getString(const Element& element, const char* id)
+		{
+			const Element* child = findChild(element, id);
+			if (!child || !child->first_property) return std::string();
+			const DataView& value = child->first_property->value;
+			return normalizePath(std::string((const char*)value.begin, value.end - value.begin));
+		}
+
+
+		void run(const Element& root, TextureFiles* files)
+		{
+			const Element* objects = findChild(root, "Objects");
+			if (!objects) return;
+
+			std::unordered_map<std::string, int> file_map;
+			for (const Element* element = objects->child; element; element = element->sibling)
+			{
+				if (element->id != "Texture") continue;
+
+				const std::string file_name = getString(*element, "FileName");
+				const std::string relative_name = getString(*element, "RelativeFilename");
+				if (file_name.empty() && relative_name.empty()) continue;
+
+				std::string path;
+				const bool found = resolve(file_name, relative_name, &path);
+				if (!found) path = file_name.empty() ? relative_name : file_name;
+
+				auto iter = file_map.find(path);
+				if (iter == file_map.end())
+				{
+					iter = file_map.insert({path, (int)files->files.size()}).first;
+					files->files.emplace_back();
+					files->files.back().status = found ? TextureFile::FOUND : TextureFile::NOT_FOUND;
+					files->paths.push_back(path);
+				}
+				files->indices[element] = iter->second;
+			}
+
+			for (int i = 0, c = (int)files->files.size(); i < c; ++i) files->files[i].path = files->paths[i].c_str();
+		}
+
+
+		std::vector<std::string> search_paths;
+		DirectoryCache directories;
+	};
+
+
+	void resolveTextures(Scene* scene)
+	{
+		assert(scene);
+		const LoadSettings& settings = scene->m_settings;
+		if (!settings.resolve_textures) return;
+
+		std::shared_ptr<TextureFiles> files = std::make_shared<TextureFiles>();
+		TextureResolver resolver(settings);
+		resolver.run(*scene->m_root_element, files.get());
+		if (settings.prefetch_textures) files->startPrefetch(settings.texture_io_threads);
+		scene->m_texture_files = files;
+	}
+
+
+	int Scene::getTextureFileCount() const
+	{
+		return m_texture_files ? (int)m_texture_files->files.size() : 0;
+	}
+
+
+	const TextureFile& Scene::getTextureFile(int index) const
+	{
+		assert(m_texture_files);
+		return m_texture_files->get(index);
+	}
+
+
+	const TextureFile* Scene::getTextureFile(const Texture& texture) const
+	{
+		if (!m_texture_files) return nullptr;
+		auto iter = m_texture_files->indices.find(&texture.element);
+		return iter == m_texture_files->indices.end() ? nullptr : &m_texture_files->get(iter->second);
+	}
+
+} // namespace ofbx
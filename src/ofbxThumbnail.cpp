@@ -0,0 +1,602 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace ofbx
+{
+
+	static Vec3 sub(const Vec3& a, const Vec3& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+	static Vec3 mul(const Vec3& a, double s) { return {a.x * s, a.y * s, a.z * s}; }
+	static Vec3 add(const Vec3& a, const Vec3& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+	static double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	static Vec3 cross(const Vec3& a, const Vec3& b) { return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; }
+
+
+	static Vec3 normalize(const Vec3& v)
+	{
+		const double len = sqrt(dot(v, v));
+		return len > 0 ? mul(v, 1 / len) : v;
+	}
+
+
+	static Vec3 getAxis(GlobalSettings::Axis axis, int sign)
+	{
+		Vec3 v = {0, 0, 0};
+		(&v.x)[axis] = sign < 0 ? -1 : 1;
+		return v;
+	}
+
+
+	struct ThumbnailRenderer
+	{
+		static const int TILE_SIZE = 32; // in output pixels
+
+		struct MeshData
+		{
+			const Mesh* mesh;
+			int first_vertex;
+			int first_triangle;
+			int triangle_count;
+			bool has_normals;
+		};
+
+		// in sample space, edge i is opposite to vertex i and its function a * x + b * y + c is positive inside
+		struct Triangle
+		{
+			float a[3], b[3], c[3];
+			// edges owning the samples exactly on them (top-left rule), so that samples on an edge shared
+			// by two triangles are covered once
+			bool owner[3];
+			float za, zb, zc; // 1 / depth = za * x + zb * y + zc
+			float inv_area;
+			int min_x, min_y, max_x, max_y; // covered samples, inclusive; min_x > max_x if culled
+			int vertices[3];
+			int mesh;
+			float color[3];
+			float normal[3]; // of the face, world space
+		};
+
+		// visibility buffer of one tile
+		struct Tile
+		{
+			std::vector<float> depth; // 1 / depth, 0 is empty
+			std::vector<int> ids; // triangle index
+		};
+
+
+		ThumbnailRenderer(const IScene& _scene, const ThumbnailSettings& _settings)
+			: scene(_scene)
+			, settings(_settings)
+		{
+			samples = std::max(1, std::min(settings.supersampling, 4));
+			width = settings.width * samples;
+			height = settings.height * samples;
+			thread_count = settings.thread_count > 0 ? settings.thread_count : (int)std::thread::hardware_concurrency();
+			thread_count = std::max(thread_count, 1);
+		}
+
+
+		void gatherMeshes()
+		{
+			for (int i = 0, c = scene.getMeshCount(); i < c; ++i)
+			{
+				const Mesh* mesh = scene.getMesh(i);
+				const Geometry* geom = mesh->getGeometry();
+				if (!geom || geom->getTriangleCount() == 0) continue;
+
+				meshes.push_back({mesh, vertex_count, triangle_count, (int)geom->getTriangleCount(), false});
+				vertex_count += (int)geom->getVertices().size();
+				triangle_count += (int)geom->getTriangleCount();
+			}
+		}
+
+
+		void poseMeshes()
+		{
+			positions.resize(vertex_count);
+			normals.resize((size_t)vertex_count * 3);
+			const AnimationLayer* layer = settings.stack ? settings.stack->getLayer(0) : nullptr;
+			parallelFor((int)meshes.size(), thread_count, [&](int i) {
+				MeshData& mesh = meshes[i];
+				std::vector<Vec3> mesh_positions;
+				std::vector<Vec3> mesh_normals;
+				poseMesh(*mesh.mesh, layer, settings.time, &mesh_positions, &mesh_normals);
+				std::copy(mesh_positions.begin(), mesh_positions.end(), positions.begin() + mesh.first_vertex);
+
+				mesh.has_normals = mesh_normals.size() == mesh_positions.size();
+				if (!mesh.has_normals) return;
+				float* out = &normals[(size_t)mesh.first_vertex * 3];
+				for (const Vec3& n : mesh_normals)
+				{
+					*out++ = (float)n.x;
+					*out++ = (float)n.y;
+					*out++ = (float)n.z;
+				}
+			});
+		}
+
+
+		// min and max of dot(p - origin, axis) over all vertices for each axis
+		void getExtents(const Vec3& origin, const Vec3* axes, double* min, double* max) const
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				min[j] = DBL_MAX;
+				max[j] = -DBL_MAX;
+			}
+			for (const Vec3& p : positions)
+			{
+				const Vec3 d = sub(p, origin);
+				for (int j = 0; j < 3; ++j)
+				{
+					const double v = dot(d, axes[j]);
+					min[j] = std::min(min[j], v);
+					max[j] = std::max(max[j], v);
+				}
+			}
+		}
+
+
+		// camera looking at the center of the bounds from the settings' direction, as close as all vertices allow
+		bool placeCamera()
+		{
+			const Scene& impl = (const Scene&)scene;
+			const GlobalSettings& space = impl.m_settings.convert_coordinates ? impl.m_settings.target_space : impl.m_global_settings;
+			const Vec3 up = getAxis(space.up_axis, space.up_axis_sign);
+			const Vec3 front = getAxis(space.front_axis, space.front_axis_sign);
+			const Vec3 coord = getAxis(space.coord_axis, space.coord_axis_sign);
+			// left-handed scenes would come out mirrored
+			const double handedness = dot(cross(coord, up), front) < 0 ? -1 : 1;
+
+			const double deg = 3.14159265358979323846 / 180;
+			const double yaw = settings.yaw * deg;
+			const double pitch = std::max(-89.0, std::min(89.0, settings.pitch)) * deg;
+			to_camera = add(mul(add(mul(front, cos(yaw)), mul(coord, sin(yaw))), cos(pitch)), mul(up, sin(pitch)));
+			camera_up = normalize(sub(up, mul(to_camera, dot(up, to_camera))));
+			right = mul(cross(camera_up, to_camera), handedness);
+			scene_up = up;
+			light = normalize(add(to_camera, add(mul(camera_up, 0.8), mul(right, -0.6))));
+
+			const Vec3 world_axes[] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+			double min[3], max[3];
+			getExtents({0, 0, 0}, world_axes, min, max);
+			const double radius = 0.5 * sqrt((max[0] - min[0]) * (max[0] - min[0]) + (max[1] - min[1]) * (max[1] - min[1]) +
+				(max[2] - min[2]) * (max[2] - min[2]));
+			if (!(radius > 0) || radius == DBL_MAX) return false;
+
+			// center the view space box, then move back until every vertex is inside the frustum
+			target = {0.5 * (min[0] + max[0]), 0.5 * (min[1] + max[1]), 0.5 * (min[2] + max[2])};
+			const Vec3 view_axes[] = {right, camera_up, to_camera};
+			getExtents(target, view_axes, min, max);
+			target = add(target, add(mul(right, 0.5 * (min[0] + max[0])), mul(camera_up, 0.5 * (min[1] + max[1]))));
+
+			tan_y = tan(std::max(1.0, std::min(170.0, settings.fov)) * 0.5 * deg);
+			tan_x = tan_y * settings.width / settings.height;
+			fitDistance(radius);
+			// perspective makes the projection lopsided, center it on the screen and fit again
+			for (int i = 0; i < 2; ++i)
+			{
+				double screen_min[2] = {DBL_MAX, DBL_MAX};
+				double screen_max[2] = {-DBL_MAX, -DBL_MAX};
+				for (const Vec3& p : positions)
+				{
+					const Vec3 d = sub(p, target);
+					const double depth = distance - dot(d, to_camera);
+					const double screen[2] = {dot(d, right) / depth, dot(d, camera_up) / depth};
+					for (int j = 0; j < 2; ++j)
+					{
+						screen_min[j] = std::min(screen_min[j], screen[j]);
+						screen_max[j] = std::max(screen_max[j], screen[j]);
+					}
+				}
+				const double shift_x = 0.5 * (screen_min[0] + screen_max[0]) * distance;
+				const double shift_y = 0.5 * (screen_min[1] + screen_max[1]) * distance;
+				target = add(target, add(mul(right, shift_x), mul(camera_up, shift_y)));
+				fitDistance(radius);
+			}
+			return true;
+		}
+
+
+		// closest distance from the target with every vertex in the view
+		void fitDistance(double radius)
+		{
+			const double fill = 1 - 2 * std::max(0.0, std::min(0.45, settings.margin));
+			distance = 0;
+			double max_z = -DBL_MAX;
+			for (const Vec3& p : positions)
+			{
+				const Vec3 d = sub(p, target);
+				const double x = fabs(dot(d, right)) / (tan_x * fill);
+				const double y = fabs(dot(d, camera_up)) / (tan_y * fill);
+				const double z = dot(d, to_camera);
+				distance = std::max(distance, std::max(x, y) + z);
+				max_z = std::max(max_z, z);
+			}
+			// vertices exactly on the view axis need some depth too
+			distance = std::max(distance, max_z + radius * 1e-3);
+		}
+
+
+		// sample space x, y and 1 / depth of every vertex
+		void project()
+		{
+			screen.resize((size_t)vertex_count * 3);
+			const double scale_x = 0.5 * width / tan_x;
+			const double scale_y = 0.5 * height / tan_y;
+			parallelFor((int)meshes.size(), thread_count, [&](int i) {
+				const int first = meshes[i].first_vertex;
+				const int count = (int)meshes[i].mesh->getGeometry()->getVertices().size();
+				for (int v = first; v < first + count; ++v)
+				{
+					const Vec3 d = sub(positions[v], target);
+					const double inv_depth = 1 / (distance - dot(d, to_camera));
+					screen[v * 3 + 0] = float(0.5 * width + dot(d, right) * inv_depth * scale_x);
+					screen[v * 3 + 1] = float(0.5 * height - dot(d, camera_up) * inv_depth * scale_y);
+					screen[v * 3 + 2] = (float)inv_depth;
+				}
+			});
+		}
+
+
+		void setupTriangle(const MeshData& mesh, int index, const Vec3* colors, int color_count, Triangle* tri) const
+		{
+			const Geometry& geom = *mesh.mesh->getGeometry();
+			const int* indices = &geom.getTriangles()[index * 3];
+			int v[3] = {mesh.first_vertex + indices[0], mesh.first_vertex + indices[1], mesh.first_vertex + indices[2]};
+			tri->min_x = 1;
+			tri->max_x = 0;
+
+			const float* p0 = &screen[v[0] * 3];
+			const float* p1 = &screen[v[1] * 3];
+			const float* p2 = &screen[v[2] * 3];
+			float area = (p1[1] - p2[1]) * p0[0] + (p2[0] - p1[0]) * p0[1] + (p1[0] * p2[1] - p1[1] * p2[0]);
+			if (area == 0 || !(area == area)) return;
+			// two-sided, wind every triangle the same way
+			if (area < 0)
+			{
+				std::swap(v[1], v[2]);
+				area = -area;
+			}
+
+			const float* p[3] = {&screen[v[0] * 3], &screen[v[1] * 3], &screen[v[2] * 3]};
+			float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+			for (int i = 0; i < 3; ++i)
+			{
+				const float* a = p[(i + 1) % 3];
+				const float* b = p[(i + 2) % 3];
+				tri->a[i] = a[1] - b[1];
+				tri->b[i] = b[0] - a[0];
+				tri->c[i] = a[0] * b[1] - a[1] * b[0];
+				tri->owner[i] = tri->a[i] > 0 || (tri->a[i] == 0 && tri->b[i] > 0);
+				min_x = std::min(min_x, p[i][0]);
+				min_y = std::min(min_y, p[i][1]);
+				max_x = std::max(max_x, p[i][0]);
+				max_y = std::max(max_y, p[i][1]);
+			}
+			tri->inv_area = 1 / area;
+			tri->za = (tri->a[0] * p[0][2] + tri->a[1] * p[1][2] + tri->a[2] * p[2][2]) * tri->inv_area;
+			tri->zb = (tri->b[0] * p[0][2] + tri->b[1] * p[1][2] + tri->b[2] * p[2][2]) * tri->inv_area;
+			tri->zc = (tri->c[0] * p[0][2] + tri->c[1] * p[1][2] + tri->c[2] * p[2][2]) * tri->inv_area;
+
+			// samples are at pixel centers
+			tri->min_x = std::max(0, (int)ceilf(min_x - 0.5f));
+			tri->min_y = std::max(0, (int)ceilf(min_y - 0.5f));
+			tri->max_x = std::min(width - 1, (int)floorf(max_x - 0.5f));
+			tri->max_y = std::min(height - 1, (int)floorf(max_y - 0.5f));
+			for (int i = 0; i < 3; ++i) tri->vertices[i] = v[i];
+			tri->mesh = int(&mesh - &meshes[0]);
+
+			const int* materials = geom.getMaterials();
+			const int material = materials ? materials[index] : 0;
+			const Vec3 color = material >= 0 && material < color_count ? colors[material] : Vec3{0.8, 0.8, 0.8};
+			tri->color[0] = (float)color.x;
+			tri->color[1] = (float)color.y;
+			tri->color[2] = (float)color.z;
+
+			const Vec3& w0 = positions[v[0]];
+			Vec3 normal = normalize(cross(sub(positions[v[1]], w0), sub(positions[v[2]], w0)));
+			if (dot(normal, normal) == 0) normal = to_camera;
+			tri->normal[0] = (float)normal.x;
+			tri->normal[1] = (float)normal.y;
+			tri->normal[2] = (float)normal.z;
+		}
+
+
+		void setupTriangles()
+		{
+			triangles.resize(triangle_count);
+			parallelFor((int)meshes.size(), thread_count, [&](int i) {
+				const MeshData& mesh = meshes[i];
+				std::vector<Vec3> colors(mesh.mesh->getMaterialCount());
+				for (int j = 0, c = (int)colors.size(); j < c; ++j)
+				{
+					const Material* material = mesh.mesh->getMaterial(j);
+					colors[j] = material ? material->getDiffuseColor() : Vec3{0.8, 0.8, 0.8};
+				}
+				for (int j = 0; j < mesh.triangle_count; ++j)
+				{
+					setupTriangle(mesh, j, colors.data(), (int)colors.size(), &triangles[mesh.first_triangle + j]);
+				}
+			});
+		}
+
+
+		// each job bins a contiguous range of triangles into its own lists, so tiles see triangles in a fixed order
+		void binTriangles()
+		{
+			const int tile_samples = TILE_SIZE * samples;
+			tiles_x = (width + tile_samples - 1) / tile_samples;
+			tiles_y = (height + tile_samples - 1) / tile_samples;
+			const int MIN_JOB_TRIANGLES = 4096;
+			bin_jobs = std::max(1, std::min(thread_count, triangle_count / MIN_JOB_TRIANGLES));
+			bins.resize((size_t)bin_jobs * tiles_x * tiles_y);
+			parallelFor(bin_jobs, bin_jobs, [&](int job) {
+				std::vector<int>* job_bins = &bins[(size_t)job * tiles_x * tiles_y];
+				const int from = int((long long)triangle_count * job / bin_jobs);
+				const int to = int((long long)triangle_count * (job + 1) / bin_jobs);
+				for (int i = from; i < to; ++i)
+				{
+					const Triangle& tri = triangles[i];
+					if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) continue;
+					for (int y = tri.min_y / tile_samples, ye = tri.max_y / tile_samples; y <= ye; ++y)
+					{
+						for (int x = tri.min_x / tile_samples, xe = tri.max_x / tile_samples; x <= xe; ++x)
+						{
+							job_bins[y * tiles_x + x].push_back(i);
+						}
+					}
+				}
+			});
+		}
+
+
+		// tile_x, tile_y is the tile's first sample, its rows are tile_size samples long
+		void rasterize(int id, int tile_x, int tile_y, int tile_size, Tile* tile) const
+		{
+			const Triangle& tri = triangles[id];
+			const int x0 = std::max(tri.min_x, tile_x);
+			const int y0 = std::max(tri.min_y, tile_y);
+			const int x1 = std::min(tri.max_x, tile_x + tile_size - 1);
+			const int y1 = std::min(tri.max_y, tile_y + tile_size - 1);
+			if (x0 > x1 || y0 > y1) return;
+
+#ifdef OFBX_SSE2
+			// groups of 4 samples aligned to the tile, tile_size is a multiple of 4
+			const int first_x = x0 - ((x0 - tile_x) & 3);
+			const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128i id4 = _mm_set1_epi32(id);
+			const __m128 za = _mm_set1_ps(tri.za);
+			__m128 a[3], owner[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				a[i] = _mm_set1_ps(tri.a[i]);
+				owner[i] = _mm_castsi128_ps(_mm_set1_epi32(tri.owner[i] ? -1 : 0));
+			}
+			for (int y = y0; y <= y1; ++y)
+			{
+				const float py = y + 0.5f;
+				__m128 row[3];
+				for (int i = 0; i < 3; ++i) row[i] = _mm_set1_ps(tri.b[i] * py + tri.c[i]);
+				const __m128 z_row = _mm_set1_ps(tri.zb * py + tri.zc);
+				float* depth = &tile->depth[(y - tile_y) * tile_size - tile_x];
+				int* ids = &tile->ids[(y - tile_y) * tile_size - tile_x];
+				for (int x = first_x; x <= x1; x += 4)
+				{
+					const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+					__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+					for (int i = 0; i < 3; ++i)
+					{
+						const __m128 e = _mm_add_ps(_mm_mul_ps(a[i], px), row[i]);
+						const __m128 on_edge = _mm_and_ps(_mm_cmpeq_ps(e, zero), owner[i]);
+						inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(e, zero), on_edge));
+					}
+					if (_mm_movemask_ps(inside) == 0) continue;
+
+					const __m128 z = _mm_add_ps(_mm_mul_ps(za, px), z_row);
+					const __m128 old_z = _mm_loadu_ps(depth + x);
+					const __m128 mask = _mm_and_ps(inside, _mm_cmpgt_ps(z, old_z));
+					_mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, old_z)));
+					const __m128i imask = _mm_castps_si128(mask);
+					const __m128i old_id = _mm_loadu_si128((const __m128i*)(ids + x));
+					_mm_storeu_si128((__m128i*)(ids + x), _mm_or_si128(_mm_and_si128(imask, id4), _mm_andnot_si128(imask, old_id)));
+				}
+			}
+#else
+			for (int y = y0; y <= y1; ++y)
+			{
+				const float py = y + 0.5f;
+				float row[3];
+				for (int i = 0; i < 3; ++i) row[i] = tri.b[i] * py + tri.c[i];
+				const float z_row = tri.zb * py + tri.zc;
+				float* depth = &tile->depth[(y - tile_y) * tile_size - tile_x];
+				int* ids = &tile->ids[(y - tile_y) * tile_size - tile_x];
+				for (int x = x0; x <= x1; ++x)
+				{
+					const float px = x + 0.5f;
+					bool inside = true;
+					for (int i = 0; i < 3; ++i)
+					{
+						const float e = tri.a[i] * px + row[i];
+						inside = inside && (e > 0 || (e == 0 && tri.owner[i]));
+					}
+					const float z = tri.za * px + z_row;
+					if (inside && z > depth[x])
+					{
+						depth[x] = z;
+						ids[x] = id;
+					}
+				}
+			}
+#endif
+		}
+
+
+		// lit color of the sample at x, y covered by triangle id
+		void shade(int id, float x, float y, float* rgb) const
+		{
+			const Triangle& tri = triangles[id];
+			Vec3 n = {tri.normal[0], tri.normal[1], tri.normal[2]};
+			if (meshes[tri.mesh].has_normals)
+			{
+				// perspective correct barycentrics
+				float w[3];
+				float sum = 0;
+				for (int i = 0; i < 3; ++i)
+				{
+					const float e = std::max(0.0f, tri.a[i] * x + tri.b[i] * y + tri.c[i]);
+					w[i] = e * screen[tri.vertices[i] * 3 + 2];
+					sum += w[i];
+				}
+				if (sum > 0)
+				{
+					Vec3 interpolated = {0, 0, 0};
+					for (int i = 0; i < 3; ++i)
+					{
+						const float* vn = &normals[(size_t)tri.vertices[i] * 3];
+						interpolated = add(interpolated, mul(Vec3{vn[0], vn[1], vn[2]}, w[i] / sum));
+					}
+					interpolated = normalize(interpolated);
+					if (dot(interpolated, interpolated) > 0) n = interpolated;
+				}
+			}
+			if (dot(n, to_camera) < 0) n = mul(n, -1);
+
+			const double sky = 0.15 + 0.2 * (0.5 + 0.5 * dot(n, scene_up));
+			const double intensity = sky + 0.7 * std::max(0.0, dot(n, light));
+			for (int i = 0; i < 3; ++i) rgb[i] = std::min(1.0f, tri.color[i] * (float)intensity);
+		}
+
+
+		void renderTile(int index, Tile* tile, u8* rgba) const
+		{
+			const int tile_size = TILE_SIZE * samples;
+			const int tile_x = (index % tiles_x) * tile_size;
+			const int tile_y = (index / tiles_x) * tile_size;
+			tile->depth.assign(tile_size * tile_size, 0.0f);
+			tile->ids.assign(tile_size * tile_size, -1);
+			for (int job = 0; job < bin_jobs; ++job)
+			{
+				for (int id : bins[(size_t)job * tiles_x * tiles_y + index]) rasterize(id, tile_x, tile_y, tile_size, tile);
+			}
+
+			// resolve with premultiplied alpha, so that the background color doesn't bleed into covered edges
+			const Vec4& bg = settings.background;
+			const float inv_count = 1.0f / (samples * samples);
+			const int out_x0 = tile_x / samples;
+			const int out_y0 = tile_y / samples;
+			const int out_x1 = std::min(out_x0 + TILE_SIZE, settings.width);
+			const int out_y1 = std::min(out_y0 + TILE_SIZE, settings.height);
+			for (int oy = out_y0; oy < out_y1; ++oy)
+			{
+				for (int ox = out_x0; ox < out_x1; ++ox)
+				{
+					float sum[4] = {0, 0, 0, 0};
+					for (int sy = oy * samples; sy < (oy + 1) * samples; ++sy)
+					{
+						for (int sx = ox * samples; sx < (ox + 1) * samples; ++sx)
+						{
+							const int id = tile->ids[(sy - tile_y) * tile_size + sx - tile_x];
+							if (id < 0)
+							{
+								sum[0] += float(bg.x * bg.w);
+								sum[1] += float(bg.y * bg.w);
+								sum[2] += float(bg.z * bg.w);
+								sum[3] += (float)bg.w;
+								continue;
+							}
+							float rgb[3];
+							shade(id, sx + 0.5f, sy + 0.5f, rgb);
+							sum[0] += rgb[0];
+							sum[1] += rgb[1];
+							sum[2] += rgb[2];
+							sum[3] += 1;
+						}
+					}
+
+					u8* out = &rgba[((size_t)oy * settings.width + ox) * 4];
+					const float alpha = sum[3] * inv_count;
+					for (int i = 0; i < 3; ++i)
+					{
+						const float c = sum[3] > 0 ? sum[i] / sum[3] : 0;
+						out[i] = (u8)(std::max(0.0f, std::min(1.0f, c)) * 255 + 0.5f);
+					}
+					out[3] = (u8)(std::max(0.0f, std::min(1.0f, alpha)) * 255 + 0.5f);
+				}
+			}
+		}
+
+
+		void render(u8* rgba)
+		{
+			const int tile_count = tiles_x * tiles_y;
+			const int job_count = std::max(1, std::min(thread_count, tile_count));
+			std::atomic<int> next_tile(0);
+			parallelFor(job_count, job_count, [&](int) {
+				Tile tile;
+				for (int i = next_tile++; i < tile_count; i = next_tile++) renderTile(i, &tile, rgba);
+			});
+		}
+
+
+		const IScene& scene;
+		const ThumbnailSettings& settings;
+		int samples;
+		int width; // in samples
+		int height;
+		int thread_count;
+
+		std::vector<MeshData> meshes;
+		int vertex_count = 0;
+		int triangle_count = 0;
+		std::vector<Vec3> positions; // world space
+		std::vector<float> normals; // world space, 3 per vertex, only for meshes with normals
+		std::vector<float> screen; // 3 per vertex, see project()
+		std::vector<Triangle> triangles;
+
+		Vec3 target;
+		Vec3 to_camera; // unit vector from the target to the camera
+		Vec3 camera_up;
+		Vec3 right;
+		double distance = 0;
+		double tan_x = 0;
+		double tan_y = 0;
+		Vec3 scene_up;
+		Vec3 light;
+
+		int tiles_x = 0;
+		int tiles_y = 0;
+		int bin_jobs = 0;
+		std::vector<std::vector<int>> bins; // [job][tile] triangle indices
+	};
+
+
+	bool renderThumbnail(const IScene& scene, const ThumbnailSettings& settings, std::vector<u8>* rgba)
+	{
+		assert(rgba);
+		rgba->clear();
+		if (settings.width <= 0 || settings.height <= 0 || settings.width > 16384 || settings.height > 16384)
+		{
+			Error::s_message = "Invalid thumbnail size";
+			return false;
+		}
+
+		ThumbnailRenderer renderer(scene, settings);
+		renderer.gatherMeshes();
+		renderer.poseMeshes();
+		if (renderer.meshes.empty() || !renderer.placeCamera())
+		{
+			Error::s_message = "Nothing to render";
+			return false;
+		}
+		renderer.project();
+		renderer.setupTriangles();
+		renderer.binTriangles();
+		rgba->resize((size_t)settings.width * settings.height * 4);
+		renderer.render(rgba->data());
+		return true;
+	}
+
+} // namespace ofbx
@@ -0,0 +1,308 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+namespace ofbx
+{
+
+	struct SceneTiler
+	{
+		enum { MAX_OCTREE_DEPTH = 20 };
+
+		struct MeshInfo
+		{
+			const Mesh* mesh = nullptr;
+			Vec3 min;
+			Vec3 max;
+			std::vector<Vec3> centers; // world-space triangle centers, only if the mesh is split
+			std::vector<Vec3> points; // world-space vertices, only if the mesh is split
+		};
+
+		// whole mesh (triangle < 0) or one triangle of a split mesh
+		struct Item
+		{
+			int mesh;
+			int triangle;
+			int triangle_count;
+			Vec3 center;
+		};
+
+
+		SceneTiler(const IScene& _scene, const TilingSettings& _settings, std::vector<SceneCell>* _cells)
+			: scene(_scene)
+			, settings(_settings)
+			, cells(_cells)
+		{
+		}
+
+
+		static double get(const Vec3& v, int axis) { return (&v.x)[axis]; }
+
+
+		bool isBiggerThanCell(const Vec3& min, const Vec3& max) const
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const double size = get(settings.cell_size, axis);
+				if (size > 0 && get(max, axis) - get(min, axis) > size) return true;
+			}
+			return false;
+		}
+
+
+		void gatherMesh(MeshInfo* info)
+		{
+			const Mesh& mesh = *info->mesh;
+			const Geometry* geom = mesh.getGeometry();
+			if (!geom || geom->getVertices().empty() || geom->getTriangleCount() == 0)
+			{
+				info->mesh = nullptr;
+				return;
+			}
+
+			std::vector<Vec3> points = geom->getVertices();
+			transformPoints(mesh.getGlobalTransform() * mesh.getGeometricMatrix(), &points[0], (int)points.size());
+
+			info->min = {DBL_MAX, DBL_MAX, DBL_MAX};
+			info->max = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+			for (const Vec3& p : points)
+			{
+				info->min = {std::min(info->min.x, p.x), std::min(info->min.y, p.y), std::min(info->min.z, p.z)};
+				info->max = {std::max(info->max.x, p.x), std::max(info->max.y, p.y), std::max(info->max.z, p.z)};
+			}
+
+			if (!settings.split_meshes || !isBiggerThanCell(info->min, info->max)) return;
+
+			const std::vector<int>& triangles = geom->getTriangles();
+			info->centers.resize(triangles.size() / 3);
+			for (int tri = 0, count = (int)info->centers.size(); tri < count; ++tri)
+			{
+				const Vec3& a = points[triangles[tri * 3]];
+				const Vec3& b = points[triangles[tri * 3 + 1]];
+				const Vec3& c = points[triangles[tri * 3 + 2]];
+				info->centers[tri] = {(a.x + b.x + c.x) / 3, (a.y + b.y + c.y) / 3, (a.z + b.z + c.z) / 3};
+			}
+			info->points = std::move(points);
+		}
+
+
+		static void addBounds(const Vec3& min, const Vec3& max, SceneCell* cell)
+		{
+			cell->bounds_min = {std::min(cell->bounds_min.x, min.x), std::min(cell->bounds_min.y, min.y), std::min(cell->bounds_min.z, min.z)};
+			cell->bounds_max = {std::max(cell->bounds_max.x, max.x), std::max(cell->bounds_max.y, max.y), std::max(cell->bounds_max.z, max.z)};
+		}
+
+
+		void gatherItems()
+		{
+			bounds_min = {DBL_MAX, DBL_MAX, DBL_MAX};
+			bounds_max = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+			for (int i = 0, c = (int)meshes.size(); i < c; ++i)
+			{
+				const MeshInfo& info = meshes[i];
+				if (!info.mesh) continue;
+
+				bounds_min = {std::min(bounds_min.x, info.min.x), std::min(bounds_min.y, info.min.y), std::min(bounds_min.z, info.min.z)};
+				bounds_max = {std::max(bounds_max.x, info.max.x), std::max(bounds_max.y, info.max.y), std::max(bounds_max.z, info.max.z)};
+
+				if (info.centers.empty())
+				{
+					const Vec3 center = {(info.min.x + info.max.x) * 0.5, (info.min.y + info.max.y) * 0.5, (info.min.z + info.max.z) * 0.5};
+					items.push_back({i, -1, (int)info.mesh->getGeometry()->getTriangleCount(), center});
+					continue;
+				}
+				for (int tri = 0, tc = (int)info.centers.size(); tri < tc; ++tri)
+				{
+					items.push_back({i, tri, 1, info.centers[tri]});
+				}
+			}
+		}
+
+
+		// items of one mesh are contiguous and keep their order, so parts are built in a single pass
+		void emitCell(int level, int x, int y, int z, const Vec3& min, const Vec3& max, const Item* begin, const Item* end)
+		{
+			if (begin == end) return;
+
+			cells->emplace_back();
+			SceneCell& cell = cells->back();
+			cell.level = level;
+			cell.x = x;
+			cell.y = y;
+			cell.z = z;
+			cell.min = min;
+			cell.max = max;
+			cell.bounds_min = {DBL_MAX, DBL_MAX, DBL_MAX};
+			cell.bounds_max = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+			for (const Item* item = begin; item != end; ++item)
+			{
+				const MeshInfo& info = meshes[item->mesh];
+				if (item->triangle < 0 || cell.parts.empty() || cell.parts.back().mesh != info.mesh)
+				{
+					cell.parts.push_back({info.mesh, {}});
+				}
+				if (item->triangle < 0)
+				{
+					addBounds(info.min, info.max, &cell);
+					continue;
+				}
+
+				cell.parts.back().triangles.push_back(item->triangle);
+				const int* tri = &info.mesh->getGeometry()->getTriangles()[item->triangle * 3];
+				for (int i = 0; i < 3; ++i) addBounds(info.points[tri[i]], info.points[tri[i]], &cell);
+			}
+		}
+
+
+		void buildGrid()
+		{
+			struct Key
+			{
+				int x, y, z;
+			};
+
+			std::vector<Key> keys(items.size());
+			for (int i = 0, c = (int)items.size(); i < c; ++i)
+			{
+				int coords[3];
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					const double size = get(settings.cell_size, axis);
+					coords[axis] = size > 0 ? (int)std::floor(get(items[i].center, axis) / size) : 0;
+				}
+				keys[i] = {coords[0], coords[1], coords[2]};
+			}
+
+			// stable, so items of a mesh stay together in each cell
+			std::vector<int> order(items.size());
+			for (int i = 0, c = (int)order.size(); i < c; ++i) order[i] = i;
+			std::stable_sort(order.begin(), order.end(), [&keys](int a, int b) {
+				const Key& ka = keys[a];
+				const Key& kb = keys[b];
+				if (ka.z != kb.z) return ka.z < kb.z;
+				if (ka.y != kb.y) return ka.y < kb.y;
+				return ka.x < kb.x;
+			});
+
+			std::vector<Item> sorted(items.size());
+			for (int i = 0, c = (int)order.size(); i < c; ++i) sorted[i] = items[order[i]];
+
+			for (int begin = 0, c = (int)sorted.size(); begin < c;)
+			{
+				const Key& key = keys[order[begin]];
+				int end = begin + 1;
+				while (end < c && keys[order[end]].x == key.x && keys[order[end]].y == key.y && keys[order[end]].z == key.z) ++end;
+
+				Vec3 min = bounds_min;
+				Vec3 max = bounds_max;
+				const int coords[] = {key.x, key.y, key.z};
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					const double size = get(settings.cell_size, axis);
+					if (size <= 0) continue;
+					(&min.x)[axis] = coords[axis] * size;
+					(&max.x)[axis] = (coords[axis] + 1) * size;
+				}
+				emitCell(0, key.x, key.y, key.z, min, max, &sorted[begin], &sorted[0] + end);
+				begin = end;
+			}
+		}
+
+
+		void buildOctree(int level, int x, int y, int z, const Vec3& min, const Vec3& max, Item* begin, Item* end)
+		{
+			if (begin == end) return;
+
+			int triangle_count = 0;
+			for (const Item* item = begin; item != end; ++item) triangle_count += item->triangle_count;
+
+			const Vec3 center = {(min.x + max.x) * 0.5, (min.y + max.y) * 0.5, (min.z + max.z) * 0.5};
+			// items sharing one center can't be separated, the depth limit stops the recursion
+			bool too_small = level >= MAX_OCTREE_DEPTH;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const double size = get(settings.cell_size, axis);
+				if (size > 0 && get(center, axis) - get(min, axis) < size) too_small = true;
+			}
+			if (triangle_count <= settings.max_cell_triangles || too_small)
+			{
+				emitCell(level, x, y, z, min, max, begin, end);
+				return;
+			}
+
+			// split into octants, stable so items of a mesh stay together
+			Item* split_x = std::stable_partition(begin, end, [&](const Item& item) { return item.center.x < center.x; });
+			Item* bounds[9] = {begin, nullptr, nullptr, nullptr, split_x, nullptr, nullptr, nullptr, end};
+			for (int i = 0; i < 8; i += 4)
+			{
+				bounds[i + 2] = std::stable_partition(bounds[i], bounds[i + 4], [&](const Item& item) { return item.center.y < center.y; });
+			}
+			for (int i = 0; i < 8; i += 2)
+			{
+				bounds[i + 1] = std::stable_partition(bounds[i], bounds[i + 2], [&](const Item& item) { return item.center.z < center.z; });
+			}
+
+			for (int i = 0; i < 8; ++i)
+			{
+				const int cx = (i >> 2) & 1;
+				const int cy = (i >> 1) & 1;
+				const int cz = i & 1;
+				const Vec3 child_min = {cx ? center.x : min.x, cy ? center.y : min.y, cz ? center.z : min.z};
+				const Vec3 child_max = {cx ? max.x : center.x, cy ? max.y : center.y, cz ? max.z : center.z};
+				buildOctree(level + 1, x * 2 + cx, y * 2 + cy, z * 2 + cz, child_min, child_max, bounds[i], bounds[i + 1]);
+			}
+		}
+
+
+		void run()
+		{
+			meshes.resize(scene.getMeshCount());
+			for (int i = 0, c = (int)meshes.size(); i < c; ++i) meshes[i].mesh = scene.getMesh(i);
+			parallelFor((int)meshes.size(), settings.thread_count, [this](int i) { gatherMesh(&meshes[i]); });
+
+			gatherItems();
+			if (items.empty()) return;
+
+			if (settings.mode == TilingSettings::GRID)
+			{
+				buildGrid();
+			}
+			else
+			{
+				// cubic root node around the scene
+				const double size = std::max(bounds_max.x - bounds_min.x, std::max(bounds_max.y - bounds_min.y, bounds_max.z - bounds_min.z));
+				const Vec3 max = {bounds_min.x + size, bounds_min.y + size, bounds_min.z + size};
+				buildOctree(0, 0, 0, 0, bounds_min, max, &items[0], &items[0] + items.size());
+			}
+
+			if (settings.merge)
+			{
+				parallelFor((int)cells->size(), settings.thread_count, [this](int i) {
+					SceneCell& cell = (*cells)[i];
+					batchMeshParts(cell.parts, settings.batch_settings, &cell.batches);
+				});
+			}
+		}
+
+
+		const IScene& scene;
+		const TilingSettings& settings;
+		std::vector<SceneCell>* cells;
+		std::vector<MeshInfo> meshes;
+		std::vector<Item> items;
+		Vec3 bounds_min;
+		Vec3 bounds_max;
+	};
+
+
+	void tileScene(const IScene& scene, const TilingSettings& settings, std::vector<SceneCell>* cells)
+	{
+		assert(cells);
+
+		cells->clear();
+		SceneTiler tiler(scene, settings, cells);
+		tiler.run();
+	}
+
+} // namespace ofbx
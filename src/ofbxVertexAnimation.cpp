@@ -0,0 +1,386 @@
+#include "ofbxImp.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace ofbx
+{
+
+	struct VertexAnimationBaker
+	{
+		// a node whose global transform is needed, parents are before their children
+		struct Node
+		{
+			const Object* object;
+			int parent;
+			const AnimationCurveNode* translation;
+			const AnimationCurveNode* rotation;
+		};
+
+		struct Channel
+		{
+			const BlendShapeChannel* channel;
+			const AnimationCurveNode* deform_percent;
+		};
+
+		// per thread temporaries
+		struct Frame
+		{
+			std::vector<Matrix> globals;
+			std::vector<Vec3> positions;
+			std::vector<Vec3> normals;
+			std::vector<Vec3> skinned_positions;
+			std::vector<Vec3> skinned_normals;
+			std::vector<double> weight_sums;
+			std::vector<double> shape_weights;
+		};
+
+
+		VertexAnimationBaker(const Mesh& _mesh, const AnimationLayer* _layer)
+			: mesh(_mesh)
+			, geom(*_mesh.getGeometry())
+			, layer(_layer)
+		{
+		}
+
+
+		int addNode(const Object* object)
+		{
+			auto iter = node_map.find(object);
+			if (iter != node_map.end()) return iter->second;
+
+			const Object* parent_object = object->getParent();
+			const int parent = parent_object ? addNode(parent_object) : -1;
+			Node node = {object, parent, nullptr, nullptr};
+			if (layer)
+			{
+				node.translation = layer->getCurveNode(*object, "Lcl Translation");
+				node.rotation = layer->getCurveNode(*object, "Lcl Rotation");
+			}
+			node_map[object] = (int)nodes.size();
+			nodes.push_back(node);
+			return (int)nodes.size() - 1;
+		}
+
+
+		void init()
+		{
+			mesh_node = addNode(&mesh);
+			const Skin* skin = geom.getSkin();
+			if (skin)
+			{
+				for (int i = 0, c = skin->getClusterCount(); i < c; ++i)
+				{
+					const Cluster& cluster = *skin->getCluster(i);
+					cluster_nodes.push_back(cluster.getLink() ? addNode(cluster.getLink()) : -1);
+					bind_matrices.push_back(cluster.getTransformMatrix());
+				}
+			}
+
+			const BlendShape* blend_shape = geom.getBlendShape();
+			if (blend_shape)
+			{
+				for (int i = 0, c = blend_shape->getBlendShapeChannelCount(); i < c; ++i)
+				{
+					const BlendShapeChannel* channel = blend_shape->getBlendShapeChannel(i);
+					channels.push_back({channel, layer ? layer->getCurveNode(*channel, "DeformPercent") : nullptr});
+					for (int j = 0, sc = channel->getShapeCount(); j < sc; ++j) shapes.push_back(channel->getShape(j));
+				}
+			}
+		}
+
+
+		void evalGlobals(double time, Frame* frame) const
+		{
+			frame->globals.resize(nodes.size());
+			for (int i = 0, c = (int)nodes.size(); i < c; ++i)
+			{
+				const Node& node = nodes[i];
+				const Vec3 translation = node.translation ? node.translation->getNodeLocalTransform(time) : node.object->getLocalTranslation();
+				const Vec3 rotation = node.rotation ? node.rotation->getNodeLocalTransform(time) : node.object->getLocalRotation();
+				const Matrix local = node.object->evalLocal(translation, rotation);
+				frame->globals[i] = node.parent < 0 ? local : frame->globals[node.parent] * local;
+			}
+		}
+
+
+		// base mesh with the blend shapes at their animated weights
+		void applyBlendShapes(double time, Frame* frame) const
+		{
+			const std::vector<Vec3>& vertices = geom.getVertices();
+			const std::vector<Vec3>& normals = geom.getNormals();
+			frame->positions = vertices;
+			frame->normals = normals;
+			if (shapes.empty()) return;
+
+			frame->shape_weights.resize(shapes.size());
+			double* weights = &frame->shape_weights[0];
+			for (const Channel& channel : channels)
+			{
+				const double percent =
+					channel.deform_percent ? channel.deform_percent->getNodeLocalTransform(time).x : channel.channel->getDeformPercent();
+				channel.channel->getShapeWeights(percent, weights);
+				weights += channel.channel->getShapeCount();
+			}
+			applyShapes(&vertices[0],
+				normals.empty() ? nullptr : &normals[0],
+				(int)vertices.size(),
+				&shapes[0],
+				&frame->shape_weights[0],
+				(int)shapes.size(),
+				&frame->positions[0],
+				normals.empty() ? nullptr : &frame->normals[0]);
+		}
+
+
+		// linear blend skinning, vertices without weights follow the mesh node
+		void skin(Frame* frame) const
+		{
+			const int vertex_count = (int)frame->positions.size();
+			const bool has_normals = !frame->normals.empty();
+			frame->skinned_positions.assign(vertex_count, {0, 0, 0});
+			frame->skinned_normals.assign(has_normals ? vertex_count : 0, {0, 0, 0});
+			frame->weight_sums.assign(vertex_count, 0);
+
+			const Skin& skin = *geom.getSkin();
+			for (int c = 0, cc = skin.getClusterCount(); c < cc; ++c)
+			{
+				if (cluster_nodes[c] < 0) continue;
+				const Cluster& cluster = *skin.getCluster(c);
+				const Matrix skin_matrix = frame->globals[cluster_nodes[c]] * bind_matrices[c];
+				const double* m = skin_matrix.m;
+				const int* indices = cluster.getIndices();
+				const double* weights = cluster.getWeights();
+				for (int i = 0, ic = cluster.getIndicesCount(); i < ic; ++i)
+				{
+					const int v = indices[i];
+					const double w = weights[i];
+					if (v < 0 || v >= vertex_count || w <= 0) continue;
+
+					const Vec3& p = frame->positions[v];
+					Vec3& out = frame->skinned_positions[v];
+					out.x += w * (m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12]);
+					out.y += w * (m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13]);
+					out.z += w * (m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]);
+					frame->weight_sums[v] += w;
+					if (has_normals)
+					{
+						const Vec3& n = frame->normals[v];
+						Vec3& out_n = frame->skinned_normals[v];
+						out_n.x += w * (m[0] * n.x + m[4] * n.y + m[8] * n.z);
+						out_n.y += w * (m[1] * n.x + m[5] * n.y + m[9] * n.z);
+						out_n.z += w * (m[2] * n.x + m[6] * n.y + m[10] * n.z);
+					}
+				}
+			}
+
+			const Matrix rigid = frame->globals[mesh_node] * mesh.getGeometricMatrix();
+			const Matrix rigid_normal = getNormalMatrix(rigid);
+			for (int v = 0; v < vertex_count; ++v)
+			{
+				const double sum = frame->weight_sums[v];
+				if (sum > 0)
+				{
+					Vec3& p = frame->skinned_positions[v];
+					p = {p.x / sum, p.y / sum, p.z / sum};
+				}
+				else
+				{
+					frame->skinned_positions[v] = frame->positions[v];
+					transformPoints(rigid, &frame->skinned_positions[v], 1);
+					if (has_normals)
+					{
+						frame->skinned_normals[v] = frame->normals[v];
+						transformVectors(rigid_normal, &frame->skinned_normals[v], 1, false);
+					}
+				}
+			}
+			frame->positions.swap(frame->skinned_positions);
+			frame->normals.swap(frame->skinned_normals);
+			if (has_normals) transformVectors(makeIdentity(), &frame->normals[0], vertex_count, true);
+		}
+
+
+		// world space positions and normals at time
+		void pose(double time, Frame* frame) const
+		{
+			evalGlobals(time, frame);
+			applyBlendShapes(time, frame);
+			if (geom.getSkin())
+			{
+				skin(frame);
+			}
+			else
+			{
+				const Matrix mtx = frame->globals[mesh_node] * mesh.getGeometricMatrix();
+				transformPoints(mtx, &frame->positions[0], (int)frame->positions.size());
+				if (!frame->normals.empty())
+				{
+					transformVectors(getNormalMatrix(mtx), &frame->normals[0], (int)frame->normals.size(), true);
+				}
+			}
+		}
+
+
+		void bakeFrame(int frame_index, Frame* frame, float* positions, float* normals, Vec3* min, Vec3* max) const
+		{
+			pose(start_time + frame_index / frame_rate, frame);
+
+			*min = {DBL_MAX, DBL_MAX, DBL_MAX};
+			*max = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+			for (int v = 0, c = (int)frame->positions.size(); v < c; ++v)
+			{
+				const Vec3& p = frame->positions[v];
+				positions[v * 3 + 0] = (float)p.x;
+				positions[v * 3 + 1] = (float)p.y;
+				positions[v * 3 + 2] = (float)p.z;
+				*min = {std::min(min->x, p.x), std::min(min->y, p.y), std::min(min->z, p.z)};
+				*max = {std::max(max->x, p.x), std::max(max->y, p.y), std::max(max->z, p.z)};
+
+				const Vec3 n = frame->normals.empty() ? Vec3{0, 0, 0} : frame->normals[v];
+				normals[v * 3 + 0] = (float)n.x;
+				normals[v * 3 + 1] = (float)n.y;
+				normals[v * 3 + 2] = (float)n.z;
+			}
+		}
+
+
+		const Mesh& mesh;
+		const Geometry& geom;
+		const AnimationLayer* layer;
+		double start_time = 0;
+		double frame_rate = 30;
+		std::vector<Node> nodes;
+		std::unordered_map<const Object*, int> node_map;
+		int mesh_node = -1;
+		std::vector<int> cluster_nodes;
+		std::vector<Matrix> bind_matrices;
+		std::vector<Channel> channels;
+		std::vector<const Shape*> shapes;
+	};
+
+
+	void poseMesh(const Mesh& mesh, const AnimationLayer* layer, double time, std::vector<Vec3>* positions, std::vector<Vec3>* normals)
+	{
+		assert(mesh.getGeometry());
+		VertexAnimationBaker baker(mesh, layer);
+		baker.init();
+		VertexAnimationBaker::Frame frame;
+		baker.pose(time, &frame);
+		positions->swap(frame.positions);
+		normals->swap(frame.normals);
+	}
+
+
+	static u16 quantize16(double value, double min, double extent)
+	{
+		if (extent <= 0) return 0;
+		const double q = (value - min) / extent * 65535 + 0.5;
+		return (u16)std::max(0.0, std::min(65535.0, q));
+	}
+
+
+	static u8 quantize8(double value)
+	{
+		const double q = (value * 0.5 + 0.5) * 255 + 0.5;
+		return (u8)std::max(0.0, std::min(255.0, q));
+	}
+
+
+	bool bakeVertexAnimation(const Mesh& mesh,
+		const AnimationStack& stack,
+		const VertexAnimationSettings& settings,
+		VertexAnimation* animation)
+	{
+		assert(animation);
+		*animation = VertexAnimation();
+		const Geometry* geom = mesh.getGeometry();
+		if (!geom || geom->getVertices().empty())
+		{
+			Error::s_message = "Mesh has no geometry";
+			return false;
+		}
+
+		double start_time = settings.start_time;
+		double end_time = settings.end_time;
+		if (end_time < start_time)
+		{
+			const TakeInfo* take = stack.getScene().getTakeInfo(stack.name);
+			start_time = take ? take->local_time_from : 0;
+			end_time = take ? take->local_time_to : 0;
+		}
+		if (settings.frame_rate <= 0 || end_time < start_time)
+		{
+			Error::s_message = "Invalid frame range";
+			return false;
+		}
+
+		VertexAnimationBaker baker(mesh, stack.getLayer(0));
+		baker.start_time = start_time;
+		baker.frame_rate = settings.frame_rate;
+		baker.init();
+
+		const int vertex_count = (int)geom->getVertices().size();
+		// a small epsilon so that a range of whole frames is not cut by rounding
+		const int frame_count = int((end_time - start_time) * settings.frame_rate + 1e-6) + 1;
+		animation->vertex_count = vertex_count;
+		animation->frame_count = frame_count;
+		animation->frame_rate = settings.frame_rate;
+		animation->start_time = start_time;
+		animation->frame_min.resize(frame_count);
+		animation->frame_max.resize(frame_count);
+
+		// unquantized frames are needed until the bounds of all frames are known
+		std::vector<float> positions((size_t)frame_count * vertex_count * 3);
+		std::vector<float> normals((size_t)frame_count * vertex_count * 3);
+		// contiguous chunks of frames so that each job reuses its temporaries
+		int job_count = settings.thread_count > 0 ? settings.thread_count : (int)std::thread::hardware_concurrency();
+		job_count = std::max(1, std::min(job_count, frame_count));
+		parallelFor(job_count, job_count, [&](int job) {
+			VertexAnimationBaker::Frame frame;
+			const int from = int((long long)frame_count * job / job_count);
+			const int to = int((long long)frame_count * (job + 1) / job_count);
+			for (int i = from; i < to; ++i)
+			{
+				const size_t offset = (size_t)i * vertex_count * 3;
+				baker.bakeFrame(i, &frame, &positions[offset], &normals[offset], &animation->frame_min[i], &animation->frame_max[i]);
+			}
+		});
+
+		animation->min = animation->frame_min[0];
+		animation->max = animation->frame_max[0];
+		for (int i = 1; i < frame_count; ++i)
+		{
+			const Vec3& a = animation->frame_min[i];
+			const Vec3& b = animation->frame_max[i];
+			animation->min = {std::min(animation->min.x, a.x), std::min(animation->min.y, a.y), std::min(animation->min.z, a.z)};
+			animation->max = {std::max(animation->max.x, b.x), std::max(animation->max.y, b.y), std::max(animation->max.z, b.z)};
+		}
+
+		const Vec3 min = animation->min;
+		const Vec3 extent = {animation->max.x - min.x, animation->max.y - min.y, animation->max.z - min.z};
+		animation->positions.resize((size_t)frame_count * vertex_count * 4);
+		animation->normals.resize((size_t)frame_count * vertex_count * 4);
+		parallelFor(job_count, job_count, [&](int job) {
+			const int from = int((long long)frame_count * job / job_count);
+			const int to = int((long long)frame_count * (job + 1) / job_count);
+			for (size_t v = (size_t)from * vertex_count, end = (size_t)to * vertex_count; v < end; ++v)
+			{
+				const float* p = &positions[v * 3];
+				const float* n = &normals[v * 3];
+				u16* out_p = &animation->positions[v * 4];
+				u8* out_n = &animation->normals[v * 4];
+				out_p[0] = quantize16(p[0], min.x, extent.x);
+				out_p[1] = quantize16(p[1], min.y, extent.y);
+				out_p[2] = quantize16(p[2], min.z, extent.z);
+				out_p[3] = 0xffff;
+				out_n[0] = quantize8(n[0]);
+				out_n[1] = quantize8(n[1]);
+				out_n[2] = quantize8(n[2]);
+				out_n[3] = 0xff;
+			}
+		});
+		return true;
+	}
+
+} // namespace ofbx